@@ -4,6 +4,16 @@
 	MAGIC equ 0x1BADB002
 	CHECKSUM equ - (MAGIC + FLAGS)
 	
+	; Must match KERNEL_VMA and DIRECT_MAP_SIZE in mm/pmm.h
+	KERNEL_VMA equ 0xC0000000
+	DIRECT_MAP_PDES equ 224
+	
+	PDE_PRESENT equ 1 << 0
+	PDE_WRITE equ 1 << 1
+	PDE_LARGE equ 1 << 7
+	CR0_PG equ 1 << 31
+	CR4_PSE equ 1 << 4
+	
 	section .multiboot
 	align 4
 	dd MAGIC
@@ -11,15 +21,59 @@
 	dd CHECKSUM
 	
 	section .bss
+	align 4096
+	; APs also start on this directory, see smp-asm.asm
+global boot_page_directory
+boot_page_directory:
+	resb 4096
 	align 16
 stack_bottom:
 	resb 16384
+global stack_top
 stack_top:
 	
-	section .text
+	; Runs at its physical address until paging is on
+	section .boot.text progbits alloc exec nowrite align=16
 global _start:function (_start.end - _start)
 _start:
+	mov esi, eax
+	
+	; Direct map the bottom of physical memory at KERNEL_VMA with 4 MiB pages
+	mov ecx, boot_page_directory - KERNEL_VMA
+	lea edi, [ecx + (KERNEL_VMA >> 22) * 4]
+	mov eax, PDE_PRESENT | PDE_WRITE | PDE_LARGE
+	mov edx, DIRECT_MAP_PDES
+.fill:
+	mov [edi], eax
+	add eax, 0x400000
+	add edi, 4
+	dec edx
+	jnz .fill
+	
+	; Keep the first 4 MiB identity mapped until we are running up high
+	mov dword [ecx], PDE_PRESENT | PDE_WRITE | PDE_LARGE
+	
+	mov eax, cr4
+	or eax, CR4_PSE
+	mov cr4, eax
+	mov cr3, ecx
+	mov eax, cr0
+	or eax, CR0_PG
+	mov cr0, eax
+	
+	mov eax, higher_half
+	jmp eax
+	.end:
+	
+	section .text
+higher_half:
 	mov esp, stack_top
+	; A null frame pointer ends every backtrace
+	xor ebp, ebp
+	
+	; Hand the multiboot magic and info structure to the kernel
+	push ebx
+	push esi
 	
 	extern kernel_main
 	call kernel_main
@@ -27,4 +81,3 @@ _start:
 	cli
 	hlt
 	jmp $
-	.end:
@@ -0,0 +1,268 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/acpi.h>
+#include <cpu/paging.h>
+#include <libk/io.h>
+#include <libk/string.h>
+#include <mm/pmm.h>
+
+#define ACPI_BIOS_AREA_START 0xE0000
+#define ACPI_BIOS_AREA_END 0x100000
+#define ACPI_EBDA_POINTER 0x40E
+
+#define MADT_TYPE_LAPIC 0
+#define MADT_TYPE_IOAPIC 1
+#define MADT_TYPE_OVERRIDE 2
+#define MADT_TYPE_LAPIC_ADDR 5
+
+#define MADT_LAPIC_ENABLED (1 << 0)
+#define MADT_LAPIC_ONLINE_CAPABLE (1 << 1)
+
+typedef struct acpi_rsdp_t
+{
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr;
+    uint32_t length;
+    uint64_t xsdt_addr;
+    uint8_t ext_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct acpi_madt_t
+{
+    acpi_sdt_header_t header;
+    uint32_t lapic_addr;
+    uint32_t flags;
+    uint8_t entries[];
+} __attribute__((packed)) acpi_madt_t;
+
+typedef struct madt_entry_t
+{
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed)) madt_entry_t;
+
+typedef struct madt_lapic_t
+{
+    madt_entry_t header;
+    uint8_t acpi_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed)) madt_lapic_t;
+
+typedef struct madt_ioapic_t
+{
+    madt_entry_t header;
+    uint8_t id;
+    uint8_t reserved;
+    uint32_t addr;
+    uint32_t gsi_base;
+} __attribute__((packed)) madt_ioapic_t;
+
+typedef struct madt_override_t
+{
+    madt_entry_t header;
+    uint8_t bus;
+    uint8_t source;
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__((packed)) madt_override_t;
+
+typedef struct madt_lapic_addr_t
+{
+    madt_entry_t header;
+    uint16_t reserved;
+    uint64_t addr;
+} __attribute__((packed)) madt_lapic_addr_t;
+
+acpi_madt_info_t acpi_madt;
+
+static acpi_sdt_header_t *acpi_root;
+static bool acpi_root_is_xsdt;
+
+static bool acpi_checksum(const void *ptr, size_t len)
+{
+    const uint8_t *bytes = ptr;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+// Firmware tables normally sit in the direct map, the rest get mapped in
+static void *acpi_map(uintptr_t phys, size_t len)
+{
+    if (phys + len <= DIRECT_MAP_SIZE)
+    {
+        return phys_to_virt(phys);
+    }
+    return paging_map_mmio(phys, len);
+}
+
+static acpi_sdt_header_t *acpi_map_table(uintptr_t phys)
+{
+    acpi_sdt_header_t *header = acpi_map(phys, sizeof(acpi_sdt_header_t));
+    if (header == NULL)
+    {
+        return NULL;
+    }
+    if (phys + header->length > DIRECT_MAP_SIZE)
+    {
+        header = acpi_map(phys, header->length);
+    }
+    if (header == NULL || !acpi_checksum(header, header->length))
+    {
+        return NULL;
+    }
+    return header;
+}
+
+static acpi_rsdp_t *acpi_scan(uintptr_t start, uintptr_t end)
+{
+    for (uintptr_t addr = start; addr + sizeof(acpi_rsdp_t) <= end; addr += 16)
+    {
+        acpi_rsdp_t *rsdp = phys_to_virt(addr);
+        if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && acpi_checksum(rsdp, 20))
+        {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+static acpi_rsdp_t *acpi_find_rsdp(void)
+{
+    uintptr_t ebda = (uintptr_t) *(uint16_t*) phys_to_virt(ACPI_EBDA_POINTER) << 4;
+    acpi_rsdp_t *rsdp = NULL;
+    if (ebda != 0)
+    {
+        rsdp = acpi_scan(ebda, ebda + 1024);
+    }
+    if (rsdp == NULL)
+    {
+        rsdp = acpi_scan(ACPI_BIOS_AREA_START, ACPI_BIOS_AREA_END);
+    }
+    return rsdp;
+}
+
+acpi_sdt_header_t *acpi_find_table(const char *signature)
+{
+    if (acpi_root == NULL)
+    {
+        return NULL;
+    }
+
+    size_t entry_size = acpi_root_is_xsdt ? sizeof(uint64_t) : sizeof(uint32_t);
+    size_t count = (acpi_root->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    uint8_t *entries = (uint8_t*) (acpi_root + 1);
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t phys = acpi_root_is_xsdt
+            ? *(uint64_t*) (entries + i * entry_size)
+            : *(uint32_t*) (entries + i * entry_size);
+        if (phys >> 32)
+        {
+            continue;
+        }
+
+        acpi_sdt_header_t *table = acpi_map_table(phys);
+        if (table != NULL && memcmp(table->signature, signature, 4) == 0)
+        {
+            return table;
+        }
+    }
+    return NULL;
+}
+
+static void acpi_parse_madt(acpi_madt_t *madt)
+{
+    acpi_madt.lapic_addr = madt->lapic_addr;
+
+    uint8_t *ptr = madt->entries;
+    uint8_t *end = (uint8_t*) madt + madt->header.length;
+    while (ptr + sizeof(madt_entry_t) <= end)
+    {
+        madt_entry_t *entry = (madt_entry_t*) ptr;
+        if (entry->length < sizeof(madt_entry_t))
+        {
+            break;
+        }
+
+        if (entry->type == MADT_TYPE_LAPIC)
+        {
+            madt_lapic_t *lapic = (madt_lapic_t*) entry;
+            if ((lapic->flags & (MADT_LAPIC_ENABLED | MADT_LAPIC_ONLINE_CAPABLE))
+                && acpi_madt.cpu_count < MAX_CPUS)
+            {
+                acpi_madt.cpu_apic_ids[acpi_madt.cpu_count++] = lapic->apic_id;
+            }
+        }
+        else if (entry->type == MADT_TYPE_IOAPIC && acpi_madt.ioapic_count < ACPI_MAX_IOAPICS)
+        {
+            madt_ioapic_t *ioapic = (madt_ioapic_t*) entry;
+            acpi_ioapic_t *info = &acpi_madt.ioapics[acpi_madt.ioapic_count++];
+            info->id = ioapic->id;
+            info->addr = ioapic->addr;
+            info->gsi_base = ioapic->gsi_base;
+        }
+        else if (entry->type == MADT_TYPE_OVERRIDE && acpi_madt.override_count < ACPI_MAX_OVERRIDES)
+        {
+            madt_override_t *override = (madt_override_t*) entry;
+            acpi_override_t *info = &acpi_madt.overrides[acpi_madt.override_count++];
+            info->source = override->source;
+            info->gsi = override->gsi;
+            info->flags = override->flags;
+        }
+        else if (entry->type == MADT_TYPE_LAPIC_ADDR)
+        {
+            madt_lapic_addr_t *addr = (madt_lapic_addr_t*) entry;
+            if (!(addr->addr >> 32))
+            {
+                acpi_madt.lapic_addr = addr->addr;
+            }
+        }
+
+        ptr += entry->length;
+    }
+}
+
+bool acpi_init(void)
+{
+    acpi_rsdp_t *rsdp = acpi_find_rsdp();
+    if (rsdp == NULL)
+    {
+        kprintf("acpi: no RSDP found\n");
+        return false;
+    }
+
+    if (rsdp->revision >= 2 && rsdp->xsdt_addr != 0 && !(rsdp->xsdt_addr >> 32)
+        && acpi_checksum(rsdp, rsdp->length))
+    {
+        acpi_root = acpi_map_table(rsdp->xsdt_addr);
+        acpi_root_is_xsdt = acpi_root != NULL;
+    }
+    if (acpi_root == NULL)
+    {
+        acpi_root = acpi_map_table(rsdp->rsdt_addr);
+    }
+    if (acpi_root == NULL)
+    {
+        kprintf("acpi: bad root table\n");
+        return false;
+    }
+
+    acpi_madt_t *madt = (acpi_madt_t*) acpi_find_table("APIC");
+    if (madt == NULL)
+    {
+        kprintf("acpi: no MADT\n");
+        return false;
+    }
+    acpi_parse_madt(madt);
+    return true;
+}
@@ -0,0 +1,199 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/acpi.h>
+#include <cpu/apic.h>
+#include <cpu/features.h>
+#include <cpu/msr.h>
+#include <cpu/paging.h>
+#include <libk/io.h>
+#include <mm/pmm.h>
+
+#define APIC_BASE_ENABLE (1 << 11)
+#define APIC_BASE_ADDR_MASK 0xFFFFF000
+
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WINDOW 0x10
+#define IOAPIC_REG_VERSION 0x01
+#define IOAPIC_REG_REDIR 0x10
+
+typedef struct ioapic_t
+{
+    volatile uint32_t *base;
+    uint32_t gsi_base;
+    uint32_t gsi_count;
+} ioapic_t;
+
+volatile uint32_t *lapic_base;
+
+static ioapic_t ioapics[ACPI_MAX_IOAPICS];
+static uint32_t ioapic_count;
+
+bool apic_supported(void)
+{
+    return cpu_has(CPU_FEATURE_APIC) && cpu_has(CPU_FEATURE_MSR);
+}
+
+bool lapic_init(uint32_t phys)
+{
+    if (lapic_base == NULL)
+    {
+        uint64_t base = rdmsr(MSR_IA32_APIC_BASE);
+        if (phys == 0)
+        {
+            phys = base & APIC_BASE_ADDR_MASK;
+        }
+        wrmsr(MSR_IA32_APIC_BASE, (base & ~(uint64_t) APIC_BASE_ADDR_MASK) | phys | APIC_BASE_ENABLE);
+
+        lapic_base = paging_map_mmio(phys, PAGE_SIZE);
+        if (lapic_base == NULL)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        wrmsr(MSR_IA32_APIC_BASE, rdmsr(MSR_IA32_APIC_BASE) | APIC_BASE_ENABLE);
+    }
+
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_ERROR_VECTOR);
+    // The ESR latches on write, so it takes two writes to clear it
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+    lapic_eoi();
+    return true;
+}
+
+uint8_t lapic_id(void)
+{
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint32_t icr)
+{
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t) apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, icr);
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING)
+    {
+        asm volatile("pause");
+    }
+}
+
+static uint32_t ioapic_read(ioapic_t *ioapic, uint8_t reg)
+{
+    ioapic->base[IOAPIC_REGSEL / 4] = reg;
+    return ioapic->base[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(ioapic_t *ioapic, uint8_t reg, uint32_t val)
+{
+    ioapic->base[IOAPIC_REGSEL / 4] = reg;
+    ioapic->base[IOAPIC_WINDOW / 4] = val;
+}
+
+static ioapic_t *ioapic_for(uint32_t gsi)
+{
+    for (uint32_t i = 0; i < ioapic_count; ++i)
+    {
+        if (gsi >= ioapics[i].gsi_base && gsi < ioapics[i].gsi_base + ioapics[i].gsi_count)
+        {
+            return &ioapics[i];
+        }
+    }
+    return NULL;
+}
+
+bool ioapic_init(void)
+{
+    for (uint32_t i = 0; i < acpi_madt.ioapic_count; ++i)
+    {
+        ioapic_t *ioapic = &ioapics[ioapic_count];
+        ioapic->base = paging_map_mmio(acpi_madt.ioapics[i].addr, PAGE_SIZE);
+        if (ioapic->base == NULL)
+        {
+            continue;
+        }
+        ioapic->gsi_base = acpi_madt.ioapics[i].gsi_base;
+        ioapic->gsi_count = ((ioapic_read(ioapic, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+
+        for (uint32_t pin = 0; pin < ioapic->gsi_count; ++pin)
+        {
+            ioapic_write(ioapic, IOAPIC_REG_REDIR + pin * 2, IOAPIC_REDIR_MASKED);
+            ioapic_write(ioapic, IOAPIC_REG_REDIR + pin * 2 + 1, 0);
+        }
+        ++ioapic_count;
+    }
+    return ioapic_count != 0;
+}
+
+// Routes a GSI to the BSP, flags are the MADT override polarity/trigger bits
+bool ioapic_route(uint32_t gsi, uint8_t vector, uint16_t flags)
+{
+    ioapic_t *ioapic = ioapic_for(gsi);
+    if (ioapic == NULL)
+    {
+        return false;
+    }
+
+    uint32_t low = vector | IOAPIC_REDIR_MASKED;
+    if ((flags & ACPI_MADT_POLARITY_MASK) == ACPI_MADT_POLARITY_LOW)
+    {
+        low |= IOAPIC_REDIR_ACTIVE_LOW;
+    }
+    if ((flags & ACPI_MADT_TRIGGER_MASK) == ACPI_MADT_TRIGGER_LEVEL)
+    {
+        low |= IOAPIC_REDIR_LEVEL;
+    }
+
+    uint32_t pin = gsi - ioapic->gsi_base;
+    ioapic_write(ioapic, IOAPIC_REG_REDIR + pin * 2 + 1, (uint32_t) lapic_id() << 24);
+    ioapic_write(ioapic, IOAPIC_REG_REDIR + pin * 2, low);
+    return true;
+}
+
+bool ioapic_set_trigger(uint32_t gsi, bool level, bool active_low)
+{
+    ioapic_t *ioapic = ioapic_for(gsi);
+    if (ioapic == NULL)
+    {
+        return false;
+    }
+
+    uint8_t reg = IOAPIC_REG_REDIR + (gsi - ioapic->gsi_base) * 2;
+    uint32_t low = ioapic_read(ioapic, reg) & ~(IOAPIC_REDIR_LEVEL | IOAPIC_REDIR_ACTIVE_LOW);
+    if (level)
+    {
+        low |= IOAPIC_REDIR_LEVEL;
+    }
+    if (active_low)
+    {
+        low |= IOAPIC_REDIR_ACTIVE_LOW;
+    }
+    ioapic_write(ioapic, reg, low);
+    return true;
+}
+
+void ioapic_mask(uint32_t gsi)
+{
+    ioapic_t *ioapic = ioapic_for(gsi);
+    if (ioapic != NULL)
+    {
+        uint8_t reg = IOAPIC_REG_REDIR + (gsi - ioapic->gsi_base) * 2;
+        ioapic_write(ioapic, reg, ioapic_read(ioapic, reg) | IOAPIC_REDIR_MASKED);
+    }
+}
+
+void ioapic_unmask(uint32_t gsi)
+{
+    ioapic_t *ioapic = ioapic_for(gsi);
+    if (ioapic != NULL)
+    {
+        uint8_t reg = IOAPIC_REG_REDIR + (gsi - ioapic->gsi_base) * 2;
+        ioapic_write(ioapic, reg, ioapic_read(ioapic, reg) & ~IOAPIC_REDIR_MASKED);
+    }
+}
@@ -0,0 +1,319 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu/apic.h>
+#include <cpu/features.h>
+#include <cpu/interrupts.h>
+#include <cpu/irq.h>
+#include <cpu/irqflags.h>
+#include <cpu/percpu.h>
+#include <cpu/pit.h>
+#include <cpu/tsc.h>
+#include <debug/profile.h>
+#include <libk/io.h>
+#include <sync/seqlock.h>
+#include <time/clock.h>
+
+#define CLOCK_CALIBRATE_MS 10
+#define CLOCK_CALIBRATE_RUNS 3
+#define CLOCK_CALIBRATE_COUNT (PIT_FREQUENCY / (1000 / CLOCK_CALIBRATE_MS))
+
+#define LAPIC_TIMER_PERIODIC (1 << 17)
+#define LAPIC_TIMER_DIVIDE_16 0x3
+
+typedef enum clock_event_t
+{
+    CLOCK_EVENT_PIT,
+    CLOCK_EVENT_LAPIC,
+} clock_event_t;
+
+// ktime_ns() is (tsc - tsc_base) * tsc_mult >> tsc_shift, the seqlock lets
+// readers on any CPU see the three change together
+static seqlock_t tsc_seq = SEQLOCK_INIT("clocksource");
+static uint64_t tsc_base;
+static uint32_t tsc_mult;
+static uint32_t tsc_shift;
+static uint32_t tsc_khz;
+
+static clock_event_t clock_event;
+static uint32_t lapic_timer_hz;
+// Timer ticks per nanosecond in 32.32 fixed point
+static uint32_t lapic_ns_mult;
+static uint32_t pit_ns_mult;
+
+static volatile uint64_t clock_jiffies;
+static uint32_t clock_hz = CLOCK_HZ;
+static clock_tick_handler_t clock_handler;
+static void *clock_handler_ctx;
+
+static bool tsc_supported(void)
+{
+    return cpu_has(CPU_FEATURE_TSC);
+}
+
+// Runs the gated PIT channel for a fixed interval and counts TSC cycles and
+// LAPIC timer ticks across it. Interference can only make a run longer, so
+// the shortest run wins.
+static void clock_calibrate(bool use_tsc, bool use_lapic)
+{
+    uint64_t best_key = UINT64_MAX;
+    uint64_t best_tsc = 0;
+    uint32_t best_lapic = 0;
+
+    if (use_lapic)
+    {
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+        lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    }
+
+    uint32_t flags = irq_save();
+    for (int run = 0; run < CLOCK_CALIBRATE_RUNS; ++run)
+    {
+        pit_gate_start(CLOCK_CALIBRATE_COUNT);
+        uint64_t tsc_start = use_tsc ? rdtsc() : 0;
+        if (use_lapic)
+        {
+            lapic_write(LAPIC_TIMER_INITIAL, UINT32_MAX);
+        }
+
+        while (!pit_gate_expired())
+        {
+            asm volatile("pause");
+        }
+
+        uint64_t tsc_delta = use_tsc ? rdtsc() - tsc_start : 0;
+        uint32_t lapic_delta = use_lapic ? UINT32_MAX - lapic_read(LAPIC_TIMER_CURRENT) : 0;
+        uint64_t key = use_tsc ? tsc_delta : lapic_delta;
+        if (key < best_key)
+        {
+            best_key = key;
+            best_tsc = tsc_delta;
+            best_lapic = lapic_delta;
+        }
+    }
+    irq_restore(flags);
+
+    if (use_lapic)
+    {
+        lapic_write(LAPIC_TIMER_INITIAL, 0);
+        lapic_timer_hz = best_lapic * (1000 / CLOCK_CALIBRATE_MS);
+        lapic_ns_mult = ((uint64_t) lapic_timer_hz << 32) / NSEC_PER_SEC;
+    }
+
+    if (use_tsc && best_tsc != 0)
+    {
+        tsc_khz = best_tsc / CLOCK_CALIBRATE_MS;
+        // Largest shift that keeps the multiplier in 32 bits keeps the most
+        // precision
+        unsigned shift = 32;
+        uint64_t mult = (NSEC_PER_MSEC << shift) / tsc_khz;
+        while (mult > UINT32_MAX)
+        {
+            --shift;
+            mult = (NSEC_PER_MSEC << shift) / tsc_khz;
+        }
+
+        uint32_t flags = write_seqlock_irqsave(&tsc_seq);
+        tsc_shift = shift;
+        tsc_mult = mult;
+        tsc_base = rdtsc();
+        write_sequnlock_irqrestore(&tsc_seq, flags);
+    }
+}
+
+static void clock_tick(interrupt_registers_t *regs)
+{
+    // Kernel-mode frames have no esp/ss, only cs tells the modes apart
+    profile_sample(regs->eip, (regs->cs & 3) != 0);
+
+    // Every CPU ticks, only the boot CPU keeps time
+    if (cpu_id() == 0)
+    {
+        ++clock_jiffies;
+    }
+    if (clock_handler != NULL)
+    {
+        clock_handler(clock_handler_ctx);
+    }
+}
+
+static void clock_lapic_interrupt(interrupt_registers_t *regs, void *ctx)
+{
+    (void) ctx;
+    clock_tick(regs);
+    lapic_eoi();
+}
+
+static void clock_pit_interrupt(interrupt_registers_t *regs, void *ctx)
+{
+    (void) ctx;
+    clock_tick(regs);
+}
+
+void clock_init(void)
+{
+    bool use_tsc = tsc_supported();
+    bool use_lapic = lapic_base != NULL;
+    clock_calibrate(use_tsc, use_lapic);
+
+    if (use_lapic && lapic_timer_hz != 0)
+    {
+        clock_event = CLOCK_EVENT_LAPIC;
+        register_interrupt_handler(LAPIC_TIMER_VECTOR, clock_lapic_interrupt, NULL);
+    }
+    else
+    {
+        clock_event = CLOCK_EVENT_PIT;
+        pit_ns_mult = ((uint64_t) PIT_FREQUENCY << 32) / NSEC_PER_SEC;
+        irq_register(PIT_IRQ, clock_pit_interrupt, NULL);
+    }
+
+    clock_set_periodic(CLOCK_HZ);
+    kprintf("clock: tsc %d kHz, %s timer\n", tsc_khz,
+        clock_event == CLOCK_EVENT_LAPIC ? "lapic" : "pit");
+}
+
+// The LAPIC timer was calibrated on the boot CPU, all of them run off the
+// same bus clock
+void clock_init_ap(void)
+{
+    if (clock_event == CLOCK_EVENT_LAPIC)
+    {
+        lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+        clock_set_periodic(clock_hz);
+    }
+}
+
+uint64_t ktime_ns(void)
+{
+    if (tsc_mult != 0)
+    {
+        uint32_t seq;
+        uint64_t ns;
+        do
+        {
+            seq = read_seqbegin(&tsc_seq);
+            ns = mul_u64_u32_shr(rdtsc() - tsc_base, tsc_mult, tsc_shift);
+        }
+        while (read_seqretry(&tsc_seq, seq));
+        return ns;
+    }
+
+    // Without a TSC time only advances a tick at a time
+    uint32_t flags = irq_save();
+    uint64_t jiffies = clock_jiffies;
+    irq_restore(flags);
+    return jiffies * (NSEC_PER_SEC / clock_hz);
+}
+
+uint32_t clock_tsc_khz(void)
+{
+    return tsc_khz;
+}
+
+uint64_t clock_ticks(void)
+{
+    uint32_t flags = irq_save();
+    uint64_t jiffies = clock_jiffies;
+    irq_restore(flags);
+    return jiffies;
+}
+
+void clock_set_tick_handler(clock_tick_handler_t handler, void *ctx)
+{
+    uint32_t flags = irq_save();
+    clock_handler = handler;
+    clock_handler_ctx = ctx;
+    irq_restore(flags);
+}
+
+bool clock_set_periodic(uint32_t hz)
+{
+    if (hz == 0)
+    {
+        return false;
+    }
+
+    clock_hz = hz;
+    if (clock_event == CLOCK_EVENT_LAPIC)
+    {
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR | LAPIC_TIMER_PERIODIC);
+        lapic_write(LAPIC_TIMER_INITIAL, lapic_timer_hz / hz);
+    }
+    else
+    {
+        pit_set_periodic(hz);
+    }
+    return true;
+}
+
+// Arms a single expiry delta_ns from now, the PIT can only reach ~55ms so
+// longer sleeps on it wake up early and re-arm
+bool clock_set_oneshot(uint64_t delta_ns)
+{
+    // Tickless needs a clock that keeps running between ticks
+    if (tsc_mult == 0)
+    {
+        return false;
+    }
+
+    if (clock_event == CLOCK_EVENT_LAPIC)
+    {
+        uint64_t ticks = mul_u64_u32_shr(delta_ns, lapic_ns_mult, 32);
+        if (ticks == 0)
+        {
+            ticks = 1;
+        }
+        if (ticks > UINT32_MAX)
+        {
+            ticks = UINT32_MAX;
+        }
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR);
+        lapic_write(LAPIC_TIMER_INITIAL, ticks);
+    }
+    else
+    {
+        uint64_t count = mul_u64_u32_shr(delta_ns, pit_ns_mult, 32);
+        pit_set_oneshot(count > 0xFFFF ? 0xFFFF : count);
+    }
+    return true;
+}
+
+void clock_stop(void)
+{
+    if (clock_event == CLOCK_EVENT_LAPIC)
+    {
+        lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+        lapic_write(LAPIC_TIMER_INITIAL, 0);
+    }
+    else
+    {
+        pit_stop();
+    }
+}
+
+void clock_delay_ns(uint64_t ns)
+{
+    if (tsc_mult != 0)
+    {
+        uint64_t end = ktime_ns() + ns;
+        while (ktime_ns() < end)
+        {
+            asm volatile("pause");
+        }
+        return;
+    }
+
+    while (ns != 0)
+    {
+        uint64_t chunk = ns > 50 * NSEC_PER_MSEC ? 50 * NSEC_PER_MSEC : ns;
+        uint64_t count = mul_u64_u32_shr(chunk, ((uint64_t) PIT_FREQUENCY << 32) / NSEC_PER_SEC, 32);
+        pit_gate_start(count ? count : 1);
+        while (!pit_gate_expired())
+        {
+            asm volatile("pause");
+        }
+        ns -= chunk;
+    }
+}
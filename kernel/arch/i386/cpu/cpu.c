@@ -1,10 +1,41 @@
 #include <cpu.h>
-#include <cpu/gdt.h>
+#include <cpu/features.h>
+#include <cpu/fpu.h>
 #include <cpu/idt.h>
+#include <cpu/irq.h>
+#include <cpu/irqflags.h>
+#include <cpu/paging.h>
+#include <cpu/pmu.h>
+#include <cpu/smp.h>
+#include <debug/boottime.h>
+#include <syscall/syscall.h>
+#include <time/clock.h>
 #include <tty/tty.h>
 
+void arch_early_init(void)
+{
+    // Everything after this reads cpu_has instead of running cpuid
+    cpu_features_init();
+    BOOT_STAGE("gdt");
+    smp_init_boot_cpu();
+    // Before string_init so it can see SSE is usable
+    fpu_init();
+}
+
 void arch_init(void)
 {
-    gdt_init();
+    BOOT_STAGE("idt");
+    cpu_features_print();
     idt_init();
-}
\ No newline at end of file
+    fpu_late_init();
+    BOOT_STAGE("paging");
+    paging_init();
+    BOOT_STAGE("irq");
+    irq_init();
+    BOOT_STAGE("clock");
+    clock_init();
+    BOOT_STAGE("syscall");
+    syscall_init();
+    pmu_init();
+    irq_enable();
+}
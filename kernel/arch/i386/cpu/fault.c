@@ -0,0 +1,101 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/fault.h>
+#include <cpu/interrupts.h>
+#include <cpu/percpu.h>
+#include <cpu/regs.h>
+#include <debug/ksyms.h>
+#include <libk/io.h>
+#include <libk/log.h>
+#include <mm/pmm.h>
+
+#define EFLAGS_VM (1 << 17)
+
+static const char *fault_names[FAULT_VECTORS] = {
+    "divide error", "debug", "NMI", "breakpoint",
+    "overflow", "bound range exceeded", "invalid opcode", "device not available",
+    "double fault", "coprocessor segment overrun", "invalid TSS", "segment not present",
+    "stack fault", "general protection fault", "page fault", "reserved",
+    "x87 floating point error", "alignment check", "machine check", "SIMD floating point error",
+    "virtualization exception", "control protection exception", "reserved", "reserved",
+    "reserved", "reserved", "reserved", "reserved",
+    "hypervisor injection", "VMM communication", "security exception", "reserved",
+};
+
+static void fault_print_address(const char *prefix, uintptr_t addr)
+{
+    uintptr_t offset;
+    const char *name = ksym_lookup(addr, &offset);
+    if (name != NULL)
+    {
+        kprintf("%s0x%x %s+0x%x\n", prefix, addr, name, offset);
+    }
+    else
+    {
+        kprintf("%s0x%x\n", prefix, addr);
+    }
+}
+
+// Frames only ever live on kernel stacks, which are all direct mapped, so
+// checking that keeps a corrupt chain from faulting again
+static bool backtrace_frame_valid(uintptr_t ebp)
+{
+    return ebp >= KERNEL_VMA && ebp < KERNEL_MAP_START - 2 * sizeof(uintptr_t) && (ebp & 3) == 0;
+}
+
+void backtrace_print(uintptr_t ebp)
+{
+    for (unsigned depth = 0; depth < FAULT_BACKTRACE_DEPTH && backtrace_frame_valid(ebp); ++depth)
+    {
+        const uintptr_t *frame = (const uintptr_t*) ebp;
+        // The return address points past the call, look up the call itself
+        if (frame[1] == 0)
+        {
+            return;
+        }
+        fault_print_address("  ", frame[1] - 1);
+
+        // Stacks grow down, every caller's frame is above its callee's
+        if (frame[0] <= ebp)
+        {
+            return;
+        }
+        ebp = frame[0];
+    }
+}
+
+void fault_dump(interrupt_registers_t *regs)
+{
+    // Only a privilege change pushes ss:esp, otherwise the interrupted code
+    // was using the stack right above the frame
+    bool user = (regs->cs & 3) != 0 || (regs->eflags & EFLAGS_VM);
+    uint32_t esp = user ? regs->esp : (uint32_t) &regs->esp;
+    const char *name = regs->int_no < FAULT_VECTORS ? fault_names[regs->int_no] : "interrupt";
+
+    kprintf("fault: %s (vector %u, error %x) in %s mode on cpu %u\n",
+        name, regs->int_no, regs->err_code, user ? "user" : "kernel", cpu_id());
+    fault_print_address("  eip ", regs->eip);
+    kprintf("  eax %x ebx %x ecx %x edx %x\n", regs->eax, regs->ebx, regs->ecx, regs->edx);
+    kprintf("  esi %x edi %x ebp %x esp %x\n", regs->esi, regs->edi, regs->ebp, esp);
+    kprintf("  cs %x ds %x gs %x eflags %x\n", regs->cs, regs->ds, regs->gs, regs->eflags);
+    kprintf("  cr0 %x cr2 %x cr3 %x\n", read_cr0(), read_cr2(), read_cr3());
+
+    if (!user)
+    {
+        kprintf("backtrace:\n");
+        backtrace_print(regs->ebp);
+    }
+    // Inside a handler kprintf only fills the ring and no softirq will
+    // drain it before the cpu halts, so push it out now
+    log_flush();
+}
+
+void fault_report(interrupt_registers_t *regs)
+{
+    fault_dump(regs);
+    for (;;)
+    {
+        asm volatile("cli; hlt");
+    }
+}
@@ -0,0 +1,174 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu/cpuid.h>
+#include <cpu/features.h>
+#include <libk/io.h>
+
+typedef struct cpuid_bit_t
+{
+    cpu_feature_t feature;
+    uint32_t mask;
+} cpuid_bit_t;
+
+static const cpuid_bit_t cpuid_edx_bits[] =
+{
+    { CPU_FEATURE_FPU, CPUID_EDX_FPU },
+    { CPU_FEATURE_PSE, CPUID_EDX_PSE },
+    { CPU_FEATURE_TSC, CPUID_EDX_TSC },
+    { CPU_FEATURE_MSR, CPUID_EDX_MSR },
+    { CPU_FEATURE_APIC, CPUID_EDX_APIC },
+    { CPU_FEATURE_SEP, CPUID_EDX_SEP },
+    { CPU_FEATURE_PGE, CPUID_EDX_PGE },
+    { CPU_FEATURE_FXSR, CPUID_EDX_FXSR },
+    { CPU_FEATURE_SSE, CPUID_EDX_SSE },
+    { CPU_FEATURE_SSE2, CPUID_EDX_SSE2 },
+};
+
+static const cpuid_bit_t cpuid_ecx_bits[] =
+{
+    { CPU_FEATURE_SSE3, CPUID_ECX_SSE3 },
+    { CPU_FEATURE_SSSE3, CPUID_ECX_SSSE3 },
+    { CPU_FEATURE_SSE4_1, CPUID_ECX_SSE4_1 },
+    { CPU_FEATURE_SSE4_2, CPUID_ECX_SSE4_2 },
+    { CPU_FEATURE_POPCNT, CPUID_ECX_POPCNT },
+    { CPU_FEATURE_AVX, CPUID_ECX_AVX },
+};
+
+static const char *const cpu_feature_names[CPU_FEATURE_COUNT] =
+{
+    [CPU_FEATURE_FPU] = "fpu",
+    [CPU_FEATURE_PSE] = "pse",
+    [CPU_FEATURE_TSC] = "tsc",
+    [CPU_FEATURE_MSR] = "msr",
+    [CPU_FEATURE_APIC] = "apic",
+    [CPU_FEATURE_SEP] = "sep",
+    [CPU_FEATURE_PGE] = "pge",
+    [CPU_FEATURE_FXSR] = "fxsr",
+    [CPU_FEATURE_SSE] = "sse",
+    [CPU_FEATURE_SSE2] = "sse2",
+    [CPU_FEATURE_SSE3] = "sse3",
+    [CPU_FEATURE_SSSE3] = "ssse3",
+    [CPU_FEATURE_SSE4_1] = "sse4.1",
+    [CPU_FEATURE_SSE4_2] = "sse4.2",
+    [CPU_FEATURE_POPCNT] = "popcnt",
+    [CPU_FEATURE_AVX] = "avx",
+    [CPU_FEATURE_ERMS] = "erms",
+    [CPU_FEATURE_TSC_INVARIANT] = "invariant-tsc",
+    [CPU_FEATURE_ARCH_PERFMON] = "arch-perfmon",
+    [CPU_FEATURE_MWAIT] = "mwait",
+};
+
+cpu_info_t cpu_info;
+
+static uint32_t cpuid_collect(const cpuid_bit_t *bits, size_t count, uint32_t reg)
+{
+    uint32_t features = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (reg & bits[i].mask)
+        {
+            features |= CPU_FEATURE_BIT(bits[i].feature);
+        }
+    }
+    return features;
+}
+
+// Queried once on the boot CPU, the APs are assumed to match it
+void cpu_features_init(void)
+{
+    uint32_t max_leaf, eax, ebx, ecx, edx;
+    cpuid(CPUID_LEAF_VENDOR, 0, &max_leaf, &ebx, &ecx, &edx);
+    *(uint32_t*) &cpu_info.vendor[0] = ebx;
+    *(uint32_t*) &cpu_info.vendor[4] = edx;
+    *(uint32_t*) &cpu_info.vendor[8] = ecx;
+    cpu_info.vendor[12] = '\0';
+
+    cpuid(CPUID_LEAF_FEATURES, 0, &eax, &ebx, &ecx, &edx);
+    cpu_info.stepping = eax & 0xF;
+    cpu_info.model = (eax >> 4) & 0xF;
+    cpu_info.family = (eax >> 8) & 0xF;
+    if (cpu_info.family == 0xF)
+    {
+        cpu_info.family += (eax >> 20) & 0xFF;
+    }
+    if (cpu_info.family == 0x6 || cpu_info.family >= 0xF)
+    {
+        cpu_info.model |= ((eax >> 16) & 0xF) << 4;
+    }
+
+    uint32_t features = cpuid_collect(cpuid_edx_bits, sizeof(cpuid_edx_bits) / sizeof(cpuid_edx_bits[0]), edx);
+    features |= cpuid_collect(cpuid_ecx_bits, sizeof(cpuid_ecx_bits) / sizeof(cpuid_ecx_bits[0]), ecx);
+
+    // The Pentium Pro reports SEP without implementing it
+    if (cpu_info.family == 6 && cpu_info.model < 3 && cpu_info.stepping < 3)
+    {
+        features &= ~CPU_FEATURE_BIT(CPU_FEATURE_SEP);
+    }
+
+    // Some hypervisors advertise MONITOR with an empty leaf 5, without a
+    // line size there is nothing sensible to monitor
+    if ((ecx & CPUID_ECX_MONITOR) && max_leaf >= CPUID_LEAF_MWAIT)
+    {
+        cpuid(CPUID_LEAF_MWAIT, 0, &eax, &ebx, &ecx, &edx);
+        cpu_info.monitor_line = ebx & CPUID_MWAIT_EBX_LINE_MASK;
+        if (cpu_info.monitor_line != 0)
+        {
+            features |= CPU_FEATURE_BIT(CPU_FEATURE_MWAIT);
+        }
+    }
+
+    if (max_leaf >= CPUID_LEAF_EXT_FEATURES)
+    {
+        cpuid(CPUID_LEAF_EXT_FEATURES, 0, &eax, &ebx, &ecx, &edx);
+        if (ebx & CPUID_EXT_EBX_ERMS)
+        {
+            features |= CPU_FEATURE_BIT(CPU_FEATURE_ERMS);
+        }
+    }
+
+    if (max_leaf >= CPUID_LEAF_PERFMON)
+    {
+        cpuid(CPUID_LEAF_PERFMON, 0, &eax, &ebx, &ecx, &edx);
+        cpu_info.pmu_version = eax & 0xFF;
+        cpu_info.pmu_counters = (eax >> 8) & 0xFF;
+        cpu_info.pmu_counter_width = (eax >> 16) & 0xFF;
+        // EBX flags the events that are missing, only the first
+        // EAX[31:24] bits of it mean anything
+        uint32_t length = (eax >> 24) & 0xFF;
+        uint32_t valid = length >= 8 ? 0xFF : (1u << length) - 1;
+        cpu_info.pmu_events = ~ebx & valid;
+        if (cpu_info.pmu_version != 0 && cpu_info.pmu_counters != 0)
+        {
+            features |= CPU_FEATURE_BIT(CPU_FEATURE_ARCH_PERFMON);
+        }
+    }
+
+    uint32_t max_ext_leaf;
+    cpuid(CPUID_LEAF_EXT_MAX, 0, &max_ext_leaf, &ebx, &ecx, &edx);
+    if (max_ext_leaf >= CPUID_LEAF_POWER)
+    {
+        cpuid(CPUID_LEAF_POWER, 0, &eax, &ebx, &ecx, &edx);
+        if (edx & CPUID_POWER_EDX_INVARIANT_TSC)
+        {
+            features |= CPU_FEATURE_BIT(CPU_FEATURE_TSC_INVARIANT);
+        }
+    }
+
+    cpu_info.features = features;
+}
+
+void cpu_features_print(void)
+{
+    kprintf("cpu: %s family %d model %d stepping %d\ncpu:", cpu_info.vendor,
+        cpu_info.family, cpu_info.model, cpu_info.stepping);
+    for (int i = 0; i < CPU_FEATURE_COUNT; ++i)
+    {
+        if (cpu_has(i))
+        {
+            kprintf(" %s", cpu_feature_names[i]);
+        }
+    }
+    kprintf("\n");
+}
@@ -0,0 +1,185 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu/features.h>
+#include <cpu/fpu.h>
+#include <cpu/interrupts.h>
+#include <cpu/irqflags.h>
+#include <cpu/percpu.h>
+#include <cpu/regs.h>
+#include <libk/io.h>
+#include <mm/slab.h>
+#include <sched/sched.h>
+#include <sched/task.h>
+
+#define MXCSR_DEFAULT 0x1F80
+
+static bool fpu_has_fxsr;
+static bool fpu_has_sse;
+static kmem_cache_t *fpu_state_cache;
+
+static void fpu_save(void *state)
+{
+    if (fpu_has_fxsr)
+    {
+        asm volatile("fxsave (%0)" : : "r"(state) : "memory");
+    }
+    else
+    {
+        asm volatile("fnsave (%0)" : : "r"(state) : "memory");
+    }
+}
+
+static void fpu_restore(void *state)
+{
+    if (fpu_has_fxsr)
+    {
+        asm volatile("fxrstor (%0)" : : "r"(state) : "memory");
+    }
+    else
+    {
+        asm volatile("frstor (%0)" : : "r"(state) : "memory");
+    }
+}
+
+static void fpu_reset(void)
+{
+    asm volatile("fninit");
+    if (fpu_has_sse)
+    {
+        uint32_t mxcsr = MXCSR_DEFAULT;
+        asm volatile("ldmxcsr %0" : : "m"(mxcsr));
+    }
+}
+
+// Runs on every CPU. The FPU is left trapping, the first task to use it
+// takes the #NM and gets its state loaded then.
+void fpu_init(void)
+{
+    if (!cpu_has(CPU_FEATURE_FPU))
+    {
+        return;
+    }
+    fpu_has_fxsr = cpu_has(CPU_FEATURE_FXSR);
+    fpu_has_sse = fpu_has_fxsr && cpu_has(CPU_FEATURE_SSE);
+
+    write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+    if (fpu_has_fxsr)
+    {
+        uint32_t cr4 = read_cr4() | CR4_OSFXSR;
+        if (fpu_has_sse)
+        {
+            cr4 |= CR4_OSXMMEXCPT;
+        }
+        write_cr4(cr4);
+    }
+    fpu_reset();
+    stts();
+}
+
+static void fpu_nm_handler(interrupt_registers_t *regs, void *ctx)
+{
+    (void) regs;
+    (void) ctx;
+    clts();
+
+    percpu_t *cpu = this_cpu();
+    task_t *task = current_task();
+    if (task == NULL || cpu->fpu_owner == task)
+    {
+        return;
+    }
+
+    if (cpu->fpu_owner != NULL)
+    {
+        fpu_save(cpu->fpu_owner->fpu_state);
+    }
+    cpu->fpu_owner = task;
+
+    if (task->fpu_state != NULL)
+    {
+        fpu_restore(task->fpu_state);
+        return;
+    }
+
+    // Without somewhere to save it the state could not survive the next
+    // owner change, and exceptions have no way to kill the task yet
+    task->fpu_state = kmem_cache_alloc(fpu_state_cache);
+    if (task->fpu_state == NULL)
+    {
+        kprintf("fpu: no memory for the state of task %d\n", task->tid);
+        for (;;)
+        {
+            asm volatile("cli; hlt");
+        }
+    }
+    fpu_reset();
+}
+
+void fpu_late_init(void)
+{
+    fpu_state_cache = kmem_cache_create("fpu_state", FPU_STATE_SIZE, FPU_STATE_ALIGN, NULL);
+    register_interrupt_handler(FPU_NM_VECTOR, fpu_nm_handler, NULL);
+}
+
+// Only the owner may run with TS clear, everyone else traps on first use
+void fpu_switch(task_t *next)
+{
+    if (this_cpu()->fpu_owner == next)
+    {
+        clts();
+    }
+    else
+    {
+        stts();
+    }
+}
+
+void fpu_task_exit(task_t *task)
+{
+    percpu_t *cpu = this_cpu();
+    if (cpu->fpu_owner == task)
+    {
+        cpu->fpu_owner = NULL;
+    }
+    if (task->fpu_state != NULL)
+    {
+        kmem_cache_free(fpu_state_cache, task->fpu_state);
+        task->fpu_state = NULL;
+    }
+}
+
+bool kernel_fpu_begin(void)
+{
+    uint32_t flags = irq_save();
+    percpu_t *cpu = this_cpu();
+    if (cpu->kernel_fpu_active)
+    {
+        irq_restore(flags);
+        return false;
+    }
+    cpu->kernel_fpu_active = true;
+    preempt_disable();
+
+    // Park the owner's registers, it reloads them on its next #NM
+    clts();
+    if (cpu->fpu_owner != NULL)
+    {
+        fpu_save(cpu->fpu_owner->fpu_state);
+        cpu->fpu_owner = NULL;
+    }
+    irq_restore(flags);
+    return true;
+}
+
+void kernel_fpu_end(void)
+{
+    uint32_t flags = irq_save();
+    stts();
+    this_cpu()->kernel_fpu_active = false;
+    irq_restore(flags);
+    // memcpy and memset land here from under spinlocks, switching away
+    // would leave the lock held
+    preempt_enable_no_resched();
+}
@@ -2,18 +2,7 @@
 #include <stdint.h>
 
 #include <cpu/gdt.h>
-
-#define GDT_ENTRIES 5
-
-typedef struct gdt_entry_t
-{
-    uint16_t limit;
-    uint16_t base_low;
-    uint8_t base_mid;
-    uint8_t access;
-    uint8_t flags;
-    uint8_t base_high;
-} gdt_entry_t;
+#include <cpu/percpu.h>
 
 typedef struct gdt_ptr_t
 {
@@ -21,41 +10,47 @@ typedef struct gdt_ptr_t
     gdt_entry_t* offset;
 } __attribute__((packed)) gdt_ptr_t;
 
+_Static_assert(sizeof(gdt_ptr_t) == 6, "gdt_ptr_t layout");
 
 // Defined in gdt-asm.asm
 extern void flush_gdt(gdt_ptr_t*);
 
-gdt_entry_t gdt_entries[5];
-gdt_ptr_t gdt_ptr;
-
-static void gdt_set_gate(size_t num, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags)
+// Entries shared by every CPU, indexed by selector
+static const gdt_entry_t gdt_flat[] = {
+    [0] = GDT_ENTRY(0, 0, 0, 0),
+    [KERNEL_CODE_SEL / 8] = GDT_ENTRY(0, GDT_LIMIT_FLAT, GDT_ACCESS_KERNEL_CODE, GDT_FLAGS_FLAT),
+    [KERNEL_DATA_SEL / 8] = GDT_ENTRY(0, GDT_LIMIT_FLAT, GDT_ACCESS_KERNEL_DATA, GDT_FLAGS_FLAT),
+    [USER_CODE_SEL / 8] = GDT_ENTRY(0, GDT_LIMIT_FLAT, GDT_ACCESS_USER_CODE, GDT_FLAGS_FLAT),
+    [USER_DATA_SEL / 8] = GDT_ENTRY(0, GDT_LIMIT_FLAT, GDT_ACCESS_USER_DATA, GDT_FLAGS_FLAT),
+};
+
+_Static_assert(sizeof(gdt_flat) / sizeof(gdt_entry_t) == TSS_SEL / 8, "per-CPU entries follow the flat ones");
+_Static_assert(PERCPU_SEL / 8 == GDT_ENTRIES - 1, "percpu entry ends the table");
+
+// Every CPU gets its own table, only the TSS and percpu entries differ.
+// Those hold the CPU's own addresses and are the only ones encoded here.
+void gdt_init(percpu_t *cpu)
 {
-    gdt_entries[num].limit = limit & 0xFFFF;
-    gdt_entries[num].base_low = (base & 0xFFFF);
-    gdt_entries[num].base_mid = (base >> 16) & 0xFF;
-    gdt_entries[num].access = access;
-    gdt_entries[num].flags = (flags & 0xF0) | ((limit >> 16) & 0xF);
-    gdt_entries[num].base_high = (base >> 24) & 0xFF;
-}
-
-void gdt_init(void)
-{
-    gdt_ptr.size = (sizeof(gdt_entry_t) * GDT_ENTRIES) - 1;
-    gdt_ptr.offset = gdt_entries;
-
-    gdt_set_gate(0, 0, 0, 0, 0); // Null segment
-    gdt_set_gate(1, 0, 0xFFFFFFFF, 
-        GDT_ACCESS_PRESENT | GDT_ACCESS_TYPE | GDT_ACCESS_EXECUTABLE | GDT_ACCESS_RW, 
-        GDT_FLAGS_GRANULARITY | GDT_FLAGS_SIZE); // Kernel code segment
-    gdt_set_gate(2, 0, 0xFFFFFFF, 
-        GDT_ACCESS_PRESENT | GDT_ACCESS_TYPE | GDT_ACCESS_RW,
-        GDT_FLAGS_GRANULARITY| GDT_FLAGS_SIZE); // Kernel data segment
-    gdt_set_gate(3, 0, 0xFFFFFFFF, 
-        GDT_ACCESS_PRESENT | GDT_ACCESS_DPL_USER | GDT_ACCESS_TYPE | GDT_ACCESS_EXECUTABLE | GDT_ACCESS_RW, 
-        GDT_FLAGS_GRANULARITY | GDT_FLAGS_SIZE); // User code segment
-    gdt_set_gate(4, 0, 0xFFFFFFF, 
-        GDT_ACCESS_PRESENT | GDT_ACCESS_DPL_USER | GDT_ACCESS_TYPE | GDT_ACCESS_RW,
-        GDT_FLAGS_GRANULARITY| GDT_FLAGS_SIZE); // Kernel data segment
+    gdt_ptr_t gdt_ptr = {
+        .size = sizeof(gdt_entry_t) * GDT_ENTRIES - 1,
+        .offset = cpu->gdt,
+    };
+
+    for (size_t i = 0; i < sizeof(gdt_flat) / sizeof(gdt_entry_t); ++i)
+    {
+        cpu->gdt[i] = gdt_flat[i];
+    }
+    uint32_t tss = (uint32_t) &cpu->tss;
+    uint32_t self = (uint32_t) cpu;
+    cpu->gdt[TSS_SEL / 8] = (gdt_entry_t) GDT_ENTRY(tss, sizeof(tss_t) - 1,
+        GDT_ACCESS_PRESENT | GDT_ACCESS_TSS, 0);
+    cpu->gdt[PERCPU_SEL / 8] = (gdt_entry_t) GDT_ENTRY(self, sizeof(percpu_t) - 1,
+        GDT_ACCESS_KERNEL_DATA, GDT_FLAGS_SIZE);
+
+    cpu->tss.ss0 = KERNEL_DATA_SEL;
+    cpu->tss.iomap_base = sizeof(tss_t);
 
     flush_gdt(&gdt_ptr);
-}
\ No newline at end of file
+    asm volatile("ltr %w0" : : "r"(TSS_SEL));
+    asm volatile("mov %w0, %%gs" : : "r"(PERCPU_SEL) : "memory");
+}
@@ -5,79 +5,112 @@ flush_idt:
 	ret
 	
 	
-	%macro ISR_NOERRCODE 1
-[global isr_%1:function]
-isr_%1:
-	push byte 0
-	push byte %1
-	jmp isr_common_stub
-	%endmacro
+	; Must match cpu/gdt.h, cpu/idt.h, cpu/irqflags.h, cpu/percpu.h and syscall/syscall.h
+	KERNEL_CODE_SEL equ 0x08
+	KERNEL_DATA_SEL equ 0x10
+	PERCPU_SEL equ 0x30
+	PERCPU_INTERRUPT_DEPTH equ 8
+	EFLAGS_IF equ 1 << 9
+	IDT_GATE equ 0x8E
+	IDT_USER_GATE equ 0xEE
+	ISR_STUB_SIZE equ 16
+	SYSCALL_VECTOR equ 0x80
 	
-	%macro ISR_ERRCODE 1
-[global isr_%1:function]
-isr_%1:
-	push byte %1
-	jmp isr_common_stub
-	%endmacro
+	; Defined in interrupts.c
+	extern interrupt_handlers
+	extern sched_interrupt_exit
 	
-	ISR_NOERRCODE 0
-	ISR_NOERRCODE 1
-	ISR_NOERRCODE 2
-	ISR_NOERRCODE 3
-	ISR_NOERRCODE 4
-	ISR_NOERRCODE 5
-	ISR_NOERRCODE 6
-	ISR_NOERRCODE 7
-	ISR_ERRCODE 8
-	ISR_NOERRCODE 9
-	ISR_ERRCODE 10
-	ISR_ERRCODE 11
-	ISR_ERRCODE 12
-	ISR_ERRCODE 13
-	ISR_ERRCODE 14
-	ISR_NOERRCODE 15
-	ISR_NOERRCODE 16
-	ISR_ERRCODE 17
-	ISR_NOERRCODE 18
-	ISR_NOERRCODE 19
-	ISR_NOERRCODE 20
-	ISR_ERRCODE 21
-	ISR_NOERRCODE 22
-	ISR_NOERRCODE 23
-	ISR_NOERRCODE 24
-	ISR_NOERRCODE 25
-	ISR_NOERRCODE 26
-	ISR_NOERRCODE 27
-	ISR_NOERRCODE 28
-	ISR_NOERRCODE 29
-	ISR_NOERRCODE 30
-	ISR_NOERRCODE 31
+	; Halves of the stub and int 0x80 entry addresses, computed by the
+	; linker script since neither C nor nasm can split a relocated address
+	extern isr_stubs_low
+	extern isr_stubs_high
+	extern syscall_int80_low
+	extern syscall_int80_high
 	
-	; Defined in interrupts.c
-	extern isr_handler
+	; One stub per vector, each padded to ISR_STUB_SIZE so a gate's offset
+	; is the base plus a multiple of it. The CPU pushes an error code for
+	; vectors 8, 10-14, 17, 21, 29 and 30, the rest push a dummy so every
+	; frame has the same layout.
+	section .isr_text progbits alloc exec nowrite align=4096
+global isr_stubs
+isr_stubs:
+	%assign i 0
+	%rep 256
+isr_%+i:
+	%if !(i == 8 || (i >= 10 && i <= 14) || i == 17 || i == 21 || i == 29 || i == 30)
+	push dword 0
+	%endif
+	push dword i
+	jmp isr_common_stub
+	times ISR_STUB_SIZE - ($ - isr_%+i) int3
+	%assign i i+1
+	%endrep
+	
+	; The IDT itself, ready to load. Every vector is an interrupt gate to
+	; its stub except int 0x80, which user mode may raise directly.
+	section .rodata
+	align 8
+global idt_table
+idt_table:
+	%assign i 0
+	%rep 256
+	%if i == SYSCALL_VECTOR
+	dw syscall_int80_low
+	dw KERNEL_CODE_SEL
+	db 0
+	db IDT_USER_GATE
+	dw syscall_int80_high
+	%else
+	dw isr_stubs_low + i * ISR_STUB_SIZE
+	dw KERNEL_CODE_SEL
+	db 0
+	db IDT_GATE
+	dw isr_stubs_high
+	%endif
+	%assign i i+1
+	%endrep
 	
+	section .text
 isr_common_stub:
 	pusha
 	
 	mov ax, ds
 	push eax
+	mov ax, gs
+	push eax
 	
-	mov ax, 0x10
+	mov ax, KERNEL_DATA_SEL
 	mov ds, ax
 	mov es, ax
+	mov fs, ax
+	mov ax, PERCPU_SEL
 	mov gs, ax
 	
-	push esp
+	inc dword [gs:PERCPU_INTERRUPT_DEPTH]
 	
-	call isr_handler
+	; Call interrupt_handlers[int_no].handler(regs, interrupt_handlers[int_no].ctx)
+	mov ebx, esp
+	mov eax, [ebx + 40]
+	push dword [interrupt_handlers + eax * 8 + 4]
+	push ebx
+	call [interrupt_handlers + eax * 8]
+	add esp, 8
 	
-	add esp, 4
+	; Leaving the outermost interrupt is where softirqs and preemption
+	; happen, unless it was an exception taken with interrupts off
+	dec dword [gs:PERCPU_INTERRUPT_DEPTH]
+	jnz .restore
+	test dword [ebx + 56], EFLAGS_IF
+	jz .restore
+	call sched_interrupt_exit
 	
+.restore:
+	pop eax
+	mov gs, ax
 	pop eax
 	mov ds, ax
 	mov es, ax
 	mov fs, ax
-	mov gs, ax
 	
 	popa
 	add esp, 8
@@ -1,16 +1,56 @@
+#include <stdbool.h>
 #include <stdint.h>
 
+#include <cpu.h>
+#include <cpu/fault.h>
+#include <cpu/idt.h>
+#include <cpu/interrupts.h>
+#include <cpu/irqflags.h>
+#include <cpu/percpu.h>
 #include <libk/io.h>
 
-typedef struct interrupt_registers_t
+void isr_handler(interrupt_registers_t *regs, void *ctx);
+
+// Used directly by isr_common_stub
+interrupt_entry_t interrupt_handlers[IDT_ENTRIES] =
+{
+    [0 ... IDT_ENTRIES - 1] = { isr_handler, NULL },
+};
+
+bool in_interrupt(void)
+{
+    return percpu_read32(interrupt_depth) != 0;
+}
+
+void register_interrupt_handler(uint8_t vector, interrupt_handler_t handler, void *ctx)
+{
+    // Never let an interrupt see the handler of one owner with the context
+    // of another
+    uint32_t flags = irq_save();
+    interrupt_handlers[vector].handler = handler;
+    interrupt_handlers[vector].ctx = ctx;
+    irq_restore(flags);
+}
+
+void unregister_interrupt_handler(uint8_t vector)
 {
-    uint32_t ds;
-    uint32_t edi, esi, ebp, useless, ebx, edx, ecs, eax;
-    uint32_t int_no, err_code;
-    uint32_t eip, cs, eflags, esp, ss;
-} interrupt_registers_t;
+    register_interrupt_handler(vector, isr_handler, NULL);
+}
 
-void isr_handler(interrupt_registers_t *regs)
+void isr_handler(interrupt_registers_t *regs, void *ctx)
 {
-    kprintf("Recieved interrupt %x\n", regs->int_no);
-}
\ No newline at end of file
+    (void) ctx;
+    if (regs->int_no == FAULT_BREAKPOINT_VECTOR)
+    {
+        // int3 is a trap, returning carries on after it
+        fault_dump(regs);
+    }
+    else if (regs->int_no < FAULT_VECTORS)
+    {
+        fault_report(regs);
+    }
+    else
+    {
+        kprintf("Unhandled interrupt %x\n", regs->int_no);
+    }
+}
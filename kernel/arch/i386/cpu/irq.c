@@ -0,0 +1,297 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu/acpi.h>
+#include <cpu/apic.h>
+#include <cpu/interrupts.h>
+#include <cpu/irq.h>
+#include <cpu/irqflags.h>
+#include <cpu/pic.h>
+#include <libk/io.h>
+
+typedef struct irq_desc_t
+{
+    interrupt_handler_t handler;
+    void *ctx;
+    uint32_t count;
+} irq_desc_t;
+
+static irq_desc_t irq_descs[IRQ_LINES];
+static irq_desc_t msi_descs[IRQ_MSI_VECTORS];
+
+const irq_chip_t *irq_chip;
+
+static void pic_chip_eoi(unsigned irq)
+{
+    pic_eoi(irq);
+}
+
+static const irq_chip_t pic_chip =
+{
+    .name = "8259",
+    .mask = pic_mask,
+    .unmask = pic_unmask,
+    .eoi = pic_chip_eoi,
+};
+
+// ISA IRQs may be wired to a different GSI, everything else is identity
+static uint32_t irq_to_gsi(unsigned irq, uint16_t *flags)
+{
+    *flags = 0;
+    for (uint32_t i = 0; i < acpi_madt.override_count; ++i)
+    {
+        if (acpi_madt.overrides[i].source == irq)
+        {
+            *flags = acpi_madt.overrides[i].flags;
+            return acpi_madt.overrides[i].gsi;
+        }
+    }
+    return irq;
+}
+
+// An override can move an ISA IRQ onto the GSI another ISA IRQ would
+// have had, the line left behind has no pin of its own
+static bool irq_shadowed(unsigned irq)
+{
+    for (uint32_t i = 0; i < acpi_madt.override_count; ++i)
+    {
+        if (acpi_madt.overrides[i].gsi == irq && acpi_madt.overrides[i].source != irq)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void ioapic_chip_mask(unsigned irq)
+{
+    uint16_t flags;
+    ioapic_mask(irq_to_gsi(irq, &flags));
+}
+
+static void ioapic_chip_unmask(unsigned irq)
+{
+    uint16_t flags;
+    ioapic_unmask(irq_to_gsi(irq, &flags));
+}
+
+static void ioapic_chip_eoi(unsigned irq)
+{
+    (void) irq;
+    lapic_eoi();
+}
+
+static const irq_chip_t ioapic_chip =
+{
+    .name = "IOAPIC",
+    .mask = ioapic_chip_mask,
+    .unmask = ioapic_chip_unmask,
+    .eoi = ioapic_chip_eoi,
+};
+
+static void irq_dispatch(interrupt_registers_t *regs, void *ctx)
+{
+    unsigned irq = (uintptr_t) ctx;
+    if (irq_chip == &pic_chip && pic_spurious(irq))
+    {
+        return;
+    }
+
+    irq_desc_t *desc = &irq_descs[irq];
+    ++desc->count;
+    if (desc->handler != NULL)
+    {
+        desc->handler(regs, desc->ctx);
+    }
+    irq_chip->eoi(irq);
+}
+
+static void irq_msi_dispatch(interrupt_registers_t *regs, void *ctx)
+{
+    irq_desc_t *desc = ctx;
+    ++desc->count;
+    desc->handler(regs, desc->ctx);
+    lapic_eoi();
+}
+
+// Spurious LAPIC interrupts and the parked 8259 must not be acknowledged
+static void irq_ignore(interrupt_registers_t *regs, void *ctx)
+{
+    (void) regs;
+    (void) ctx;
+}
+
+static void lapic_error(interrupt_registers_t *regs, void *ctx)
+{
+    (void) regs;
+    (void) ctx;
+    lapic_write(LAPIC_ESR, 0);
+    kprintf("lapic: error %x\n", lapic_read(LAPIC_ESR));
+    lapic_eoi();
+}
+
+static bool irq_init_apic(void)
+{
+    if (!apic_supported() || !acpi_init() || acpi_madt.ioapic_count == 0)
+    {
+        return false;
+    }
+    if (!lapic_init(acpi_madt.lapic_addr) || !ioapic_init())
+    {
+        return false;
+    }
+
+    for (unsigned irq = 0; irq < IRQ_LINES; ++irq)
+    {
+        if (irq_shadowed(irq))
+        {
+            continue;
+        }
+        uint16_t flags = 0;
+        ioapic_route(irq_to_gsi(irq, &flags), IRQ_BASE + irq, flags);
+    }
+
+    // The 8259 can still raise spurious interrupts while fully masked
+    pic_remap(IRQ_PIC_PARKED_BASE, IRQ_PIC_PARKED_BASE + 8);
+    pic_disable();
+    for (unsigned i = 0; i < PIC_IRQS; ++i)
+    {
+        register_interrupt_handler(IRQ_PIC_PARKED_BASE + i, irq_ignore, NULL);
+    }
+
+    register_interrupt_handler(LAPIC_SPURIOUS_VECTOR, irq_ignore, NULL);
+    register_interrupt_handler(LAPIC_ERROR_VECTOR, lapic_error, NULL);
+    return true;
+}
+
+void irq_init(void)
+{
+    unsigned lines = IRQ_LINES;
+    if (irq_init_apic())
+    {
+        irq_chip = &ioapic_chip;
+    }
+    else
+    {
+        pic_remap(IRQ_BASE, IRQ_BASE + 8);
+        irq_chip = &pic_chip;
+        lines = PIC_IRQS;
+    }
+
+    for (unsigned irq = 0; irq < lines; ++irq)
+    {
+        register_interrupt_handler(IRQ_BASE + irq, irq_dispatch, (void*) (uintptr_t) irq);
+    }
+
+    kprintf("irq: using %s, %d cpus\n", irq_chip->name, acpi_madt.cpu_count ? acpi_madt.cpu_count : 1);
+}
+
+bool irq_register(unsigned irq, interrupt_handler_t handler, void *ctx)
+{
+    if (irq >= IRQ_LINES || (irq_chip == &pic_chip && irq >= PIC_IRQS))
+    {
+        return false;
+    }
+    if (irq_chip == &ioapic_chip && irq_shadowed(irq))
+    {
+        return false;
+    }
+
+    uint32_t flags = irq_save();
+    irq_descs[irq].handler = handler;
+    irq_descs[irq].ctx = ctx;
+    irq_chip->unmask(irq);
+    irq_restore(flags);
+    return true;
+}
+
+bool irq_set_trigger(unsigned irq, bool level, bool active_low)
+{
+    if (irq >= IRQ_LINES)
+    {
+        return false;
+    }
+    // The 8259 follows the ELCR the firmware set up
+    if (irq_chip != &ioapic_chip)
+    {
+        return true;
+    }
+
+    uint16_t flags;
+    uint32_t gsi = irq_to_gsi(irq, &flags);
+    // An override describes the actual wiring, it wins over the caller
+    if (flags & (ACPI_MADT_POLARITY_MASK | ACPI_MADT_TRIGGER_MASK))
+    {
+        return true;
+    }
+
+    uint32_t saved = irq_save();
+    bool ok = ioapic_set_trigger(gsi, level, active_low);
+    irq_restore(saved);
+    return ok;
+}
+
+void irq_unregister(unsigned irq)
+{
+    if (irq >= IRQ_LINES)
+    {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    irq_chip->mask(irq);
+    irq_descs[irq].handler = NULL;
+    irq_descs[irq].ctx = NULL;
+    irq_restore(flags);
+}
+
+void irq_mask(unsigned irq)
+{
+    if (irq < IRQ_LINES)
+    {
+        irq_chip->mask(irq);
+    }
+}
+
+void irq_unmask(unsigned irq)
+{
+    if (irq < IRQ_LINES)
+    {
+        irq_chip->unmask(irq);
+    }
+}
+
+uint32_t irq_count(unsigned irq)
+{
+    return irq < IRQ_LINES ? irq_descs[irq].count : 0;
+}
+
+bool irq_msi_alloc(interrupt_handler_t handler, void *ctx, uint32_t *address, uint16_t *data)
+{
+    if (irq_chip != &ioapic_chip)
+    {
+        return false;
+    }
+
+    uint32_t flags = irq_save();
+    for (unsigned i = 0; i < IRQ_MSI_VECTORS; ++i)
+    {
+        irq_desc_t *desc = &msi_descs[i];
+        if (desc->handler != NULL)
+        {
+            continue;
+        }
+        desc->handler = handler;
+        desc->ctx = ctx;
+        register_interrupt_handler(IRQ_MSI_BASE + i, irq_msi_dispatch, desc);
+        irq_restore(flags);
+
+        // Fixed delivery, edge triggered, physical destination
+        *address = MSI_ADDRESS_BASE | ((uint32_t) lapic_id() << 12);
+        *data = IRQ_MSI_BASE + i;
+        return true;
+    }
+    irq_restore(flags);
+    return false;
+}
@@ -0,0 +1,161 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/features.h>
+#include <cpu/paging.h>
+#include <cpu/regs.h>
+#include <libk/io.h>
+#include <libk/string.h>
+#include <mm/pmm.h>
+
+static pde_t kernel_pd[PAGE_TABLE_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+pde_t *kernel_page_directory = kernel_pd;
+
+static uint32_t global_flag;
+static uintptr_t mmio_next = KERNEL_MAP_START;
+
+void paging_init(void)
+{
+    if (!cpu_has(CPU_FEATURE_PSE))
+    {
+        kprintf("paging: CPU has no PSE, cannot map the kernel\n");
+        return;
+    }
+    // Global pages keep the kernel's TLB entries alive across CR3 reloads
+    if (cpu_has(CPU_FEATURE_PGE))
+    {
+        global_flag = PAGE_GLOBAL;
+    }
+
+    // The image and all of low physical memory sit in 4 MiB pages, so the
+    // whole kernel costs a handful of TLB entries
+    for (uintptr_t phys = 0; phys < DIRECT_MAP_SIZE; phys += LARGE_PAGE_SIZE)
+    {
+        kernel_pd[PDE_INDEX(phys + KERNEL_VMA)] = phys | PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE | global_flag;
+    }
+
+    // Page tables for the rest of kernel space are created now, so every
+    // address space copying the kernel half sees later mappings there
+    for (uintptr_t virt = KERNEL_MAP_START; virt != 0; virt += LARGE_PAGE_SIZE)
+    {
+        uintptr_t table = pmm_alloc_frame();
+        if (table == 0)
+        {
+            kprintf("paging: out of memory for kernel page tables\n");
+            return;
+        }
+        memset(phys_to_virt(table), 0, PAGE_SIZE);
+        kernel_pd[PDE_INDEX(virt)] = table | PAGE_PRESENT | PAGE_WRITE;
+    }
+
+    // This also drops the boot identity map of the first 4 MiB
+    write_cr3(virt_to_phys(kernel_pd));
+    write_cr0(read_cr0() | CR0_WP);
+    if (global_flag)
+    {
+        write_cr4(read_cr4() | CR4_PGE);
+    }
+}
+
+// APs arrive on the boot page directory with only PSE enabled
+void paging_init_ap(void)
+{
+    write_cr3(virt_to_phys(kernel_pd));
+    write_cr0(read_cr0() | CR0_WP);
+    if (global_flag)
+    {
+        write_cr4(read_cr4() | CR4_PGE);
+    }
+}
+
+pte_t *paging_get_pte(pde_t *pd, uintptr_t virt)
+{
+    pde_t pde = pd[PDE_INDEX(virt)];
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE))
+    {
+        return NULL;
+    }
+    pte_t *table = phys_to_virt(pde & ~PAGE_FLAGS_MASK);
+    return &table[PTE_INDEX(virt)];
+}
+
+bool paging_map(pde_t *pd, uintptr_t virt, uintptr_t phys, uint32_t flags)
+{
+    pde_t *pde = &pd[PDE_INDEX(virt)];
+    if (*pde & PAGE_LARGE)
+    {
+        return false;
+    }
+    if (!(*pde & PAGE_PRESENT))
+    {
+        uintptr_t table = pmm_alloc_zeroed_frame();
+        if (table == 0)
+        {
+            return false;
+        }
+        *pde = table | PAGE_PRESENT | PAGE_WRITE;
+    }
+    // Leaf entries decide the real protection
+    *pde |= flags & PAGE_USER;
+
+    if (virt >= KERNEL_VMA)
+    {
+        flags |= global_flag;
+    }
+    pte_t *table = phys_to_virt(*pde & ~PAGE_FLAGS_MASK);
+    table[PTE_INDEX(virt)] = (phys & ~PAGE_FLAGS_MASK) | (flags & PAGE_FLAGS_MASK) | PAGE_PRESENT;
+    invlpg(virt);
+    return true;
+}
+
+void paging_unmap(pde_t *pd, uintptr_t virt)
+{
+    pte_t *pte = paging_get_pte(pd, virt);
+    if (pte != NULL)
+    {
+        *pte = 0;
+        invlpg(virt);
+    }
+}
+
+uintptr_t paging_translate(pde_t *pd, uintptr_t virt)
+{
+    pde_t pde = pd[PDE_INDEX(virt)];
+    if (!(pde & PAGE_PRESENT))
+    {
+        return 0;
+    }
+    if (pde & PAGE_LARGE)
+    {
+        return (pde & ~(LARGE_PAGE_SIZE - 1)) | (virt & (LARGE_PAGE_SIZE - 1));
+    }
+
+    pte_t pte = *paging_get_pte(pd, virt);
+    if (!(pte & PAGE_PRESENT))
+    {
+        return 0;
+    }
+    return (pte & ~PAGE_FLAGS_MASK) | (virt & PAGE_FLAGS_MASK);
+}
+
+void *paging_map_mmio(uintptr_t phys, size_t size)
+{
+    uintptr_t offset = phys & PAGE_FLAGS_MASK;
+    size_t len = PAGE_ALIGN_UP(size + offset);
+    if (len > 0 - mmio_next)
+    {
+        return NULL;
+    }
+
+    uintptr_t virt = mmio_next;
+    for (size_t i = 0; i < len; i += PAGE_SIZE)
+    {
+        if (!paging_map(kernel_page_directory, virt + i, phys - offset + i,
+            PAGE_WRITE | PAGE_CACHE_DISABLE | PAGE_WRITE_THROUGH))
+        {
+            return NULL;
+        }
+    }
+    mmio_next += len;
+    return (void*) (virt + offset);
+}
@@ -0,0 +1,39 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu/cpuid.h>
+#include <cpu/features.h>
+#include <cpu/patch.h>
+
+#define PATCH_JMP_OPCODE 0xE9
+
+typedef int32_t __attribute__((may_alias, aligned(1))) unaligned_i32_t;
+
+void *patch_select(void *site, const patch_choice_t *choices, size_t count)
+{
+    unsigned char *code = (unsigned char*) site;
+    if (code[0] != PATCH_JMP_OPCODE)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!cpu_has_all(choices[i].requires))
+        {
+            continue;
+        }
+
+        // Kernel text is mapped writable, the displacement is relative to
+        // the end of the jump
+        int32_t rel = (int32_t) ((uintptr_t) choices[i].target - ((uintptr_t) code + PATCH_JUMP_SIZE));
+        *(volatile unaligned_i32_t*) (code + 1) = rel;
+
+        // A serializing instruction makes sure the old jump is not executed
+        // from the prefetch queue
+        uint32_t eax, ebx, ecx, edx;
+        cpuid(CPUID_LEAF_VENDOR, 0, &eax, &ebx, &ecx, &edx);
+        return choices[i].target;
+    }
+    return NULL;
+}
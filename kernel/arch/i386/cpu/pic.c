@@ -0,0 +1,117 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/pic.h>
+#include <cpu/ports.h>
+
+#define PIC_MASTER_CMD 0x20
+#define PIC_MASTER_DATA 0x21
+#define PIC_SLAVE_CMD 0xA0
+#define PIC_SLAVE_DATA 0xA1
+
+#define PIC_ICW1_ICW4 0x01
+#define PIC_ICW1_INIT 0x10
+#define PIC_ICW4_8086 0x01
+#define PIC_OCW3_READ_ISR 0x0B
+#define PIC_EOI 0x20
+
+#define PIC_CASCADE_IRQ 2
+
+// Cached so masking a line is a single port write
+static uint16_t pic_masks = 0xFFFF;
+
+static void pic_write_masks(void)
+{
+    outb(PIC_MASTER_DATA, pic_masks & 0xFF);
+    outb(PIC_SLAVE_DATA, pic_masks >> 8);
+}
+
+void pic_remap(uint8_t master_base, uint8_t slave_base)
+{
+    outb(PIC_MASTER_CMD, PIC_ICW1_INIT | PIC_ICW1_ICW4);
+    io_wait();
+    outb(PIC_SLAVE_CMD, PIC_ICW1_INIT | PIC_ICW1_ICW4);
+    io_wait();
+    outb(PIC_MASTER_DATA, master_base);
+    io_wait();
+    outb(PIC_SLAVE_DATA, slave_base);
+    io_wait();
+    // The slave hangs off the master's IRQ 2
+    outb(PIC_MASTER_DATA, 1 << PIC_CASCADE_IRQ);
+    io_wait();
+    outb(PIC_SLAVE_DATA, PIC_CASCADE_IRQ);
+    io_wait();
+    outb(PIC_MASTER_DATA, PIC_ICW4_8086);
+    io_wait();
+    outb(PIC_SLAVE_DATA, PIC_ICW4_8086);
+    io_wait();
+
+    // Everything starts masked except the cascade
+    pic_masks = 0xFFFF & ~(1 << PIC_CASCADE_IRQ);
+    pic_write_masks();
+}
+
+void pic_disable(void)
+{
+    pic_masks = 0xFFFF;
+    pic_write_masks();
+}
+
+void pic_mask(unsigned irq)
+{
+    pic_masks |= 1 << irq;
+    if (irq < 8)
+    {
+        outb(PIC_MASTER_DATA, pic_masks & 0xFF);
+    }
+    else
+    {
+        outb(PIC_SLAVE_DATA, pic_masks >> 8);
+    }
+}
+
+void pic_unmask(unsigned irq)
+{
+    pic_masks &= ~(1 << irq);
+    if (irq < 8)
+    {
+        outb(PIC_MASTER_DATA, pic_masks & 0xFF);
+    }
+    else
+    {
+        outb(PIC_SLAVE_DATA, pic_masks >> 8);
+    }
+}
+
+void pic_eoi(unsigned irq)
+{
+    if (irq >= 8)
+    {
+        outb(PIC_SLAVE_CMD, PIC_EOI);
+    }
+    outb(PIC_MASTER_CMD, PIC_EOI);
+}
+
+// IRQ 7 and 15 fire spuriously when a line drops before it is serviced,
+// those must not be acknowledged as if they were real
+bool pic_spurious(unsigned irq)
+{
+    if (irq != 7 && irq != 15)
+    {
+        return false;
+    }
+
+    uint16_t port = irq == 7 ? PIC_MASTER_CMD : PIC_SLAVE_CMD;
+    outb(port, PIC_OCW3_READ_ISR);
+    if (inb(port) & 0x80)
+    {
+        return false;
+    }
+
+    // The master did see the cascade line and still wants its EOI
+    if (irq == 15)
+    {
+        outb(PIC_MASTER_CMD, PIC_EOI);
+    }
+    return true;
+}
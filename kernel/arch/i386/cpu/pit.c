@@ -0,0 +1,61 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/pit.h>
+#include <cpu/ports.h>
+
+#define PIT_CHANNEL0 0x40
+#define PIT_CHANNEL2 0x42
+#define PIT_COMMAND 0x43
+#define PIT_GATE_PORT 0x61
+
+#define PIT_SELECT_CHANNEL0 (0 << 6)
+#define PIT_SELECT_CHANNEL2 (2 << 6)
+#define PIT_ACCESS_LOHI (3 << 4)
+#define PIT_MODE_TERMINAL (0 << 1)
+#define PIT_MODE_RATE (2 << 1)
+
+#define PIT_GATE_ENABLE (1 << 0)
+#define PIT_GATE_SPEAKER (1 << 1)
+#define PIT_GATE_OUT (1 << 5)
+
+static void pit_load(uint16_t port, uint16_t count)
+{
+    outb(port, count & 0xFF);
+    outb(port, count >> 8);
+}
+
+void pit_set_periodic(uint32_t hz)
+{
+    uint32_t count = PIT_FREQUENCY / hz;
+    if (count > 0xFFFF)
+    {
+        count = 0xFFFF;
+    }
+    outb(PIT_COMMAND, PIT_SELECT_CHANNEL0 | PIT_ACCESS_LOHI | PIT_MODE_RATE);
+    pit_load(PIT_CHANNEL0, count);
+}
+
+void pit_set_oneshot(uint16_t count)
+{
+    outb(PIT_COMMAND, PIT_SELECT_CHANNEL0 | PIT_ACCESS_LOHI | PIT_MODE_TERMINAL);
+    pit_load(PIT_CHANNEL0, count ? count : 1);
+}
+
+void pit_stop(void)
+{
+    // Terminal count mode without a count loaded never fires
+    outb(PIT_COMMAND, PIT_SELECT_CHANNEL0 | PIT_ACCESS_LOHI | PIT_MODE_TERMINAL);
+}
+
+void pit_gate_start(uint16_t count)
+{
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~PIT_GATE_SPEAKER) | PIT_GATE_ENABLE);
+    outb(PIT_COMMAND, PIT_SELECT_CHANNEL2 | PIT_ACCESS_LOHI | PIT_MODE_TERMINAL);
+    pit_load(PIT_CHANNEL2, count);
+}
+
+bool pit_gate_expired(void)
+{
+    return inb(PIT_GATE_PORT) & PIT_GATE_OUT;
+}
@@ -0,0 +1,216 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu.h>
+#include <cpu/features.h>
+#include <cpu/msr.h>
+#include <cpu/percpu.h>
+#include <cpu/pmu.h>
+#include <libk/io.h>
+#include <libk/string.h>
+
+#define PMU_MAX_COUNTERS PERF_MAX_EVENTS
+#define PMU_NOT_ARCH -1
+
+typedef struct pmu_event_desc_t
+{
+    uint8_t event;
+    uint8_t umask;
+    // Bit in CPUID leaf 0xA EBX, or PMU_NOT_ARCH for model specific events
+    int8_t arch_bit;
+} pmu_event_desc_t;
+
+static const pmu_event_desc_t pmu_events[PERF_EVENT_COUNT] =
+{
+    [PERF_CYCLES] = { 0x3C, 0x00, 0 },
+    [PERF_INSTRUCTIONS] = { 0xC0, 0x00, 1 },
+    [PERF_REF_CYCLES] = { 0x3C, 0x01, 2 },
+    [PERF_LLC_REFERENCES] = { 0x2E, 0x4F, 3 },
+    [PERF_LLC_MISSES] = { 0x2E, 0x41, 4 },
+    [PERF_BRANCHES] = { 0xC4, 0x00, 5 },
+    [PERF_BRANCH_MISSES] = { 0xC5, 0x00, 6 },
+    // DTLB_LOAD_MISSES.MISS_CAUSES_A_WALK and ITLB_MISSES.MISS_CAUSES_A_WALK
+    [PERF_DTLB_MISSES] = { 0x08, 0x01, PMU_NOT_ARCH },
+    [PERF_ITLB_MISSES] = { 0x85, 0x01, PMU_NOT_ARCH },
+};
+
+// Picked in order until the counters run out
+static const perf_event_t pmu_default_events[] =
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_LLC_REFERENCES,
+    PERF_BRANCH_MISSES,
+    PERF_ITLB_MISSES,
+    PERF_BRANCHES,
+};
+
+// Sandy Bridge through Coffee Lake share the TLB walk encodings above
+static const uint8_t pmu_tlb_models[] =
+{
+    0x2A, 0x2D, 0x3A, 0x3E, 0x3C, 0x3F, 0x45, 0x46, 0x3D, 0x47, 0x4F, 0x56,
+    0x4E, 0x5E, 0x55, 0x8E, 0x9E,
+};
+
+// Each CPU counts its own selection, so perf on one CPU never labels its
+// counters with events another CPU picked
+typedef struct pmu_cpu_t
+{
+    perf_event_t selected[PMU_MAX_COUNTERS];
+    unsigned count;
+} __attribute__((aligned(64))) pmu_cpu_t;
+
+static pmu_cpu_t pmu_cpus[MAX_CPUS];
+
+static inline pmu_cpu_t *this_pmu(void)
+{
+    return &pmu_cpus[cpu_id()];
+}
+
+bool pmu_event_supported(perf_event_t event)
+{
+    if (!cpu_has(CPU_FEATURE_ARCH_PERFMON) || event >= PERF_EVENT_COUNT)
+    {
+        return false;
+    }
+
+    const pmu_event_desc_t *desc = &pmu_events[event];
+    if (desc->arch_bit != PMU_NOT_ARCH)
+    {
+        return cpu_info.pmu_events & (1u << desc->arch_bit);
+    }
+
+    if (memcmp(cpu_info.vendor, "GenuineIntel", 12) != 0 || cpu_info.family != 6)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(pmu_tlb_models); ++i)
+    {
+        if (cpu_info.model == pmu_tlb_models[i])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static unsigned pmu_hw_counters(void)
+{
+    unsigned counters = cpu_info.pmu_counters;
+    return counters < PMU_MAX_COUNTERS ? counters : PMU_MAX_COUNTERS;
+}
+
+static void pmu_program(const pmu_cpu_t *pmu)
+{
+    unsigned counters = pmu_hw_counters();
+    if (cpu_info.pmu_version >= 2)
+    {
+        wrmsr(MSR_IA32_PERF_GLOBAL_CTRL, 0);
+    }
+    for (unsigned i = 0; i < counters; ++i)
+    {
+        wrmsr(MSR_IA32_PERFEVTSEL0 + i, 0);
+        wrmsr(MSR_IA32_PMC0 + i, 0);
+        if (i < pmu->count)
+        {
+            const pmu_event_desc_t *desc = &pmu_events[pmu->selected[i]];
+            wrmsr(MSR_IA32_PERFEVTSEL0 + i, desc->event | (desc->umask << 8)
+                | PERFEVTSEL_USR | PERFEVTSEL_OS | PERFEVTSEL_EN);
+        }
+    }
+    // Version 2 adds a global enable on top of each counter's own
+    if (cpu_info.pmu_version >= 2)
+    {
+        wrmsr(MSR_IA32_PERF_GLOBAL_CTRL, (1ull << pmu->count) - 1);
+    }
+}
+
+bool pmu_select(const perf_event_t *events, unsigned count)
+{
+    if (count > pmu_hw_counters())
+    {
+        return false;
+    }
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if (!pmu_event_supported(events[i]))
+        {
+            return false;
+        }
+    }
+
+    pmu_cpu_t *pmu = this_pmu();
+    memcpy(pmu->selected, events, count * sizeof(perf_event_t));
+    pmu->count = count;
+    pmu_program(pmu);
+    return true;
+}
+
+void pmu_init(void)
+{
+    if (!cpu_has(CPU_FEATURE_ARCH_PERFMON))
+    {
+        kprintf("pmu: no architectural performance counters\n");
+        return;
+    }
+
+    unsigned counters = pmu_hw_counters();
+    pmu_cpu_t *pmu = this_pmu();
+    pmu->count = 0;
+    for (size_t i = 0; i < sizeof(pmu_default_events) / sizeof(pmu_default_events[0]) && pmu->count < counters; ++i)
+    {
+        if (pmu_event_supported(pmu_default_events[i]))
+        {
+            pmu->selected[pmu->count++] = pmu_default_events[i];
+        }
+    }
+    // APs start from the boot CPU's choice
+    for (unsigned cpu = 0; cpu < MAX_CPUS; ++cpu)
+    {
+        pmu_cpus[cpu] = *pmu;
+    }
+    pmu_program(pmu);
+
+    kprintf("pmu: version %u, %u counters of %u bits, counting", cpu_info.pmu_version,
+        cpu_info.pmu_counters, cpu_info.pmu_counter_width);
+    for (unsigned i = 0; i < pmu->count; ++i)
+    {
+        kprintf(" %s", perf_event_name(pmu->selected[i]));
+    }
+    kprintf("\n");
+}
+
+void pmu_init_ap(void)
+{
+    if (cpu_has(CPU_FEATURE_ARCH_PERFMON))
+    {
+        pmu_program(this_pmu());
+    }
+}
+
+unsigned pmu_active(void)
+{
+    return this_pmu()->count;
+}
+
+perf_event_t pmu_active_event(unsigned index)
+{
+    return this_pmu()->selected[index];
+}
+
+uint64_t pmu_counter_mask(void)
+{
+    unsigned width = cpu_info.pmu_counter_width;
+    return width >= 64 ? UINT64_MAX : (1ull << width) - 1;
+}
+
+void pmu_read(uint64_t *values)
+{
+    unsigned count = this_pmu()->count;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        values[i] = rdpmc(i);
+    }
+}
@@ -0,0 +1,77 @@
+	; Must match cpu/regs.h and cpu/smp.h
+	CR0_PE equ 1 << 0
+	CR0_PG equ 1 << 31
+	CR4_PSE equ 1 << 4
+	AP_TRAMPOLINE_ADDR equ 0x8000
+	
+	; Addresses inside the copy of the trampoline at AP_TRAMPOLINE_ADDR
+	%define TRAMPOLINE(x) ((x) - ap_trampoline_start + AP_TRAMPOLINE_ADDR)
+	
+	; Copied below 1 MiB by smp_init. An AP starts here in real mode after
+	; the startup IPI, goes straight to protected mode and turns on paging
+	; with the boot page directory, which still maps both the trampoline
+	; and the higher half.
+	section .rodata
+	bits 16
+global ap_trampoline_start
+ap_trampoline_start:
+	cli
+	cld
+	xor ax, ax
+	mov ds, ax
+	lgdt [TRAMPOLINE(ap_trampoline_gdt_ptr)]
+	mov eax, cr0
+	or eax, CR0_PE
+	mov cr0, eax
+	jmp dword 0x08:TRAMPOLINE(ap_trampoline_32)
+	
+	bits 32
+ap_trampoline_32:
+	mov ax, 0x10
+	mov ds, ax
+	mov es, ax
+	mov fs, ax
+	mov gs, ax
+	mov ss, ax
+	
+	mov eax, cr4
+	or eax, CR4_PSE
+	mov cr4, eax
+	mov eax, [TRAMPOLINE(ap_trampoline_cr3)]
+	mov cr3, eax
+	mov eax, cr0
+	or eax, CR0_PG
+	mov cr0, eax
+	
+	mov esp, [TRAMPOLINE(ap_trampoline_stack)]
+	mov eax, ap_entry
+	jmp eax
+	
+	align 8
+ap_trampoline_gdt:
+	dq 0
+	dq 0x00CF9A000000FFFF
+	dq 0x00CF92000000FFFF
+ap_trampoline_gdt_ptr:
+	dw ap_trampoline_gdt_ptr - ap_trampoline_gdt - 1
+	dd TRAMPOLINE(ap_trampoline_gdt)
+	
+	align 4
+global ap_trampoline_cr3
+ap_trampoline_cr3:
+	dd 0
+global ap_trampoline_stack
+ap_trampoline_stack:
+	dd 0
+global ap_trampoline_end
+ap_trampoline_end:
+	
+	section .text
+ap_entry:
+	xor ebp, ebp
+	extern ap_main
+	call ap_main
+	
+	cli
+	hlt
+	jmp $
@@ -0,0 +1,167 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu.h>
+#include <cpu/acpi.h>
+#include <cpu/apic.h>
+#include <cpu/fpu.h>
+#include <cpu/gdt.h>
+#include <cpu/idt.h>
+#include <cpu/interrupts.h>
+#include <cpu/irqflags.h>
+#include <cpu/paging.h>
+#include <cpu/percpu.h>
+#include <cpu/pmu.h>
+#include <cpu/smp.h>
+#include <cpu/syscall.h>
+#include <libk/io.h>
+#include <libk/string.h>
+#include <mm/kmalloc.h>
+#include <mm/pmm.h>
+#include <sched/sched.h>
+#include <sched/work.h>
+#include <time/clock.h>
+
+#define AP_STARTUP_TIMEOUT_NS (100 * NSEC_PER_MSEC)
+
+// Defined in boot.asm
+extern uint32_t boot_page_directory[];
+extern uint8_t stack_top[];
+
+percpu_t percpu[MAX_CPUS];
+
+static unsigned cpus_online = 1;
+// The AP currently being started, they come up one at a time
+static percpu_t *volatile ap_booting;
+
+// The boot CPU needs %gs before anything may call cpu_id()
+void smp_init_boot_cpu(void)
+{
+    percpu_t *cpu = &percpu[0];
+    cpu->self = cpu;
+    cpu->id = 0;
+    cpu->online = true;
+    cpu->tss.esp0 = (uint32_t) stack_top;
+    gdt_init(cpu);
+}
+
+unsigned cpu_count(void)
+{
+    return cpus_online;
+}
+
+static void smp_reschedule_ipi(interrupt_registers_t *regs, void *ctx)
+{
+    (void) regs;
+    (void) ctx;
+    // The interrupt exit path does the actual rescheduling
+    this_runqueue()->need_resched = true;
+    lapic_eoi();
+}
+
+void smp_send_reschedule(unsigned cpu)
+{
+    if (cpu != cpu_id() && cpu < MAX_CPUS && percpu[cpu].online)
+    {
+        lapic_send_ipi(percpu[cpu].apic_id, LAPIC_IPI_VECTOR);
+    }
+}
+
+void ap_main(void)
+{
+    percpu_t *cpu = ap_booting;
+
+    paging_init_ap();
+    gdt_init(cpu);
+    idt_load();
+    fpu_init();
+    lapic_init(0);
+    syscall_arch_init_ap();
+    pmu_init_ap();
+    sched_init_ap();
+    work_init_cpu();
+    clock_init_ap();
+
+    __atomic_store_n(&cpu->online, true, __ATOMIC_RELEASE);
+    sched_idle();
+}
+
+static bool smp_start_ap(percpu_t *cpu)
+{
+    cpu->stack = kmalloc(AP_STACK_SIZE, 0);
+    if (cpu->stack == NULL)
+    {
+        return false;
+    }
+    cpu->tss.esp0 = (uint32_t) cpu->stack + AP_STACK_SIZE;
+
+    uint8_t *trampoline = phys_to_virt(AP_TRAMPOLINE_ADDR);
+    *(uint32_t*) (trampoline + ((uint8_t*) &ap_trampoline_stack - ap_trampoline_start)) =
+        (uint32_t) cpu->stack + AP_STACK_SIZE;
+    ap_booting = cpu;
+
+    // INIT, then the startup IPI twice as the MP spec asks, the second one
+    // is ignored by a CPU that already started
+    lapic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT | LAPIC_ICR_LEVEL);
+    lapic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL);
+    clock_delay_ns(10 * NSEC_PER_MSEC);
+    for (int i = 0; i < 2 && !cpu->online; ++i)
+    {
+        lapic_send_ipi(cpu->apic_id, LAPIC_ICR_STARTUP | (AP_TRAMPOLINE_ADDR >> PAGE_SHIFT));
+        clock_delay_ns(200 * NSEC_PER_USEC);
+    }
+
+    uint64_t deadline = ktime_ns() + AP_STARTUP_TIMEOUT_NS;
+    while (!__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE))
+    {
+        // The stack stays allocated, a late AP may still be running on it
+        if (ktime_ns() > deadline)
+        {
+            return false;
+        }
+        asm volatile("pause");
+    }
+    return true;
+}
+
+void smp_init(void)
+{
+    if (lapic_base == NULL || acpi_madt.cpu_count <= 1)
+    {
+        return;
+    }
+
+    size_t size = ap_trampoline_end - ap_trampoline_start;
+    uint8_t *trampoline = phys_to_virt(AP_TRAMPOLINE_ADDR);
+    memcpy(trampoline, ap_trampoline_start, size);
+    *(uint32_t*) (trampoline + ((uint8_t*) &ap_trampoline_cr3 - ap_trampoline_start)) =
+        virt_to_phys(boot_page_directory);
+
+    register_interrupt_handler(LAPIC_IPI_VECTOR, smp_reschedule_ipi, NULL);
+
+    uint8_t boot_apic_id = lapic_id();
+    percpu[0].apic_id = boot_apic_id;
+    for (uint32_t i = 0; i < acpi_madt.cpu_count && cpus_online < MAX_CPUS; ++i)
+    {
+        uint8_t apic_id = acpi_madt.cpu_apic_ids[i];
+        if (apic_id == boot_apic_id)
+        {
+            continue;
+        }
+
+        percpu_t *cpu = &percpu[cpus_online];
+        cpu->self = cpu;
+        cpu->id = cpus_online;
+        cpu->apic_id = apic_id;
+        if (smp_start_ap(cpu))
+        {
+            ++cpus_online;
+        }
+        else
+        {
+            kprintf("smp: cpu with apic id %d did not start\n", apic_id);
+        }
+    }
+    kprintf("smp: %d cpus online\n", cpus_online);
+}
@@ -0,0 +1,21 @@
+	; void switch_context(uint32_t *prev_esp, uint32_t next_esp)
+	; Only the callee-saved registers need saving, the C caller takes care
+	; of the rest. Keep the push order in sync with context_frame_t.
+global switch_context:function
+switch_context:
+	mov eax, [esp + 4]
+	mov edx, [esp + 8]
+	
+	push ebp
+	push ebx
+	push esi
+	push edi
+	
+	mov [eax], esp
+	mov esp, edx
+	
+	pop edi
+	pop esi
+	pop ebx
+	pop ebp
+	ret
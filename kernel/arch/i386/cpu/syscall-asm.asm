@@ -0,0 +1,108 @@
+	; Must match cpu/gdt.h, cpu/irqflags.h and syscall/syscall.h
+	KERNEL_DATA_SEL equ 0x10
+	USER_CODE_SEL equ 0x18
+	USER_DATA_SEL equ 0x20
+	PERCPU_SEL equ 0x30
+	EFLAGS_IF equ 1 << 9
+	SYSCALL_VECTOR equ 0x80
+	
+	extern syscall_dispatch
+	extern sched_interrupt_exit
+	
+	; Both entry paths finish building an interrupt_registers_t on top of
+	; an iret style frame, so syscall_dispatch sees the same layout as an
+	; interrupt handler. Syscalls are not interrupts, interrupt_depth is
+	; left alone so they may block.
+	%macro SYSCALL_SAVE 0
+	push dword 0
+	push dword SYSCALL_VECTOR
+	pusha
+	
+	mov ax, ds
+	push eax
+	mov ax, gs
+	push eax
+	
+	mov ax, KERNEL_DATA_SEL
+	mov ds, ax
+	mov es, ax
+	mov fs, ax
+	mov ax, PERCPU_SEL
+	mov gs, ax
+	%endmacro
+	
+	%macro SYSCALL_CALL 0
+	sti
+	push esp
+	call syscall_dispatch
+	add esp, 4
+	cli
+	call sched_interrupt_exit
+	%endmacro
+	
+	%macro SYSCALL_RESTORE 0
+	pop eax
+	mov gs, ax
+	pop eax
+	mov ds, ax
+	mov es, ax
+	mov fs, ax
+	
+	popa
+	add esp, 8
+	%endmacro
+	
+	section .text
+	; User code passes its return address in edx and its stack in ecx
+global sysenter_entry:function
+sysenter_entry:
+	; IA32_SYSENTER_ESP points at this CPU's tss.esp0
+	mov esp, [esp]
+	
+	push dword USER_DATA_SEL | 3
+	push ecx
+	pushfd
+	or dword [esp], EFLAGS_IF
+	push dword USER_CODE_SEL | 3
+	push edx
+	
+	SYSCALL_SAVE
+	SYSCALL_CALL
+	SYSCALL_RESTORE
+	
+	; Left with eip, cs, eflags, esp and ss. The sti shadow covers the
+	; sysexit so no interrupt can arrive between the two.
+	mov edx, [esp]
+	mov ecx, [esp + 12]
+	and dword [esp + 8], ~EFLAGS_IF
+	add esp, 8
+	popfd
+	sti
+	sysexit
+	
+global syscall_int80_entry:function
+syscall_int80_entry:
+	SYSCALL_SAVE
+	SYSCALL_CALL
+	SYSCALL_RESTORE
+	iret
+	
+	; void enter_user(uint32_t eip, uint32_t esp)
+global enter_user:function
+enter_user:
+	mov ecx, [esp + 4]
+	mov edx, [esp + 8]
+	
+	mov ax, USER_DATA_SEL | 3
+	mov ds, ax
+	mov es, ax
+	mov fs, ax
+	mov gs, ax
+	
+	push dword USER_DATA_SEL | 3
+	push edx
+	pushfd
+	or dword [esp], EFLAGS_IF
+	push dword USER_CODE_SEL | 3
+	push ecx
+	iret
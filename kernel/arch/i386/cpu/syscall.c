@@ -0,0 +1,36 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/features.h>
+#include <cpu/gdt.h>
+#include <cpu/msr.h>
+#include <cpu/percpu.h>
+#include <cpu/syscall.h>
+#include <syscall/syscall.h>
+
+bool sysenter_supported;
+
+static bool sysenter_detect(void)
+{
+    return cpu_has(CPU_FEATURE_SEP);
+}
+
+// SYSENTER loads esp from the MSR, pointing it at tss.esp0 lets the entry
+// code pick up the current task's kernel stack with one load instead of a
+// wrmsr on every context switch
+void syscall_arch_init_ap(void)
+{
+    if (sysenter_supported)
+    {
+        wrmsr(MSR_IA32_SYSENTER_CS, KERNEL_CODE_SEL);
+        wrmsr(MSR_IA32_SYSENTER_ESP, (uint32_t) &this_cpu()->tss.esp0);
+        wrmsr(MSR_IA32_SYSENTER_EIP, (uint32_t) sysenter_entry);
+    }
+}
+
+// The int 0x80 gate is part of the static IDT
+void syscall_arch_init(void)
+{
+    sysenter_supported = sysenter_detect();
+    syscall_arch_init_ap();
+}
@@ -0,0 +1,61 @@
+#ifndef ARCH_I386_ACPI_H
+#define ARCH_I386_ACPI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu.h>
+
+#define ACPI_MAX_IOAPICS 8
+#define ACPI_MAX_OVERRIDES 16
+
+#define ACPI_MADT_POLARITY_MASK 0x3
+#define ACPI_MADT_POLARITY_LOW 0x3
+#define ACPI_MADT_TRIGGER_MASK 0xC
+#define ACPI_MADT_TRIGGER_LEVEL 0xC
+
+typedef struct acpi_sdt_header_t
+{
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+typedef struct acpi_ioapic_t
+{
+    uint8_t id;
+    uint32_t addr;
+    uint32_t gsi_base;
+} acpi_ioapic_t;
+
+typedef struct acpi_override_t
+{
+    uint8_t source;
+    uint32_t gsi;
+    uint16_t flags;
+} acpi_override_t;
+
+// What the MADT told us about the interrupt hardware
+typedef struct acpi_madt_info_t
+{
+    uint32_t lapic_addr;
+    uint32_t cpu_count;
+    uint8_t cpu_apic_ids[MAX_CPUS];
+    uint32_t ioapic_count;
+    acpi_ioapic_t ioapics[ACPI_MAX_IOAPICS];
+    uint32_t override_count;
+    acpi_override_t overrides[ACPI_MAX_OVERRIDES];
+} acpi_madt_info_t;
+
+extern acpi_madt_info_t acpi_madt;
+
+bool acpi_init(void);
+acpi_sdt_header_t *acpi_find_table(const char *signature);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef ARCH_I386_APIC_H
+#define ARCH_I386_APIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LAPIC_ID 0x020
+#define LAPIC_VERSION 0x030
+#define LAPIC_TPR 0x080
+#define LAPIC_EOI 0x0B0
+#define LAPIC_SVR 0x0F0
+#define LAPIC_ESR 0x280
+#define LAPIC_ICR_LOW 0x300
+#define LAPIC_ICR_HIGH 0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_LVT_ERROR 0x370
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE 0x3E0
+
+#define LAPIC_SVR_ENABLE (1 << 8)
+#define LAPIC_LVT_MASKED (1 << 16)
+#define LAPIC_ICR_INIT (5 << 8)
+#define LAPIC_ICR_STARTUP (6 << 8)
+#define LAPIC_ICR_PENDING (1 << 12)
+#define LAPIC_ICR_ASSERT (1 << 14)
+#define LAPIC_ICR_LEVEL (1 << 15)
+
+#define LAPIC_TIMER_VECTOR 0xF0
+#define LAPIC_IPI_VECTOR 0xF1
+#define LAPIC_ERROR_VECTOR 0xFE
+#define LAPIC_SPURIOUS_VECTOR 0xFF
+
+#define IOAPIC_REDIR_MASKED (1 << 16)
+#define IOAPIC_REDIR_LEVEL (1 << 15)
+#define IOAPIC_REDIR_ACTIVE_LOW (1 << 13)
+
+extern volatile uint32_t *lapic_base;
+
+static inline uint32_t lapic_read(uint32_t reg)
+{
+    return lapic_base[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t val)
+{
+    lapic_base[reg / 4] = val;
+}
+
+// A single MMIO store, any value acknowledges the in-service interrupt
+static inline void lapic_eoi(void)
+{
+    lapic_write(LAPIC_EOI, 0);
+}
+
+bool apic_supported(void);
+bool lapic_init(uint32_t phys);
+uint8_t lapic_id(void);
+void lapic_send_ipi(uint8_t apic_id, uint32_t icr);
+
+bool ioapic_init(void);
+bool ioapic_route(uint32_t gsi, uint8_t vector, uint16_t flags);
+bool ioapic_set_trigger(uint32_t gsi, bool level, bool active_low);
+void ioapic_mask(uint32_t gsi);
+void ioapic_unmask(uint32_t gsi);
+
+#endif
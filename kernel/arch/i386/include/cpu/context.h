@@ -0,0 +1,40 @@
+#ifndef ARCH_I386_CONTEXT_H
+#define ARCH_I386_CONTEXT_H
+
+#include <stdint.h>
+
+#include <cpu/percpu.h>
+
+// Callee-saved registers pushed by switch_context, in stack order
+typedef struct context_frame_t
+{
+    uint32_t edi, esi, ebx, ebp;
+    uint32_t eip;
+} context_frame_t;
+
+void switch_context(uint32_t *prev_esp, uint32_t next_esp);
+
+// Where the CPU switches to on an interrupt or SYSENTER from user mode
+static inline void context_set_kernel_stack(uint32_t top)
+{
+    this_cpu()->tss.esp0 = top;
+}
+
+// Lays out a frame that switch_context will "return" into entry from
+static inline uint32_t context_init(void *stack_top, void (*entry)(void))
+{
+    uint32_t *sp = (uint32_t*) ((uintptr_t) stack_top & ~0xF);
+    // A null return address, which also leaves entry with the stack
+    // alignment it would have after a normal call
+    *--sp = 0;
+
+    context_frame_t *frame = (context_frame_t*) sp - 1;
+    frame->edi = 0;
+    frame->esi = 0;
+    frame->ebx = 0;
+    frame->ebp = 0;
+    frame->eip = (uint32_t) entry;
+    return (uint32_t) frame;
+}
+
+#endif
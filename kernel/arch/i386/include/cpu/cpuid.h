@@ -0,0 +1,44 @@
+#ifndef ARCH_I386_CPUID_H
+#define ARCH_I386_CPUID_H
+
+#include <stdint.h>
+
+#define CPUID_LEAF_VENDOR 0x00
+#define CPUID_LEAF_FEATURES 0x01
+#define CPUID_LEAF_MWAIT 0x05
+#define CPUID_LEAF_EXT_FEATURES 0x07
+#define CPUID_LEAF_PERFMON 0x0A
+#define CPUID_LEAF_EXT_MAX 0x80000000
+#define CPUID_LEAF_POWER 0x80000007
+
+#define CPUID_EDX_FPU (1 << 0)
+#define CPUID_EDX_PSE (1 << 3)
+#define CPUID_EDX_TSC (1 << 4)
+#define CPUID_EDX_MSR (1 << 5)
+#define CPUID_EDX_APIC (1 << 9)
+#define CPUID_EDX_SEP (1 << 11)
+#define CPUID_EDX_PGE (1 << 13)
+#define CPUID_EDX_FXSR (1 << 24)
+#define CPUID_EDX_SSE (1 << 25)
+#define CPUID_EDX_SSE2 (1 << 26)
+
+#define CPUID_ECX_SSE3 (1 << 0)
+#define CPUID_ECX_MONITOR (1 << 3)
+#define CPUID_ECX_SSSE3 (1 << 9)
+#define CPUID_ECX_SSE4_1 (1 << 19)
+#define CPUID_ECX_SSE4_2 (1 << 20)
+#define CPUID_ECX_POPCNT (1 << 23)
+#define CPUID_ECX_AVX (1 << 28)
+
+#define CPUID_MWAIT_EBX_LINE_MASK 0xFFFF
+#define CPUID_EXT_EBX_ERMS (1 << 9)
+#define CPUID_POWER_EDX_INVARIANT_TSC (1 << 8)
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+    asm volatile("cpuid"
+        : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+        : "a"(leaf), "c"(subleaf));
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef ARCH_I386_FAULT_H
+#define ARCH_I386_FAULT_H
+
+#include <stdint.h>
+
+#include <cpu/interrupts.h>
+
+#define FAULT_VECTORS 32
+#define FAULT_BREAKPOINT_VECTOR 3
+#define FAULT_BACKTRACE_DEPTH 16
+
+// Prints the exception, the saved registers and a backtrace of the
+// interrupted kernel code
+void fault_dump(interrupt_registers_t *regs);
+// The same, then stops this CPU for good. Exceptions nobody handled land
+// here instead of returning into the faulting instruction again.
+__attribute__((noreturn)) void fault_report(interrupt_registers_t *regs);
+
+// Walks the saved ebp chain from ebp, printing each return address with
+// the function it falls in. Needs -fno-omit-frame-pointer.
+void backtrace_print(uintptr_t ebp);
+
+#endif
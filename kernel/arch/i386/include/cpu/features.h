@@ -0,0 +1,70 @@
+#ifndef ARCH_I386_FEATURES_H
+#define ARCH_I386_FEATURES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum cpu_feature_t
+{
+    CPU_FEATURE_FPU,
+    CPU_FEATURE_PSE,
+    CPU_FEATURE_TSC,
+    CPU_FEATURE_MSR,
+    CPU_FEATURE_APIC,
+    CPU_FEATURE_SEP,
+    CPU_FEATURE_PGE,
+    CPU_FEATURE_FXSR,
+    CPU_FEATURE_SSE,
+    CPU_FEATURE_SSE2,
+    CPU_FEATURE_SSE3,
+    CPU_FEATURE_SSSE3,
+    CPU_FEATURE_SSE4_1,
+    CPU_FEATURE_SSE4_2,
+    CPU_FEATURE_POPCNT,
+    // Reported by the hardware only, nothing enables XSAVE so no kernel
+    // code may use AVX registers
+    CPU_FEATURE_AVX,
+    CPU_FEATURE_ERMS,
+    CPU_FEATURE_TSC_INVARIANT,
+    // Intel architectural performance monitoring, see cpu_info.pmu_*
+    CPU_FEATURE_ARCH_PERFMON,
+    // MONITOR/MWAIT with leaf 5 present, see cpu_info.monitor_line
+    CPU_FEATURE_MWAIT,
+    CPU_FEATURE_COUNT,
+} cpu_feature_t;
+
+#define CPU_FEATURE_BIT(feature) (1u << (feature))
+
+typedef struct cpu_info_t
+{
+    char vendor[13];
+    uint32_t family;
+    uint32_t model;
+    uint32_t stepping;
+    uint32_t features;
+    uint8_t pmu_version;
+    uint8_t pmu_counters;
+    uint8_t pmu_counter_width;
+    // Bit n set when architectural event n of CPUID leaf 0xA can be counted
+    uint8_t pmu_events;
+    // Largest monitored range of MONITOR, in bytes
+    uint16_t monitor_line;
+} cpu_info_t;
+
+extern cpu_info_t cpu_info;
+
+static inline bool cpu_has(cpu_feature_t feature)
+{
+    return cpu_info.features & CPU_FEATURE_BIT(feature);
+}
+
+// All set bits in mask must be present
+static inline bool cpu_has_all(uint32_t mask)
+{
+    return (cpu_info.features & mask) == mask;
+}
+
+void cpu_features_init(void);
+void cpu_features_print(void);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef ARCH_I386_FPU_H
+#define ARCH_I386_FPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/regs.h>
+
+#define FPU_STATE_SIZE 512
+#define FPU_STATE_ALIGN 16
+#define FPU_NM_VECTOR 7
+
+struct task_t;
+
+static inline void clts(void)
+{
+    asm volatile("clts" : : : "memory");
+}
+
+static inline void stts(void)
+{
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+void fpu_init(void);
+void fpu_late_init(void);
+void fpu_switch(struct task_t *next);
+void fpu_task_exit(struct task_t *task);
+
+// Brackets kernel code that touches FPU/SSE registers. Fails when the
+// FPU is already claimed on this CPU, e.g. from an interrupt landing in
+// another kernel_fpu section, callers must have a fallback.
+bool kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+#endif
@@ -3,20 +3,79 @@
 
 #include <stdint.h>
 
-#define GDT_ACCESS_PRESENT 1 << 7
-#define GDT_ACCESS_DPL_USER 3 << 5
-#define GDT_ACCESS_TYPE 1 << 4
-#define GDT_ACCESS_EXECUTABLE 1 << 3
-#define GDT_ACCESS_DIRECTION 1 << 2;
-#define GDT_ACCESS_RW 1 << 1
-#define GDT_ACCESS_A 1
+#define GDT_ACCESS_PRESENT (1 << 7)
+#define GDT_ACCESS_DPL_USER (3 << 5)
+#define GDT_ACCESS_TYPE (1 << 4)
+#define GDT_ACCESS_EXECUTABLE (1 << 3)
+#define GDT_ACCESS_DIRECTION (1 << 2)
+#define GDT_ACCESS_RW (1 << 1)
+#define GDT_ACCESS_A (1 << 0)
 
-#define GDT_FLAGS_GRANULARITY 1 << 7
-#define GDT_FLAGS_SIZE 1 << 6
-#define GDT_FLAGS_LONG 1 << 5
+#define GDT_FLAGS_GRANULARITY (1 << 7)
+#define GDT_FLAGS_SIZE (1 << 6)
+#define GDT_FLAGS_LONG (1 << 5)
 
-#define KERNEL_DATA_SEL 0x08
+#define GDT_ACCESS_TSS 0x9
 
-void gdt_init(void);
+// Flat 4 GiB segments in pages, and the access byte of the four kinds
+#define GDT_LIMIT_FLAT 0xFFFFF
+#define GDT_FLAGS_FLAT (GDT_FLAGS_GRANULARITY | GDT_FLAGS_SIZE)
+#define GDT_ACCESS_KERNEL_CODE (GDT_ACCESS_PRESENT | GDT_ACCESS_TYPE | GDT_ACCESS_EXECUTABLE | GDT_ACCESS_RW)
+#define GDT_ACCESS_KERNEL_DATA (GDT_ACCESS_PRESENT | GDT_ACCESS_TYPE | GDT_ACCESS_RW)
+#define GDT_ACCESS_USER_CODE (GDT_ACCESS_KERNEL_CODE | GDT_ACCESS_DPL_USER)
+#define GDT_ACCESS_USER_DATA (GDT_ACCESS_KERNEL_DATA | GDT_ACCESS_DPL_USER)
+
+// Initialiser for a gdt_entry_t, a constant expression when its arguments
+// are. limit is in bytes, or in pages with GDT_FLAGS_GRANULARITY.
+#define GDT_ENTRY(base_, limit_, access_, flags_) { \
+    .limit = (limit_) & 0xFFFF, \
+    .base_low = (base_) & 0xFFFF, \
+    .base_mid = ((base_) >> 16) & 0xFF, \
+    .access = (access_), \
+    .flags = ((flags_) & 0xF0) | (((limit_) >> 16) & 0x0F), \
+    .base_high = ((base_) >> 24) & 0xFF, \
+}
+
+#define GDT_ENTRIES 7
+
+#define KERNEL_CODE_SEL 0x08
+#define KERNEL_DATA_SEL 0x10
+#define USER_CODE_SEL 0x18
+#define USER_DATA_SEL 0x20
+#define TSS_SEL 0x28
+// Segment based at the CPU's percpu_t, loaded into %gs
+#define PERCPU_SEL 0x30
+
+typedef struct gdt_entry_t
+{
+    uint16_t limit;
+    uint16_t base_low;
+    uint8_t base_mid;
+    uint8_t access;
+    uint8_t flags;
+    uint8_t base_high;
+} gdt_entry_t;
+
+_Static_assert(sizeof(gdt_entry_t) == 8, "gdt_entry_t layout");
+
+typedef struct tss_t
+{
+    uint32_t prev_tss;
+    uint32_t esp0, ss0;
+    uint32_t esp1, ss1;
+    uint32_t esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap;
+    uint16_t iomap_base;
+} __attribute__((packed)) tss_t;
+
+_Static_assert(sizeof(tss_t) == 104, "tss_t layout");
+
+struct percpu_t;
+
+void gdt_init(struct percpu_t *cpu);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,40 @@
+#ifndef ARCH_I386_IDLE_H
+#define ARCH_I386_IDLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/features.h>
+#include <cpu/irqflags.h>
+
+// Sleeps while *wake stays zero, until an interrupt arrives or, with
+// MWAIT, until another CPU writes the cache line holding it. Called with
+// interrupts disabled and returns with them enabled; sti only takes effect
+// after the next instruction so no interrupt slips in before the sleep.
+static inline void cpu_idle(const volatile uint32_t *wake)
+{
+    bool mwait = cpu_has(CPU_FEATURE_MWAIT);
+    if (mwait)
+    {
+        asm volatile("monitor" : : "a"(wake), "c"(0), "d"(0));
+    }
+    // A write that landed before the monitor was armed would not end the
+    // mwait, so look once more now that it is
+    if (*wake != 0)
+    {
+        irq_enable();
+        return;
+    }
+
+    if (mwait)
+    {
+        // C1 with no extensions, any interrupt ends it
+        asm volatile("sti; mwait" : : "a"(0), "c"(0) : "memory");
+    }
+    else
+    {
+        asm volatile("sti; hlt" : : : "memory");
+    }
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef ARCH_I386_INTERRUPTS_H
+#define ARCH_I386_INTERRUPTS_H
+
+#include <stdint.h>
+
+typedef struct interrupt_registers_t
+{
+    uint32_t gs, ds;
+    uint32_t edi, esi, ebp, useless, ebx, edx, ecx, eax;
+    uint32_t int_no, err_code;
+    uint32_t eip, cs, eflags, esp, ss;
+} interrupt_registers_t;
+
+typedef void (*interrupt_handler_t)(interrupt_registers_t *regs, void *ctx);
+
+// Indexed by isr_common_stub with the vector number, keep the layout in
+// sync with interrupts-asm.asm
+typedef struct interrupt_entry_t
+{
+    interrupt_handler_t handler;
+    void *ctx;
+} interrupt_entry_t;
+
+void register_interrupt_handler(uint8_t vector, interrupt_handler_t handler, void *ctx);
+void unregister_interrupt_handler(uint8_t vector);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef ARCH_I386_IRQ_H
+#define ARCH_I386_IRQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/interrupts.h>
+
+// IRQ n is delivered on vector IRQ_BASE + n, under the IOAPIC ISA IRQs are
+// translated to their GSI through the MADT overrides first
+#define IRQ_BASE 0x20
+#define IRQ_LINES 32
+
+// Where the 8259 is parked once the IOAPIC takes over
+#define IRQ_PIC_PARKED_BASE 0xE0
+
+// Message signalled interrupts bypass the IOAPIC and get vectors of their
+// own, only available when the LAPIC is in use
+#define IRQ_MSI_BASE 0x40
+#define IRQ_MSI_VECTORS 32
+#define MSI_ADDRESS_BASE 0xFEE00000
+
+typedef struct irq_chip_t
+{
+    const char *name;
+    void (*mask)(unsigned irq);
+    void (*unmask)(unsigned irq);
+    void (*eoi)(unsigned irq);
+} irq_chip_t;
+
+extern const irq_chip_t *irq_chip;
+
+void irq_init(void);
+bool irq_register(unsigned irq, interrupt_handler_t handler, void *ctx);
+void irq_unregister(unsigned irq);
+// Lines come up edge triggered and active high as ISA devices expect. PCI
+// INTx pins are level triggered and active low, their drivers say so here
+// before registering.
+bool irq_set_trigger(unsigned irq, bool level, bool active_low);
+void irq_mask(unsigned irq);
+void irq_unmask(unsigned irq);
+uint32_t irq_count(unsigned irq);
+
+// Allocates a vector for handler and returns the address/data pair the
+// device has to write to raise it on the calling CPU
+bool irq_msi_alloc(interrupt_handler_t handler, void *ctx, uint32_t *address, uint16_t *data);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef ARCH_I386_IRQFLAGS_H
+#define ARCH_I386_IRQFLAGS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define EFLAGS_IF (1 << 9)
+
+static inline void irq_enable(void)
+{
+    asm volatile("sti" : : : "memory");
+}
+
+static inline void irq_disable(void)
+{
+    asm volatile("cli" : : : "memory");
+}
+
+static inline uint32_t irq_save(void)
+{
+    uint32_t flags;
+    asm volatile("pushf\n\tpop %0\n\tcli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags)
+{
+    asm volatile("push %0\n\tpopf" : : "r"(flags) : "memory", "cc");
+}
+
+static inline bool irq_enabled(void)
+{
+    uint32_t flags;
+    asm volatile("pushf\n\tpop %0" : "=r"(flags));
+    return flags & EFLAGS_IF;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef ARCH_I386_PAGING_H
+#define ARCH_I386_PAGING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PAGE_PRESENT (1 << 0)
+#define PAGE_WRITE (1 << 1)
+#define PAGE_USER (1 << 2)
+#define PAGE_WRITE_THROUGH (1 << 3)
+#define PAGE_CACHE_DISABLE (1 << 4)
+#define PAGE_ACCESSED (1 << 5)
+#define PAGE_DIRTY (1 << 6)
+#define PAGE_LARGE (1 << 7)
+#define PAGE_GLOBAL (1 << 8)
+
+#define PAGE_FLAGS_MASK 0xFFF
+#define PAGE_TABLE_ENTRIES 1024
+#define LARGE_PAGE_SIZE 0x400000
+
+#define PDE_INDEX(virt) ((uintptr_t) (virt) >> 22)
+#define PTE_INDEX(virt) (((uintptr_t) (virt) >> 12) & 0x3FF)
+
+#define PAGE_FAULT_VECTOR 14
+
+// Error code pushed with a page fault
+#define PAGE_FAULT_PRESENT (1 << 0)
+#define PAGE_FAULT_WRITE (1 << 1)
+#define PAGE_FAULT_USER (1 << 2)
+#define PAGE_FAULT_RESERVED (1 << 3)
+#define PAGE_FAULT_FETCH (1 << 4)
+
+typedef uint32_t pde_t;
+typedef uint32_t pte_t;
+
+// Shared by every address space, only its kernel half is ever used
+extern pde_t *kernel_page_directory;
+
+void paging_init(void);
+void paging_init_ap(void);
+
+bool paging_map(pde_t *pd, uintptr_t virt, uintptr_t phys, uint32_t flags);
+void paging_unmap(pde_t *pd, uintptr_t virt);
+pte_t *paging_get_pte(pde_t *pd, uintptr_t virt);
+uintptr_t paging_translate(pde_t *pd, uintptr_t virt);
+
+// Maps device memory uncached into the kernel's 4 KiB page window
+void *paging_map_mmio(uintptr_t phys, size_t size);
+
+static inline void invlpg(uintptr_t virt)
+{
+    asm volatile("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+#endif
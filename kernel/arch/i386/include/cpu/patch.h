@@ -0,0 +1,36 @@
+#ifndef ARCH_I386_PATCH_H
+#define ARCH_I386_PATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PATCH_JUMP_SIZE 5
+
+// Defines a global function that is nothing but a 5 byte jmp rel32 to
+// initial. patch_select rewrites the displacement once at boot, so callers
+// pay one direct jump and never test a feature flag. The 16 byte alignment
+// keeps the instruction inside one cache line.
+#define PATCHABLE_JUMP(name, initial) \
+    asm(".pushsection .text\n\t" \
+        ".globl " #name "\n\t" \
+        ".type " #name ", @function\n\t" \
+        ".p2align 4\n" \
+        #name ":\n\t" \
+        ".byte 0xE9\n\t" \
+        ".long " #initial " - . - 4\n\t" \
+        ".size " #name ", . - " #name "\n\t" \
+        ".popsection")
+
+typedef struct patch_choice_t
+{
+    // CPU_FEATURE_BIT mask, all of which must be present
+    uint32_t requires;
+    void *target;
+} patch_choice_t;
+
+// Points site at the first choice the CPU supports and returns it. The
+// list should end with an unconditional choice. Only safe while a single
+// CPU runs and nothing can be executing the site.
+void *patch_select(void *site, const patch_choice_t *choices, size_t count);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef ARCH_I386_PERCPU_H
+#define ARCH_I386_PERCPU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu.h>
+#include <cpu/gdt.h>
+
+// Offsets used from assembly, checked against the struct below
+#define PERCPU_SELF 0
+#define PERCPU_ID 4
+#define PERCPU_INTERRUPT_DEPTH 8
+
+// Reached through %gs, so each CPU touches its own copy without locking.
+// Cache line aligned to keep CPUs from sharing lines.
+typedef struct percpu_t
+{
+    struct percpu_t *self;
+    uint32_t id;
+    uint32_t interrupt_depth;
+    uint8_t apic_id;
+    volatile bool online;
+    void *stack;
+    // Task whose FPU/SSE state is live in this CPU's registers
+    struct task_t *fpu_owner;
+    bool kernel_fpu_active;
+    gdt_entry_t gdt[GDT_ENTRIES];
+    tss_t tss;
+} __attribute__((aligned(64))) percpu_t;
+
+_Static_assert(offsetof(percpu_t, self) == PERCPU_SELF, "percpu_t layout");
+_Static_assert(offsetof(percpu_t, id) == PERCPU_ID, "percpu_t layout");
+_Static_assert(offsetof(percpu_t, interrupt_depth) == PERCPU_INTERRUPT_DEPTH, "percpu_t layout");
+
+extern percpu_t percpu[MAX_CPUS];
+
+#define percpu_read32(field) ({ \
+    uint32_t __val; \
+    asm volatile("movl %%gs:%c1, %0" : "=r"(__val) : "i"(offsetof(percpu_t, field))); \
+    __val; \
+})
+
+static inline percpu_t *this_cpu(void)
+{
+    return (percpu_t*) percpu_read32(self);
+}
+
+static inline unsigned cpu_id(void)
+{
+    return percpu_read32(id);
+}
+
+#endif
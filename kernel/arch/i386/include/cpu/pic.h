@@ -0,0 +1,16 @@
+#ifndef ARCH_I386_PIC_H
+#define ARCH_I386_PIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PIC_IRQS 16
+
+void pic_remap(uint8_t master_base, uint8_t slave_base);
+void pic_disable(void);
+void pic_mask(unsigned irq);
+void pic_unmask(unsigned irq);
+void pic_eoi(unsigned irq);
+bool pic_spurious(unsigned irq);
+
+#endif
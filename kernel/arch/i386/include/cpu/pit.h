@@ -0,0 +1,18 @@
+#ifndef ARCH_I386_PIT_H
+#define ARCH_I386_PIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PIT_FREQUENCY 1193182
+#define PIT_IRQ 0
+
+void pit_set_periodic(uint32_t hz);
+void pit_set_oneshot(uint16_t count);
+void pit_stop(void);
+
+// Channel 2 is run gated for calibration and busy waits, it raises no IRQ
+void pit_gate_start(uint16_t count);
+bool pit_gate_expired(void);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef ARCH_I386_PMU_H
+#define ARCH_I386_PMU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <debug/perf.h>
+
+#define PERFEVTSEL_USR (1 << 16)
+#define PERFEVTSEL_OS (1 << 17)
+#define PERFEVTSEL_EN (1 << 22)
+
+static inline uint64_t rdpmc(uint32_t counter)
+{
+    uint32_t lo, hi;
+    asm volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(counter));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+// The boot CPU picks the events, the APs program the same set
+void pmu_init(void);
+void pmu_init_ap(void);
+bool pmu_event_supported(perf_event_t event);
+// Changes the calling CPU's selection and counters only
+bool pmu_select(const perf_event_t *events, unsigned count);
+
+// All of these describe the calling CPU's selection
+unsigned pmu_active(void);
+perf_event_t pmu_active_event(unsigned index);
+uint64_t pmu_counter_mask(void);
+void pmu_read(uint64_t *values);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef ARCH_I386_REGS_H
+#define ARCH_I386_REGS_H
+
+#include <stdint.h>
+
+#define CR0_MP (1 << 1)
+#define CR0_EM (1 << 2)
+#define CR0_TS (1 << 3)
+#define CR0_NE (1 << 5)
+#define CR0_WP (1 << 16)
+#define CR0_PG (1 << 31)
+
+#define CR4_PSE (1 << 4)
+#define CR4_PGE (1 << 7)
+#define CR4_OSFXSR (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+
+static inline uint32_t read_cr0(void)
+{
+    uint32_t val;
+    asm volatile("mov %%cr0, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr0(uint32_t val)
+{
+    asm volatile("mov %0, %%cr0" : : "r"(val) : "memory");
+}
+
+static inline uint32_t read_cr2(void)
+{
+    uint32_t val;
+    asm volatile("mov %%cr2, %0" : "=r"(val));
+    return val;
+}
+
+static inline uint32_t read_cr3(void)
+{
+    uint32_t val;
+    asm volatile("mov %%cr3, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr3(uint32_t val)
+{
+    asm volatile("mov %0, %%cr3" : : "r"(val) : "memory");
+}
+
+static inline uint32_t read_cr4(void)
+{
+    uint32_t val;
+    asm volatile("mov %%cr4, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr4(uint32_t val)
+{
+    asm volatile("mov %0, %%cr4" : : "r"(val) : "memory");
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef ARCH_I386_SMP_H
+#define ARCH_I386_SMP_H
+
+#include <stdint.h>
+
+// Startup IPIs take the page number of the trampoline as their vector
+#define AP_TRAMPOLINE_ADDR 0x8000
+#define AP_STACK_SIZE 0x4000
+
+// Defined in smp-asm.asm, the two variables are patched in the copy
+extern const uint8_t ap_trampoline_start[];
+extern const uint8_t ap_trampoline_end[];
+extern const uint32_t ap_trampoline_cr3;
+extern const uint32_t ap_trampoline_stack;
+
+void smp_init_boot_cpu(void);
+void ap_main(void);
+
+#endif
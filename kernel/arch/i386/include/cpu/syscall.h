@@ -0,0 +1,17 @@
+#ifndef ARCH_I386_SYSCALL_H
+#define ARCH_I386_SYSCALL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Defined in syscall-asm.asm
+extern void sysenter_entry(void);
+extern void syscall_int80_entry(void);
+__attribute__((noreturn)) void enter_user(uint32_t eip, uint32_t esp);
+
+extern bool sysenter_supported;
+
+void syscall_arch_init(void);
+void syscall_arch_init_ap(void);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef ARCH_I386_TSC_H
+#define ARCH_I386_TSC_H
+
+#include <stdint.h>
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+// lfence keeps rdtsc from running ahead of earlier instructions, for
+// timing short code. Needs SSE2.
+static inline uint64_t rdtsc_ordered(void)
+{
+    asm volatile("lfence" : : : "memory");
+    return rdtsc();
+}
+
+// (val * mult) >> shift without a 64x64 multiply, shift must be 1..32
+static inline uint64_t mul_u64_u32_shr(uint64_t val, uint32_t mult, unsigned shift)
+{
+    uint32_t lo = val;
+    uint32_t hi = val >> 32;
+    uint64_t res = ((uint64_t) lo * mult) >> shift;
+    if (hi)
+    {
+        res += ((uint64_t) hi * mult) << (32 - shift);
+    }
+    return res;
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <bench/bench.h>
+#include <cpu/features.h>
+#include <cpu/irqflags.h>
+#include <cpu/ports.h>
+#include <cpu/tsc.h>
+#include <libk/console.h>
+#include <libk/io.h>
+#include <sync/lockstat.h>
+
+extern const bench_case_t bench_cases_start[];
+extern const bench_case_t bench_cases_end[];
+
+static uint32_t bench_samples[BENCH_SAMPLES];
+static uint64_t (*bench_clock)(void);
+
+static uint64_t bench_clock_plain(void)
+{
+    return rdtsc();
+}
+
+static uint64_t bench_clock_ordered(void)
+{
+    return rdtsc_ordered();
+}
+
+// Stands in for a case to measure what the timing itself costs
+__attribute__((noinline))
+static void bench_empty(uintptr_t arg)
+{
+    (void) arg;
+    asm volatile("" : : : "memory");
+}
+
+static void bench_sort(uint32_t *values, size_t count)
+{
+    // Shell sort, the gap sequence is Ciura's
+    static const size_t gaps[] = { 701, 301, 132, 57, 23, 10, 4, 1 };
+    for (size_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); ++g)
+    {
+        size_t gap = gaps[g];
+        for (size_t i = gap; i < count; ++i)
+        {
+            uint32_t value = values[i];
+            size_t j = i;
+            for (; j >= gap && values[j - gap] > value; j -= gap)
+            {
+                values[j] = values[j - gap];
+            }
+            values[j] = value;
+        }
+    }
+}
+
+typedef struct bench_result_t
+{
+    uint32_t min;
+    uint32_t median;
+    uint32_t p99;
+} bench_result_t;
+
+// Interrupts stay off while timing, so ticks do not land in the samples
+static bench_result_t bench_measure(void (*fn)(uintptr_t), uintptr_t arg)
+{
+    uint32_t flags = irq_save();
+    for (int i = 0; i < BENCH_WARMUP; ++i)
+    {
+        fn(arg);
+    }
+    for (int i = 0; i < BENCH_SAMPLES; ++i)
+    {
+        uint64_t start = bench_clock();
+        fn(arg);
+        uint64_t cycles = bench_clock() - start;
+        bench_samples[i] = cycles > UINT32_MAX ? UINT32_MAX : cycles;
+    }
+    irq_restore(flags);
+
+    bench_sort(bench_samples, BENCH_SAMPLES);
+    bench_result_t result =
+    {
+        bench_samples[0],
+        bench_samples[BENCH_SAMPLES / 2],
+        bench_samples[BENCH_SAMPLES * 99 / 100],
+    };
+    return result;
+}
+
+static uint32_t bench_sub(uint32_t value, uint32_t overhead)
+{
+    return value > overhead ? value - overhead : 0;
+}
+
+__attribute__((noreturn)) static void bench_exit(uint32_t code)
+{
+    console_flush();
+    outl(QEMU_DEBUG_EXIT_PORT, code);
+    // Not running under QEMU
+    for (;;)
+    {
+        asm volatile("cli; hlt");
+    }
+}
+
+void bench_run(void)
+{
+    bench_clock = cpu_has(CPU_FEATURE_SSE2) ? bench_clock_ordered : bench_clock_plain;
+
+    // The cheapest empty measurement is taken off every result
+    bench_result_t empty = bench_measure(bench_empty, 0);
+    uint32_t overhead = empty.min;
+    kprintf("bench: begin, %u samples per case, timing overhead %u cycles\n", BENCH_SAMPLES, overhead);
+
+    for (const bench_case_t *c = bench_cases_start; c < bench_cases_end; ++c)
+    {
+        if (!cpu_has_all(c->requires))
+        {
+            kprintf("bench: %-24s skipped\n", c->name);
+            continue;
+        }
+        if (c->setup != NULL)
+        {
+            c->setup(c->arg);
+        }
+        bench_result_t result = bench_measure(c->fn, c->arg);
+        kprintf("bench: %-24s min %u median %u p99 %u cycles\n", c->name, bench_sub(result.min, overhead),
+            bench_sub(result.median, overhead), bench_sub(result.p99, overhead));
+    }
+
+    // Built with DEBUG=1 the locks the benchmarks took report here too
+    lock_stats_dump();
+    kprintf("bench: end\n");
+    bench_exit(0);
+}
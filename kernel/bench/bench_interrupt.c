@@ -0,0 +1,29 @@
+#include <stdint.h>
+
+#include <bench/bench.h>
+#include <cpu/interrupts.h>
+
+// Nothing else uses it, between the syscall gate and the parked PIC
+#define BENCH_VECTOR 0x81
+
+static void bench_interrupt_handler(interrupt_registers_t *regs, void *ctx)
+{
+    (void) regs;
+    (void) ctx;
+}
+
+static void bench_interrupt_setup(uintptr_t arg)
+{
+    (void) arg;
+    register_interrupt_handler(BENCH_VECTOR, bench_interrupt_handler, NULL);
+}
+
+// Software interrupts ignore IF, so this covers the full stub and dispatch
+// path with the runner's interrupts disabled
+static void interrupt_round_trip(uintptr_t arg)
+{
+    (void) arg;
+    asm volatile("int %0" : : "i"(BENCH_VECTOR) : "memory");
+}
+
+BENCH_CASE(interrupt_round_trip, "interrupt_round_trip", bench_interrupt_setup, interrupt_round_trip, 0, 0);
@@ -0,0 +1,31 @@
+#include <stdint.h>
+
+#include <bench/bench.h>
+#include <libk/io.h>
+#include <libk/string.h>
+#include <tty/tty.h>
+
+static char bench_buf[128];
+
+// A typical driver log line, formatting only so nothing reaches a console
+static void ksnprintf_line(uintptr_t arg)
+{
+    (void) arg;
+    ksnprintf(bench_buf, sizeof(bench_buf), "irq %d: %s at %x took %llu ns\n", 14, "ata0", 0xC0101234, 123456ull);
+}
+
+static void ksnprintf_u32(uintptr_t arg)
+{
+    ksnprintf(bench_buf, sizeof(bench_buf), "%u", (uint32_t) arg);
+}
+
+static void tty_write_line(uintptr_t arg)
+{
+    (void) arg;
+    static const char line[] = "bench: tty_write scrolls the console one line per call\n";
+    tty_write(line, sizeof(line) - 1);
+}
+
+BENCH(ksnprintf_line);
+BENCH_CASE(ksnprintf_u32_max, "ksnprintf_u32/max", NULL, ksnprintf_u32, UINT32_MAX, 0);
+BENCH(tty_write_line);
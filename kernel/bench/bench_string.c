@@ -0,0 +1,131 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <bench/bench.h>
+#include <cpu/features.h>
+#include <libk/string.h>
+
+#define BENCH_MAX_SIZE 65536
+#define BENCH_SSE2 (CPU_FEATURE_BIT(CPU_FEATURE_FXSR) | CPU_FEATURE_BIT(CPU_FEATURE_SSE2))
+
+static uint8_t bench_src[BENCH_MAX_SIZE + 1] __attribute__((aligned(64)));
+static uint8_t bench_dst[BENCH_MAX_SIZE + 1] __attribute__((aligned(64)));
+
+#define BENCH_SIZES(id, label, setup, func, features) \
+    BENCH_CASE(id##_16, label "/16", setup, func, 16, features); \
+    BENCH_CASE(id##_64, label "/64", setup, func, 64, features); \
+    BENCH_CASE(id##_256, label "/256", setup, func, 256, features); \
+    BENCH_CASE(id##_1k, label "/1k", setup, func, 1024, features); \
+    BENCH_CASE(id##_4k, label "/4k", setup, func, 4096, features); \
+    BENCH_CASE(id##_64k, label "/64k", setup, func, 65536, features)
+
+static void bench_memcpy(uintptr_t size)
+{
+    memcpy(bench_dst, bench_src, size);
+}
+
+static void bench_memcpy_words(uintptr_t size)
+{
+    memcpy_words(bench_dst, bench_src, size);
+}
+
+static void bench_memcpy_rep(uintptr_t size)
+{
+    memcpy_rep(bench_dst, bench_src, size);
+}
+
+static void bench_memcpy_erms(uintptr_t size)
+{
+    memcpy_erms(bench_dst, bench_src, size);
+}
+
+static void bench_memcpy_sse2(uintptr_t size)
+{
+    memcpy_sse2(bench_dst, bench_src, size);
+}
+
+BENCH_SIZES(memcpy, "memcpy", NULL, bench_memcpy, 0);
+BENCH_SIZES(memcpy_words, "memcpy_words", NULL, bench_memcpy_words, 0);
+BENCH_SIZES(memcpy_rep, "memcpy_rep", NULL, bench_memcpy_rep, 0);
+BENCH_SIZES(memcpy_erms, "memcpy_erms", NULL, bench_memcpy_erms, 0);
+BENCH_SIZES(memcpy_sse2, "memcpy_sse2", NULL, bench_memcpy_sse2, BENCH_SSE2);
+
+static void bench_memset(uintptr_t size)
+{
+    memset(bench_dst, 0x5A, size);
+}
+
+static void bench_memset_rep(uintptr_t size)
+{
+    memset_rep(bench_dst, 0x5A, size);
+}
+
+static void bench_memset_sse2(uintptr_t size)
+{
+    memset_sse2(bench_dst, 0x5A, size);
+}
+
+BENCH_SIZES(memset, "memset", NULL, bench_memset, 0);
+BENCH_SIZES(memset_rep, "memset_rep", NULL, bench_memset_rep, 0);
+BENCH_SIZES(memset_sse2, "memset_sse2", NULL, bench_memset_sse2, BENCH_SSE2);
+
+// Equal buffers, so every variant has to compare all of them
+static void bench_memcmp_setup(uintptr_t size)
+{
+    memset(bench_src, 0x5A, size);
+    memset(bench_dst, 0x5A, size);
+}
+
+static void bench_memcmp(uintptr_t size)
+{
+    memcmp(bench_dst, bench_src, size);
+}
+
+static void bench_memcmp_words(uintptr_t size)
+{
+    memcmp_words(bench_dst, bench_src, size);
+}
+
+static void bench_memcmp_sse2(uintptr_t size)
+{
+    memcmp_sse2(bench_dst, bench_src, size);
+}
+
+BENCH_SIZES(memcmp, "memcmp", bench_memcmp_setup, bench_memcmp, 0);
+BENCH_SIZES(memcmp_words, "memcmp_words", bench_memcmp_setup, bench_memcmp_words, 0);
+BENCH_SIZES(memcmp_sse2, "memcmp_sse2", bench_memcmp_setup, bench_memcmp_sse2, BENCH_SSE2);
+
+static void bench_strlen_setup(uintptr_t len)
+{
+    memset(bench_src, 'a', len);
+    bench_src[len] = '\0';
+}
+
+static void bench_strlen(uintptr_t len)
+{
+    (void) len;
+    strlen((const char*) bench_src);
+}
+
+static void bench_strlen_bytes(uintptr_t len)
+{
+    (void) len;
+    strlen_bytes((const char*) bench_src);
+}
+
+static void bench_strlen_words(uintptr_t len)
+{
+    (void) len;
+    strlen_words((const char*) bench_src);
+}
+
+static void bench_strlen_sse2(uintptr_t len)
+{
+    (void) len;
+    strlen_sse2((const char*) bench_src);
+}
+
+BENCH_SIZES(strlen, "strlen", bench_strlen_setup, bench_strlen, 0);
+BENCH_SIZES(strlen_bytes, "strlen_bytes", bench_strlen_setup, bench_strlen_bytes, 0);
+BENCH_SIZES(strlen_words, "strlen_words", bench_strlen_setup, bench_strlen_words, 0);
+BENCH_SIZES(strlen_sse2, "strlen_sse2", bench_strlen_setup, bench_strlen_sse2, BENCH_SSE2);
@@ -0,0 +1,30 @@
+#include <stdint.h>
+
+#include <debug/boottime.h>
+#include <libk/io.h>
+#include <time/clock.h>
+
+boot_stage_t boot_stages[BOOT_STAGES_MAX];
+uint32_t boot_stage_count;
+
+void boot_timeline_print(void)
+{
+    if (boot_stage_count == 0)
+    {
+        return;
+    }
+    uint64_t end = rdtsc();
+    uint32_t khz = clock_tsc_khz();
+    const char *unit = khz != 0 ? "us" : "cycles";
+
+    kprintf("boot: timeline\n");
+    for (uint32_t i = 0; i < boot_stage_count; ++i)
+    {
+        uint64_t next = i + 1 < boot_stage_count ? boot_stages[i + 1].tsc : end;
+        uint64_t cycles = next - boot_stages[i].tsc;
+        uint64_t value = khz != 0 ? cycles * 1000 / khz : cycles;
+        kprintf("  %-12s %8llu %s\n", boot_stages[i].name, value, unit);
+    }
+    uint64_t total = end - boot_stages[0].tsc;
+    kprintf("boot: ready after %llu %s\n", khz != 0 ? total * 1000 / khz : total, unit);
+}
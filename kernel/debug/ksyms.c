@@ -0,0 +1,69 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <debug/ksyms.h>
+
+extern char kernel_text_end[];
+
+uint32_t ksym_total(void)
+{
+    return &ksyms_count != NULL ? ksyms_count : 0;
+}
+
+int ksym_index(uintptr_t addr)
+{
+    uint32_t count = ksym_total();
+    if (count == 0 || addr < ksyms_table[0].addr || addr >= (uintptr_t) kernel_text_end)
+    {
+        return -1;
+    }
+
+    // Last symbol at or below addr
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (high - low > 1)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        if (ksyms_table[mid].addr <= addr)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+const char *ksym_name(int index)
+{
+    if (index < 0 || (uint32_t) index >= ksym_total())
+    {
+        return NULL;
+    }
+    return &ksyms_names[ksyms_table[index].name];
+}
+
+uintptr_t ksym_addr(int index)
+{
+    if (index < 0 || (uint32_t) index >= ksym_total())
+    {
+        return 0;
+    }
+    return ksyms_table[index].addr;
+}
+
+const char *ksym_lookup(uintptr_t addr, uintptr_t *offset)
+{
+    int index = ksym_index(addr);
+    if (index < 0)
+    {
+        return NULL;
+    }
+    if (offset != NULL)
+    {
+        *offset = addr - ksyms_table[index].addr;
+    }
+    return ksym_name(index);
+}
@@ -0,0 +1,91 @@
+#include <stdint.h>
+
+#include <cpu/percpu.h>
+#include <cpu/pmu.h>
+#include <debug/perf.h>
+#include <libk/io.h>
+#include <libk/string.h>
+
+static const char *const perf_event_names[PERF_EVENT_COUNT] =
+{
+    [PERF_CYCLES] = "cycles",
+    [PERF_INSTRUCTIONS] = "instructions",
+    [PERF_REF_CYCLES] = "ref-cycles",
+    [PERF_LLC_REFERENCES] = "llc-references",
+    [PERF_LLC_MISSES] = "llc-misses",
+    [PERF_BRANCHES] = "branches",
+    [PERF_BRANCH_MISSES] = "branch-misses",
+    [PERF_DTLB_MISSES] = "dtlb-misses",
+    [PERF_ITLB_MISSES] = "itlb-misses",
+};
+
+const char *perf_event_name(perf_event_t event)
+{
+    return event < PERF_EVENT_COUNT ? perf_event_names[event] : "unknown";
+}
+
+void perf_begin(perf_scope_t *scope)
+{
+    scope->cpu = cpu_id();
+    pmu_read(scope->start);
+}
+
+void perf_end(perf_region_t *region, perf_scope_t *scope)
+{
+    uint64_t end[PERF_MAX_EVENTS];
+    pmu_read(end);
+
+    // Another CPU's counters have nothing to do with our start values
+    if (cpu_id() != scope->cpu)
+    {
+        return;
+    }
+
+    uint64_t mask = pmu_counter_mask();
+    unsigned active = pmu_active();
+    for (unsigned i = 0; i < active; ++i)
+    {
+        __atomic_fetch_add(&region->totals[i], (end[i] - scope->start[i]) & mask, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&region->calls, 1, __ATOMIC_RELAXED);
+}
+
+void perf_reset(perf_region_t *region)
+{
+    memset(region->totals, 0, sizeof(region->totals));
+    region->calls = 0;
+}
+
+void perf_report(perf_region_t *region)
+{
+    unsigned active = pmu_active();
+    if (active == 0)
+    {
+        kprintf("perf: %s: no counters available\n", region->name);
+        return;
+    }
+
+    uint64_t calls = region->calls;
+    kprintf("perf: %s: %llu calls\n", region->name, calls);
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    for (unsigned i = 0; i < active; ++i)
+    {
+        perf_event_t event = pmu_active_event(i);
+        uint64_t total = region->totals[i];
+        kprintf("  %-16s %llu (%llu per call)\n", perf_event_name(event), total, calls ? total / calls : 0);
+        if (event == PERF_CYCLES)
+        {
+            cycles = total;
+        }
+        else if (event == PERF_INSTRUCTIONS)
+        {
+            instructions = total;
+        }
+    }
+    if (cycles != 0 && instructions != 0)
+    {
+        uint64_t ipc = instructions * 100 / cycles;
+        kprintf("  ipc %llu.%02llu\n", ipc / 100, ipc % 100);
+    }
+}
@@ -0,0 +1,181 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu.h>
+#include <cpu/irqflags.h>
+#include <cpu/percpu.h>
+#include <debug/ksyms.h>
+#include <debug/profile.h>
+#include <libk/io.h>
+#include <mm/kmalloc.h>
+#include <sched/sched.h>
+#include <sched/task.h>
+#include <time/clock.h>
+
+static profile_buffer_t profile_buffers[MAX_CPUS];
+static bool profile_enabled;
+
+// Set while profile_run waits. Only the CPU its task is on checks for
+// expiry, so the check and the task going to sleep cannot race.
+static bool profile_running;
+static task_t *profile_task;
+static uint64_t profile_deadline;
+
+void profile_sample(uintptr_t pc, bool user)
+{
+    if (!__atomic_load_n(&profile_enabled, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    profile_buffer_t *buf = &profile_buffers[cpu_id()];
+    if (user)
+    {
+        ++buf->user;
+    }
+    else if (buf->count < PROFILE_SAMPLES_PER_CPU)
+    {
+        buf->samples[buf->count] = pc;
+        __atomic_store_n(&buf->count, buf->count + 1, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        ++buf->dropped;
+    }
+
+    task_t *task = __atomic_load_n(&profile_task, __ATOMIC_ACQUIRE);
+    if (task != NULL && task->cpu == cpu_id() && profile_deadline != 0 && ktime_ns() >= profile_deadline)
+    {
+        profile_deadline = 0;
+        __atomic_store_n(&profile_enabled, false, __ATOMIC_RELEASE);
+        sched_wake(task);
+    }
+}
+
+bool profile_start(void)
+{
+    unsigned cpus = cpu_count();
+    for (unsigned i = 0; i < cpus; ++i)
+    {
+        profile_buffer_t *buf = &profile_buffers[i];
+        if (buf->samples == NULL)
+        {
+            buf->samples = kmalloc(PROFILE_SAMPLES_PER_CPU * sizeof(uintptr_t), 0);
+            if (buf->samples == NULL)
+            {
+                kprintf("profile: no memory for the cpu %d sample buffer\n", i);
+                return false;
+            }
+        }
+        buf->user = 0;
+        buf->dropped = 0;
+        __atomic_store_n(&buf->count, 0, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&profile_enabled, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+void profile_stop(void)
+{
+    __atomic_store_n(&profile_enabled, false, __ATOMIC_RELEASE);
+}
+
+void profile_dump(void)
+{
+    profile_stop();
+
+    // One bucket per symbol plus one for pcs outside the kernel text
+    uint32_t symbols = ksym_total();
+    uint32_t *hits = kmalloc((symbols + 1) * sizeof(uint32_t), KMALLOC_ZERO);
+    if (hits == NULL)
+    {
+        kprintf("profile: no memory for the histogram\n");
+        return;
+    }
+
+    uint32_t total = 0;
+    uint32_t user = 0;
+    uint32_t dropped = 0;
+    unsigned cpus = cpu_count();
+    for (unsigned i = 0; i < cpus; ++i)
+    {
+        profile_buffer_t *buf = &profile_buffers[i];
+        uint32_t count = __atomic_load_n(&buf->count, __ATOMIC_ACQUIRE);
+        for (uint32_t j = 0; j < count; ++j)
+        {
+            int index = ksym_index(buf->samples[j]);
+            ++hits[index < 0 ? symbols : (uint32_t) index];
+        }
+        total += count;
+        user += buf->user;
+        dropped += buf->dropped;
+    }
+
+    kprintf("profile: %u kernel samples, %u user, %u dropped\n", total, user, dropped);
+    if (total == 0)
+    {
+        kfree(hits);
+        return;
+    }
+
+    // Repeatedly taking the largest bucket is fine for a short top list
+    for (int rank = 0; rank < PROFILE_TOP_SYMBOLS; ++rank)
+    {
+        uint32_t best = 0;
+        for (uint32_t i = 1; i <= symbols; ++i)
+        {
+            if (hits[i] > hits[best])
+            {
+                best = i;
+            }
+        }
+        if (hits[best] == 0)
+        {
+            break;
+        }
+
+        uint32_t permille = (uint64_t) hits[best] * 1000 / total;
+        const char *name = best == symbols ? "[unknown]" : ksym_name(best);
+        kprintf("  %6u %3u.%u%%  %s\n", hits[best], permille / 10, permille % 10, name);
+        hits[best] = 0;
+    }
+    kfree(hits);
+}
+
+static void profile_task_main(void *arg)
+{
+    uint32_t seconds = (uintptr_t) arg;
+
+    // With interrupts off the expiring tick cannot land between testing
+    // the deadline and blocking, it can only wake us once we sleep
+    irq_disable();
+    if (profile_start())
+    {
+        __atomic_store_n(&profile_task, current_task(), __ATOMIC_RELEASE);
+        profile_deadline = ktime_ns() + seconds * NSEC_PER_SEC;
+        while (profile_deadline != 0)
+        {
+            sched_block();
+        }
+    }
+    __atomic_store_n(&profile_task, NULL, __ATOMIC_RELEASE);
+    irq_enable();
+
+    profile_dump();
+    __atomic_store_n(&profile_running, false, __ATOMIC_RELEASE);
+}
+
+bool profile_run(uint32_t seconds)
+{
+    if (seconds == 0 || __atomic_exchange_n(&profile_running, true, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+    if (task_create("profile", profile_task_main, (void*) (uintptr_t) seconds, 0) == NULL)
+    {
+        __atomic_store_n(&profile_running, false, __ATOMIC_RELEASE);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,462 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu/irq.h>
+#include <cpu/paging.h>
+#include <drivers/block/ahci.h>
+#include <drivers/block/ata.h>
+#include <drivers/block/block.h>
+#include <drivers/pci/pci.h>
+#include <libk/io.h>
+#include <libk/string.h>
+#include <mm/kmalloc.h>
+#include <mm/pmm.h>
+
+#define AHCI_POLL_LIMIT 1000000
+#define AHCI_TABLES_ORDER 2
+#define AHCI_FIS_OFFSET 1024
+
+static unsigned ahci_disk_count;
+
+static inline uint32_t ahci_read(volatile uint32_t *regs, uint32_t reg)
+{
+    return regs[reg / 4];
+}
+
+static inline void ahci_write(volatile uint32_t *regs, uint32_t reg, uint32_t val)
+{
+    regs[reg / 4] = val;
+}
+
+static bool ahci_wait_clear(volatile uint32_t *regs, uint32_t reg, uint32_t mask)
+{
+    for (int i = 0; i < AHCI_POLL_LIMIT; ++i)
+    {
+        if (!(ahci_read(regs, reg) & mask))
+        {
+            return true;
+        }
+        asm volatile("pause");
+    }
+    return false;
+}
+
+static bool ahci_port_stop(ahci_port_t *port)
+{
+    uint32_t cmd = ahci_read(port->regs, AHCI_PX_CMD);
+    ahci_write(port->regs, AHCI_PX_CMD, cmd & ~AHCI_PX_CMD_ST);
+    if (!ahci_wait_clear(port->regs, AHCI_PX_CMD, AHCI_PX_CMD_CR))
+    {
+        return false;
+    }
+    cmd = ahci_read(port->regs, AHCI_PX_CMD);
+    ahci_write(port->regs, AHCI_PX_CMD, cmd & ~AHCI_PX_CMD_FRE);
+    return ahci_wait_clear(port->regs, AHCI_PX_CMD, AHCI_PX_CMD_FR);
+}
+
+static bool ahci_port_start(ahci_port_t *port)
+{
+    ahci_write(port->regs, AHCI_PX_SERR, 0xFFFFFFFF);
+    ahci_write(port->regs, AHCI_PX_IS, 0xFFFFFFFF);
+    ahci_write(port->regs, AHCI_PX_CMD, ahci_read(port->regs, AHCI_PX_CMD) | AHCI_PX_CMD_FRE);
+    if (!ahci_wait_clear(port->regs, AHCI_PX_TFD, AHCI_TFD_BSY | AHCI_TFD_DRQ))
+    {
+        return false;
+    }
+    ahci_write(port->regs, AHCI_PX_CMD, ahci_read(port->regs, AHCI_PX_CMD) | AHCI_PX_CMD_ST);
+    return true;
+}
+
+static void ahci_fill_fis(ahci_cmd_table_t *table, uint8_t command, uint64_t lba, uint16_t count,
+    uint16_t features)
+{
+    ahci_fis_h2d_t *fis = (ahci_fis_h2d_t*) table->cfis;
+    memset(fis, 0, sizeof(*fis));
+    fis->type = FIS_TYPE_REG_H2D;
+    fis->flags = FIS_H2D_COMMAND;
+    fis->command = command;
+    fis->device = FIS_DEVICE_LBA;
+    fis->lba0 = lba;
+    fis->lba1 = lba >> 8;
+    fis->lba2 = lba >> 16;
+    fis->lba3 = lba >> 24;
+    fis->lba4 = lba >> 32;
+    fis->lba5 = lba >> 40;
+    fis->count_low = count;
+    fis->count_high = count >> 8;
+    fis->feature_low = features;
+    fis->feature_high = features >> 8;
+}
+
+static bool ahci_direct_mapped(const void *buffer, uint32_t bytes)
+{
+    uintptr_t addr = (uintptr_t) buffer;
+    return addr >= KERNEL_VMA && addr - KERNEL_VMA + bytes <= DIRECT_MAP_SIZE;
+}
+
+// Returns the number of PRDs used, zero if a buffer is out of DMA reach
+static unsigned ahci_build_prdt(ahci_cmd_table_t *table, block_request_t *req)
+{
+    unsigned n = 0;
+    for (block_io_t *io = req->ios; io != NULL; io = io->next)
+    {
+        uint32_t bytes = io->count * BLOCK_SECTOR_SIZE;
+        if (!ahci_direct_mapped(io->buffer, bytes))
+        {
+            return 0;
+        }
+
+        uint32_t phys = virt_to_phys(io->buffer);
+        while (bytes > 0)
+        {
+            uint32_t len = bytes < AHCI_PRD_MAX_BYTES ? bytes : AHCI_PRD_MAX_BYTES;
+            if (n == AHCI_PRDT_ENTRIES)
+            {
+                return 0;
+            }
+            table->prdt[n] = (ahci_prd_t) { .addr = phys, .bytes = len - 1 };
+            ++n;
+            phys += len;
+            bytes -= len;
+        }
+    }
+    return n;
+}
+
+static void ahci_prepare(ahci_port_t *port, unsigned slot, unsigned prds, bool write)
+{
+    ahci_cmd_header_t *header = &port->cmd_list[slot];
+    header->flags = AHCI_CMD_FIS_DWORDS | (write ? AHCI_CMD_WRITE : 0);
+    header->prdt_length = prds;
+    header->prd_bytes = 0;
+    header->table = port->tables_phys + slot * sizeof(ahci_cmd_table_t);
+    header->table_high = 0;
+}
+
+static bool ahci_start(block_device_t *dev, block_request_t *req)
+{
+    ahci_port_t *port = dev->ctx;
+    uint32_t flags = spin_lock_irqsave(&port->lock);
+
+    uint32_t free = port->slot_mask & ~port->issued;
+    if (free == 0)
+    {
+        spin_unlock_irqrestore(&port->lock, flags);
+        return false;
+    }
+    unsigned slot = __builtin_ctz(free);
+    ahci_cmd_table_t *table = &port->tables[slot];
+    unsigned prds = ahci_build_prdt(table, req);
+    if (prds == 0)
+    {
+        spin_unlock_irqrestore(&port->lock, flags);
+        return false;
+    }
+
+    if (port->ncq)
+    {
+        // Queued commands carry the count in the features field and the
+        // tag where the count would go
+        uint8_t cmd = req->write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA;
+        ahci_fill_fis(table, cmd, req->lba, slot << 3, req->count);
+    }
+    else
+    {
+        uint8_t cmd = req->write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+        ahci_fill_fis(table, cmd, req->lba, req->count, 0);
+    }
+    ahci_prepare(port, slot, prds, req->write);
+
+    req->tag = slot;
+    port->slots[slot] = req;
+    port->issued |= 1u << slot;
+    // The header, FIS and PRDT are plain stores the compiler could sink
+    // past the volatile doorbell. x86 keeps them ordered for the HBA once
+    // they are issued in program order.
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    if (port->ncq)
+    {
+        ahci_write(port->regs, AHCI_PX_SACT, 1u << slot);
+    }
+    ahci_write(port->regs, AHCI_PX_CI, 1u << slot);
+    spin_unlock_irqrestore(&port->lock, flags);
+    return true;
+}
+
+static const block_ops_t ahci_ops =
+{
+    .start = ahci_start,
+};
+
+static void ahci_port_interrupt(ahci_port_t *port)
+{
+    block_request_t *done[AHCI_MAX_SLOTS];
+    unsigned count = 0;
+
+    spin_lock(&port->lock);
+    uint32_t status = ahci_read(port->regs, AHCI_PX_IS);
+    ahci_write(port->regs, AHCI_PX_IS, status);
+
+    bool ok = !(status & AHCI_PX_IS_ERRORS);
+    uint32_t finished;
+    if (ok)
+    {
+        uint32_t busy = ahci_read(port->regs, AHCI_PX_CI);
+        if (port->ncq)
+        {
+            busy |= ahci_read(port->regs, AHCI_PX_SACT);
+        }
+        finished = port->issued & ~busy;
+    }
+    else
+    {
+        // Without reading the NCQ error log there is no telling which
+        // command failed, so everything in flight fails and the port is
+        // restarted to clear the error
+        finished = port->issued;
+        uint32_t tfd = ahci_read(port->regs, AHCI_PX_TFD);
+        kprintf("ahci: %s error, status %x, task file %x\n", port->dev.name, status, tfd);
+        ahci_port_stop(port);
+        ahci_port_start(port);
+    }
+
+    port->issued &= ~finished;
+    while (finished != 0)
+    {
+        unsigned slot = __builtin_ctz(finished);
+        finished &= finished - 1;
+        done[count++] = port->slots[slot];
+        port->slots[slot] = NULL;
+    }
+    spin_unlock(&port->lock);
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        block_complete(&port->dev, done[i], ok);
+    }
+}
+
+static void ahci_interrupt(interrupt_registers_t *regs, void *ctx)
+{
+    (void) regs;
+    ahci_hba_t *hba = ctx;
+    uint32_t pending = ahci_read(hba->regs, AHCI_IS);
+    for (uint32_t bits = pending; bits != 0; bits &= bits - 1)
+    {
+        ahci_port_t *port = hba->ports[__builtin_ctz(bits)];
+        if (port != NULL)
+        {
+            ahci_port_interrupt(port);
+        }
+    }
+    // Port status is cleared first, the HBA bit would be set again otherwise
+    ahci_write(hba->regs, AHCI_IS, pending);
+}
+
+// Polled, only used while the port's interrupts are still off
+static bool ahci_identify(ahci_port_t *port, uint16_t *id)
+{
+    uintptr_t buffer = pmm_alloc_frame();
+    if (buffer == 0)
+    {
+        return false;
+    }
+
+    ahci_cmd_table_t *table = &port->tables[0];
+    table->prdt[0] = (ahci_prd_t) { .addr = buffer, .bytes = BLOCK_SECTOR_SIZE - 1 };
+    ahci_fill_fis(table, ATA_CMD_IDENTIFY, 0, 0, 0);
+    ((ahci_fis_h2d_t*) table->cfis)->device = 0;
+    ahci_prepare(port, 0, 1, false);
+
+    ahci_write(port->regs, AHCI_PX_CI, 1);
+    bool ok = ahci_wait_clear(port->regs, AHCI_PX_CI, 1)
+        && !(ahci_read(port->regs, AHCI_PX_IS) & AHCI_PX_IS_TFES);
+    if (ok)
+    {
+        memcpy(id, phys_to_virt(buffer), BLOCK_SECTOR_SIZE);
+    }
+    ahci_write(port->regs, AHCI_PX_IS, 0xFFFFFFFF);
+    pmm_free_frame(buffer);
+    return ok;
+}
+
+static void ahci_port_free(ahci_port_t *port)
+{
+    if (port->tables_phys != 0)
+    {
+        pmm_free_frames(port->tables_phys, AHCI_TABLES_ORDER);
+    }
+    if (port->cmd_list_phys != 0)
+    {
+        pmm_free_frame(port->cmd_list_phys);
+    }
+    kfree(port);
+}
+
+// Points the port at its command list and FIS area, starts it and asks the
+// drive what it is
+static bool ahci_port_setup(ahci_port_t *port, uint16_t *id)
+{
+    if (!ahci_port_stop(port))
+    {
+        return false;
+    }
+    ahci_write(port->regs, AHCI_PX_CLB, port->cmd_list_phys);
+    ahci_write(port->regs, AHCI_PX_CLBU, 0);
+    ahci_write(port->regs, AHCI_PX_FB, port->cmd_list_phys + AHCI_FIS_OFFSET);
+    ahci_write(port->regs, AHCI_PX_FBU, 0);
+    if (!ahci_port_start(port))
+    {
+        return false;
+    }
+    if (!ahci_identify(port, id) || !(id[ATA_ID_COMMAND_SETS] & ATA_ID_CMD_LBA48))
+    {
+        ahci_port_stop(port);
+        return false;
+    }
+    return true;
+}
+
+static ahci_port_t *ahci_port_init(ahci_hba_t *hba, unsigned index)
+{
+    volatile uint32_t *regs = hba->regs + (AHCI_PORT_BASE + index * AHCI_PORT_SIZE) / 4;
+    uint32_t ssts = ahci_read(regs, AHCI_PX_SSTS);
+    if ((ssts & AHCI_SSTS_DET_MASK) != AHCI_SSTS_DET_PRESENT || ahci_read(regs, AHCI_PX_SIG) != AHCI_SIG_ATA)
+    {
+        return NULL;
+    }
+
+    ahci_port_t *port = kmalloc(sizeof(ahci_port_t), KMALLOC_ZERO);
+    if (port == NULL)
+    {
+        return NULL;
+    }
+    port->cmd_list_phys = pmm_alloc_frame();
+    port->tables_phys = pmm_alloc_frames(AHCI_TABLES_ORDER);
+    if (port->cmd_list_phys == 0 || port->tables_phys == 0)
+    {
+        ahci_port_free(port);
+        return NULL;
+    }
+    port->hba = hba;
+    port->regs = regs;
+    port->index = index;
+    port->cmd_list = phys_to_virt(port->cmd_list_phys);
+    port->tables = phys_to_virt(port->tables_phys);
+    port->lock = (spinlock_t) SPINLOCK_INIT("ahci");
+    memset(port->cmd_list, 0, PAGE_SIZE);
+    memset(port->tables, 0, PAGE_SIZE << AHCI_TABLES_ORDER);
+
+    uint16_t id[256];
+    if (!ahci_port_setup(port, id))
+    {
+        ahci_port_free(port);
+        return NULL;
+    }
+
+    unsigned depth = 1;
+    port->ncq = (hba->cap & AHCI_CAP_SNCQ) && (id[ATA_ID_SATA_CAPABILITIES] & ATA_ID_SATA_NCQ);
+    if (port->ncq)
+    {
+        depth = (id[ATA_ID_QUEUE_DEPTH] & 0x1F) + 1;
+        if (depth > hba->slots)
+        {
+            depth = hba->slots;
+        }
+    }
+    port->slot_mask = hba->slots == 32 ? 0xFFFFFFFF : (1u << hba->slots) - 1;
+
+    block_device_t *dev = &port->dev;
+    dev->name[0] = 's';
+    dev->name[1] = 'd';
+    dev->name[2] = 'a' + ahci_disk_count++;
+    dev->sectors = (uint64_t) id[ATA_ID_LBA48_SECTORS] | ((uint64_t) id[ATA_ID_LBA48_SECTORS + 1] << 16)
+        | ((uint64_t) id[ATA_ID_LBA48_SECTORS + 2] << 32) | ((uint64_t) id[ATA_ID_LBA48_SECTORS + 3] << 48);
+    dev->max_sectors = AHCI_MAX_SECTORS;
+    dev->max_segments = AHCI_PRDT_ENTRIES;
+    dev->depth = depth;
+    dev->ops = &ahci_ops;
+    dev->ctx = port;
+
+    ahci_write(regs, AHCI_PX_IE, AHCI_PX_IS_DHRS | AHCI_PX_IS_PSS | AHCI_PX_IS_SDBS | AHCI_PX_IS_ERRORS);
+    return port;
+}
+
+static void ahci_init_hba(const pci_device_t *pci)
+{
+    uint32_t abar = pci_bar(pci, AHCI_ABAR);
+    if (abar == 0)
+    {
+        return;
+    }
+    ahci_hba_t *hba = kmalloc(sizeof(ahci_hba_t), KMALLOC_ZERO);
+    if (hba == NULL)
+    {
+        return;
+    }
+    hba->pci = pci;
+    hba->regs = paging_map_mmio(abar, AHCI_PORT_BASE + AHCI_MAX_PORTS * AHCI_PORT_SIZE);
+    if (hba->regs == NULL)
+    {
+        kfree(hba);
+        return;
+    }
+    pci_enable(pci, PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+
+    // No HBA reset, that would drop the links the firmware brought up.
+    // Each port is stopped before it is reprogrammed instead.
+    ahci_write(hba->regs, AHCI_GHC, ahci_read(hba->regs, AHCI_GHC) | AHCI_GHC_AE);
+
+    hba->cap = ahci_read(hba->regs, AHCI_CAP);
+    hba->slots = ((hba->cap >> AHCI_CAP_NCS_SHIFT) & AHCI_CAP_NCS_MASK) + 1;
+    uint32_t implemented = ahci_read(hba->regs, AHCI_PI);
+    bool any = false;
+    for (unsigned i = 0; i < AHCI_MAX_PORTS; ++i)
+    {
+        if (implemented & (1u << i))
+        {
+            hba->ports[i] = ahci_port_init(hba, i);
+            any |= hba->ports[i] != NULL;
+        }
+    }
+    if (!any)
+    {
+        return;
+    }
+
+    // MSI needs no routing, the legacy line is used where the firmware
+    // put it and switched to level triggered, active low
+    uint32_t address;
+    uint16_t data;
+    bool irq = irq_msi_alloc(ahci_interrupt, hba, &address, &data) && pci_enable_msi(pci, address, data);
+    if (!irq)
+    {
+        irq = irq_set_trigger(pci->irq, true, true) && irq_register(pci->irq, ahci_interrupt, hba);
+    }
+    if (!irq)
+    {
+        kprintf("ahci: no interrupt for the controller\n");
+        return;
+    }
+    ahci_write(hba->regs, AHCI_IS, 0xFFFFFFFF);
+    ahci_write(hba->regs, AHCI_GHC, ahci_read(hba->regs, AHCI_GHC) | AHCI_GHC_IE);
+
+    for (unsigned i = 0; i < AHCI_MAX_PORTS; ++i)
+    {
+        if (hba->ports[i] != NULL)
+        {
+            block_register(&hba->ports[i]->dev);
+        }
+    }
+}
+
+void ahci_init(void)
+{
+    unsigned index = 0;
+    const pci_device_t *pci;
+    while ((pci = pci_find_class(PCI_CLASS_STORAGE, PCI_STORAGE_SATA, AHCI_PROG_IF, &index)) != NULL)
+    {
+        ahci_init_hba(pci);
+    }
+}
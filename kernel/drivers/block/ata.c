@@ -0,0 +1,531 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu/irq.h>
+#include <cpu/ports.h>
+#include <drivers/block/ata.h>
+#include <drivers/block/block.h>
+#include <drivers/pci/pci.h>
+#include <libk/io.h>
+#include <libk/string.h>
+#include <mm/pmm.h>
+
+// Polling limits for the few places that cannot wait for an interrupt
+#define ATA_POLL_LIMIT 1000000
+
+static ata_channel_t ata_channels[2] =
+{
+    { .io = ATA_PRIMARY_IO, .ctrl = ATA_PRIMARY_CTRL, .irq = ATA_PRIMARY_IRQ },
+    { .io = ATA_SECONDARY_IO, .ctrl = ATA_SECONDARY_CTRL, .irq = ATA_SECONDARY_IRQ },
+};
+
+static const char *ata_names[4] = { "hda", "hdb", "hdc", "hdd" };
+
+// Reading the alternate status four times gives the drive the 400 ns it
+// needs before status reflects a new command or drive selection
+static void ata_delay(ata_channel_t *channel)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        inb(channel->ctrl);
+    }
+}
+
+static bool ata_wait_idle(ata_channel_t *channel)
+{
+    for (int i = 0; i < ATA_POLL_LIMIT; ++i)
+    {
+        if (!(inb(channel->ctrl) & ATA_STATUS_BSY))
+        {
+            return true;
+        }
+        asm volatile("pause");
+    }
+    return false;
+}
+
+static bool ata_wait_drq(ata_channel_t *channel)
+{
+    for (int i = 0; i < ATA_POLL_LIMIT; ++i)
+    {
+        uint8_t status = inb(channel->ctrl);
+        if (status & (ATA_STATUS_ERR | ATA_STATUS_DF))
+        {
+            return false;
+        }
+        if (!(status & ATA_STATUS_BSY) && (status & ATA_STATUS_DRQ))
+        {
+            return true;
+        }
+        asm volatile("pause");
+    }
+    return false;
+}
+
+static bool ata_direct_mapped(const void *buffer, uint32_t bytes)
+{
+    uintptr_t addr = (uintptr_t) buffer;
+    return addr >= KERNEL_VMA && addr - KERNEL_VMA + bytes <= DIRECT_MAP_SIZE;
+}
+
+// Fills the PRD table from the request's ios, false if a buffer cannot be
+// reached by the bus master and the request has to go through PIO instead
+static bool ata_build_prdt(ata_channel_t *channel, block_request_t *req)
+{
+    unsigned n = 0;
+    for (block_io_t *io = req->ios; io != NULL; io = io->next)
+    {
+        uint32_t bytes = io->count * BLOCK_SECTOR_SIZE;
+        if (!ata_direct_mapped(io->buffer, bytes))
+        {
+            return false;
+        }
+
+        uint32_t phys = virt_to_phys(io->buffer);
+        while (bytes > 0)
+        {
+            uint32_t room = ATA_PRD_BOUNDARY - (phys & (ATA_PRD_BOUNDARY - 1));
+            uint32_t len = bytes < room ? bytes : room;
+            if (n == ATA_PRDT_ENTRIES)
+            {
+                return false;
+            }
+            channel->prdt[n].addr = phys;
+            channel->prdt[n].bytes = len & 0xFFFF;
+            channel->prdt[n].flags = 0;
+            ++n;
+            phys += len;
+            bytes -= len;
+        }
+    }
+    channel->prdt[n - 1].flags = ATA_PRD_EOT;
+    return true;
+}
+
+static void ata_select(ata_channel_t *channel, ata_drive_t *drive, uint64_t lba)
+{
+    uint8_t select = ATA_DRIVE_OBSOLETE | ATA_DRIVE_LBA | (drive->slave ? ATA_DRIVE_SLAVE : 0);
+    if (!drive->lba48)
+    {
+        select |= (lba >> 24) & 0x0F;
+    }
+    outb(channel->io + ATA_DRIVE, select);
+    ata_delay(channel);
+}
+
+static void ata_set_range(ata_channel_t *channel, ata_drive_t *drive, uint64_t lba, uint32_t count)
+{
+    // LBA48 takes the high bytes first through the same registers
+    if (drive->lba48)
+    {
+        outb(channel->io + ATA_COUNT, count >> 8);
+        outb(channel->io + ATA_LBA_LOW, lba >> 24);
+        outb(channel->io + ATA_LBA_MID, lba >> 32);
+        outb(channel->io + ATA_LBA_HIGH, lba >> 40);
+    }
+    // A count of zero means 256 sectors without LBA48
+    outb(channel->io + ATA_COUNT, count);
+    outb(channel->io + ATA_LBA_LOW, lba);
+    outb(channel->io + ATA_LBA_MID, lba >> 8);
+    outb(channel->io + ATA_LBA_HIGH, lba >> 16);
+}
+
+static void ata_pio_sector(ata_channel_t *channel, bool write)
+{
+    uint8_t *buf = (uint8_t*) channel->pio_io->buffer + channel->pio_offset;
+    if (write)
+    {
+        outsw(channel->io + ATA_DATA, buf, BLOCK_SECTOR_SIZE / 2);
+    }
+    else
+    {
+        insw(channel->io + ATA_DATA, buf, BLOCK_SECTOR_SIZE / 2);
+    }
+
+    channel->pio_offset += BLOCK_SECTOR_SIZE;
+    if (channel->pio_offset == channel->pio_io->count * BLOCK_SECTOR_SIZE && channel->pio_io->next != NULL)
+    {
+        channel->pio_io = channel->pio_io->next;
+        channel->pio_offset = 0;
+    }
+    --channel->pio_left;
+}
+
+// Puts a request on the wire, called with the channel lock held
+static bool ata_issue(ata_channel_t *channel, ata_drive_t *drive, block_request_t *req)
+{
+    ata_select(channel, drive, req->lba);
+    if (!ata_wait_idle(channel))
+    {
+        return false;
+    }
+
+    bool dma = drive->dma && ata_build_prdt(channel, req);
+    req->tag = drive->slave;
+    channel->active = req;
+    channel->active_dma = dma;
+
+    if (dma)
+    {
+        // Keeps the PRDT stores ahead of the port writes that start
+        // the transfer
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        outb(channel->bmide + BMIDE_COMMAND, 0);
+        outl(channel->bmide + BMIDE_PRDT, channel->prdt_phys);
+        outb(channel->bmide + BMIDE_STATUS, BMIDE_STATUS_ERROR | BMIDE_STATUS_IRQ);
+        ata_set_range(channel, drive, req->lba, req->count);
+
+        uint8_t cmd;
+        if (req->write)
+        {
+            cmd = drive->lba48 ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_DMA;
+        }
+        else
+        {
+            cmd = drive->lba48 ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_DMA;
+        }
+        outb(channel->io + ATA_COMMAND, cmd);
+        // Bus master direction is from the memory's side, a disk read writes it
+        outb(channel->bmide + BMIDE_COMMAND, BMIDE_CMD_START | (req->write ? 0 : BMIDE_CMD_READ));
+        return true;
+    }
+
+    channel->pio_io = req->ios;
+    channel->pio_offset = 0;
+    channel->pio_left = req->count;
+    ata_set_range(channel, drive, req->lba, req->count);
+    if (req->write)
+    {
+        outb(channel->io + ATA_COMMAND, drive->lba48 ? ATA_CMD_WRITE_PIO_EXT : ATA_CMD_WRITE_PIO);
+        // The first sector goes out without an interrupt, each one after
+        // that once the drive asks for it
+        if (!ata_wait_drq(channel))
+        {
+            channel->active = NULL;
+            return false;
+        }
+        ata_pio_sector(channel, true);
+    }
+    else
+    {
+        outb(channel->io + ATA_COMMAND, drive->lba48 ? ATA_CMD_READ_PIO_EXT : ATA_CMD_READ_PIO);
+    }
+    return true;
+}
+
+static bool ata_start(block_device_t *dev, block_request_t *req)
+{
+    ata_drive_t *drive = dev->ctx;
+    ata_channel_t *channel = drive->channel;
+    bool ok = true;
+
+    spin_lock(&channel->lock);
+    if (channel->active != NULL)
+    {
+        req->tag = drive->slave;
+        req->next = NULL;
+        if (channel->waiting_tail != NULL)
+        {
+            channel->waiting_tail->next = req;
+        }
+        else
+        {
+            channel->waiting = req;
+        }
+        channel->waiting_tail = req;
+    }
+    else
+    {
+        ok = ata_issue(channel, drive, req);
+    }
+    spin_unlock(&channel->lock);
+    return ok;
+}
+
+// Returns true once the active request is over, with *ok its result
+static bool ata_progress(ata_channel_t *channel, bool *ok)
+{
+    block_request_t *req = channel->active;
+    if (channel->active_dma)
+    {
+        uint8_t bm = inb(channel->bmide + BMIDE_STATUS);
+        if (!(bm & BMIDE_STATUS_IRQ))
+        {
+            return false;
+        }
+        outb(channel->bmide + BMIDE_COMMAND, 0);
+        outb(channel->bmide + BMIDE_STATUS, BMIDE_STATUS_ERROR | BMIDE_STATUS_IRQ);
+        uint8_t status = inb(channel->io + ATA_STATUS);
+        *ok = !(bm & BMIDE_STATUS_ERROR) && !(status & (ATA_STATUS_ERR | ATA_STATUS_DF));
+        return true;
+    }
+
+    // Reading status acknowledges the interrupt
+    uint8_t status = inb(channel->io + ATA_STATUS);
+    if (status & ATA_STATUS_BSY)
+    {
+        return false;
+    }
+    if (status & (ATA_STATUS_ERR | ATA_STATUS_DF))
+    {
+        *ok = false;
+        return true;
+    }
+    if (channel->pio_left == 0)
+    {
+        *ok = true;
+        return true;
+    }
+    if (!(status & ATA_STATUS_DRQ))
+    {
+        return false;
+    }
+
+    ata_pio_sector(channel, req->write);
+    // Reads are done with the last sector, writes get one more interrupt
+    // once the drive committed it
+    if (!req->write && channel->pio_left == 0)
+    {
+        *ok = true;
+        return true;
+    }
+    return false;
+}
+
+static void ata_interrupt(interrupt_registers_t *regs, void *ctx)
+{
+    (void) regs;
+    ata_channel_t *channel = ctx;
+    block_request_t *done = NULL;
+    bool ok = false;
+    // Requests the channel could not start, the drive is in their tag
+    block_request_t *failed = NULL;
+
+    spin_lock(&channel->lock);
+    if (channel->active == NULL)
+    {
+        inb(channel->io + ATA_STATUS);
+        spin_unlock(&channel->lock);
+        return;
+    }
+    if (ata_progress(channel, &ok))
+    {
+        done = channel->active;
+        channel->active = NULL;
+
+        // Keep the channel busy with whatever the other drive queued
+        while (channel->waiting != NULL && channel->active == NULL)
+        {
+            block_request_t *next = channel->waiting;
+            channel->waiting = next->next;
+            if (channel->waiting == NULL)
+            {
+                channel->waiting_tail = NULL;
+            }
+            next->next = NULL;
+            if (!ata_issue(channel, &channel->drives[next->tag], next))
+            {
+                next->next = failed;
+                failed = next;
+            }
+        }
+    }
+    spin_unlock(&channel->lock);
+
+    if (done != NULL)
+    {
+        block_complete(&channel->drives[done->tag].dev, done, ok);
+    }
+    while (failed != NULL)
+    {
+        block_request_t *next = failed->next;
+        block_complete(&channel->drives[failed->tag].dev, failed, false);
+        failed = next;
+    }
+}
+
+// Native mode channels may share one interrupt line
+static void ata_interrupt_shared(interrupt_registers_t *regs, void *ctx)
+{
+    (void) ctx;
+    ata_interrupt(regs, &ata_channels[0]);
+    ata_interrupt(regs, &ata_channels[1]);
+}
+
+static const block_ops_t ata_ops =
+{
+    .start = ata_start,
+};
+
+static bool ata_identify(ata_channel_t *channel, ata_drive_t *drive, uint16_t *id)
+{
+    outb(channel->io + ATA_DRIVE, ATA_DRIVE_OBSOLETE | (drive->slave ? ATA_DRIVE_SLAVE : 0));
+    ata_delay(channel);
+    outb(channel->io + ATA_COUNT, 0);
+    outb(channel->io + ATA_LBA_LOW, 0);
+    outb(channel->io + ATA_LBA_MID, 0);
+    outb(channel->io + ATA_LBA_HIGH, 0);
+    outb(channel->io + ATA_COMMAND, ATA_CMD_IDENTIFY);
+    ata_delay(channel);
+
+    // Floating bus or no drive behind it
+    uint8_t status = inb(channel->io + ATA_STATUS);
+    if (status == 0 || status == 0xFF || !ata_wait_idle(channel))
+    {
+        return false;
+    }
+    // ATAPI and SATA signatures, the packet interface is not supported
+    if (inb(channel->io + ATA_LBA_MID) != 0 || inb(channel->io + ATA_LBA_HIGH) != 0)
+    {
+        return false;
+    }
+    if (!ata_wait_drq(channel))
+    {
+        return false;
+    }
+    insw(channel->io + ATA_DATA, id, 256);
+    return true;
+}
+
+static void ata_probe_drive(ata_channel_t *channel, bool slave)
+{
+    ata_drive_t *drive = &channel->drives[slave];
+    drive->channel = channel;
+    drive->slave = slave;
+
+    uint16_t id[256];
+    if (!ata_identify(channel, drive, id) || !(id[ATA_ID_CAPABILITIES] & ATA_ID_CAP_LBA))
+    {
+        return;
+    }
+
+    drive->lba48 = id[ATA_ID_COMMAND_SETS] & ATA_ID_CMD_LBA48;
+    drive->dma = channel->bmide != 0 && (id[ATA_ID_CAPABILITIES] & ATA_ID_CAP_DMA);
+    uint64_t sectors;
+    if (drive->lba48)
+    {
+        sectors = (uint64_t) id[ATA_ID_LBA48_SECTORS] | ((uint64_t) id[ATA_ID_LBA48_SECTORS + 1] << 16)
+            | ((uint64_t) id[ATA_ID_LBA48_SECTORS + 2] << 32) | ((uint64_t) id[ATA_ID_LBA48_SECTORS + 3] << 48);
+    }
+    else
+    {
+        sectors = id[ATA_ID_LBA28_SECTORS] | ((uint32_t) id[ATA_ID_LBA28_SECTORS + 1] << 16);
+    }
+    if (sectors == 0)
+    {
+        return;
+    }
+
+    block_device_t *dev = &drive->dev;
+    memcpy(dev->name, ata_names[(channel - ata_channels) * 2 + drive->slave], 4);
+    dev->sectors = sectors;
+    dev->max_sectors = ATA_MAX_SECTORS;
+    dev->max_segments = ATA_MAX_SEGMENTS;
+    dev->depth = 1;
+    dev->ops = &ata_ops;
+    dev->ctx = drive;
+    drive->present = true;
+}
+
+// Returns whether any drive answered on the channel
+static bool ata_probe_channel(ata_channel_t *channel)
+{
+    channel->lock = (spinlock_t) SPINLOCK_INIT("ata");
+    if (inb(channel->io + ATA_STATUS) == 0xFF)
+    {
+        return false;
+    }
+
+    if (channel->bmide != 0)
+    {
+        uintptr_t prdt = pmm_alloc_frame();
+        if (prdt == 0)
+        {
+            channel->bmide = 0;
+        }
+        else
+        {
+            channel->prdt = phys_to_virt(prdt);
+            channel->prdt_phys = prdt;
+        }
+    }
+
+    // Probe with interrupts off, IDENTIFY is polled
+    outb(channel->ctrl, ATA_CTRL_NIEN);
+    ata_probe_drive(channel, false);
+    ata_probe_drive(channel, true);
+    return channel->drives[0].present || channel->drives[1].present;
+}
+
+static void ata_start_channel(ata_channel_t *channel, interrupt_handler_t handler, void *ctx)
+{
+    if (handler != NULL && !irq_register(channel->irq, handler, ctx))
+    {
+        kprintf("ata: irq %d unavailable\n", channel->irq);
+        return;
+    }
+    outb(channel->ctrl, 0);
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        ata_drive_t *drive = &channel->drives[i];
+        if (drive->present)
+        {
+            block_register(&drive->dev);
+        }
+    }
+}
+
+void ata_init(void)
+{
+    // A PCI IDE controller gives the channels a bus master for DMA and may
+    // have moved them off the legacy ports
+    unsigned index = 0;
+    const pci_device_t *ide = pci_find_class(PCI_CLASS_STORAGE, PCI_STORAGE_IDE, PCI_ANY, &index);
+    if (ide != NULL)
+    {
+        pci_enable(ide, PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+        uint32_t bmide = pci_bar(ide, 4);
+        for (unsigned i = 0; i < 2; ++i)
+        {
+            ata_channel_t *channel = &ata_channels[i];
+            // Prog IF bits 0 and 2 mark the channels running in native mode
+            if (ide->prog_if & (1 << (i * 2)))
+            {
+                channel->io = pci_bar(ide, i * 2);
+                channel->ctrl = pci_bar(ide, i * 2 + 1) + 2;
+                channel->irq = ide->irq;
+                // Native channels interrupt through the PCI INTx pin
+                irq_set_trigger(channel->irq, true, true);
+            }
+            if (bmide != 0 && (ide->prog_if & (1 << 7)))
+            {
+                channel->bmide = bmide + i * BMIDE_CHANNEL_STRIDE;
+            }
+        }
+    }
+
+    bool present[2];
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        present[i] = ata_probe_channel(&ata_channels[i]);
+    }
+
+    // The second of two channels on one line rides on the first's handler
+    bool shared = present[0] && present[1] && ata_channels[0].irq == ata_channels[1].irq;
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        if (!present[i])
+        {
+            continue;
+        }
+        if (shared)
+        {
+            ata_start_channel(&ata_channels[i], i == 0 ? ata_interrupt_shared : NULL, NULL);
+        }
+        else
+        {
+            ata_start_channel(&ata_channels[i], ata_interrupt, &ata_channels[i]);
+        }
+    }
+}
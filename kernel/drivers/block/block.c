@@ -0,0 +1,350 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu.h>
+#include <cpu/irqflags.h>
+#include <cpu/percpu.h>
+#include <drivers/block/ahci.h>
+#include <drivers/block/ata.h>
+#include <drivers/block/block.h>
+#include <libk/io.h>
+#include <libk/string.h>
+#include <mm/slab.h>
+#include <sched/sched.h>
+#include <sched/softirq.h>
+#include <sched/task.h>
+
+static block_device_t *block_devices;
+static spinlock_t block_list_lock = SPINLOCK_INIT("block_list");
+static kmem_cache_t *block_request_cache;
+
+// Requests completed on a CPU and waiting for its block softirq
+typedef struct block_completions_t
+{
+    block_request_t *head;
+    block_request_t *tail;
+} __attribute__((aligned(64))) block_completions_t;
+
+static block_completions_t block_completions[MAX_CPUS];
+
+typedef struct block_wait_t
+{
+    volatile bool done;
+    bool ok;
+    task_t *task;
+} block_wait_t;
+
+static void block_softirq(void);
+
+void block_init(void)
+{
+    block_request_cache = kmem_cache_create("block_request", sizeof(block_request_t), 0, NULL);
+    if (block_request_cache == NULL)
+    {
+        kprintf("block: no memory for the request cache\n");
+        return;
+    }
+    softirq_register(SOFTIRQ_BLOCK, block_softirq);
+    ahci_init();
+    ata_init();
+}
+
+void block_register(block_device_t *dev)
+{
+    dev->lock = (spinlock_t) SPINLOCK_INIT("block");
+    dev->pending = NULL;
+    dev->inflight = 0;
+    dev->position = 0;
+    dev->next = NULL;
+
+    uint32_t flags = spin_lock_irqsave(&block_list_lock);
+    block_device_t **link = &block_devices;
+    while (*link != NULL)
+    {
+        link = &(*link)->next;
+    }
+    *link = dev;
+    spin_unlock_irqrestore(&block_list_lock, flags);
+
+    kprintf("block: %s, %llu MiB, queue depth %u\n", dev->name,
+        dev->sectors / (1024 * 1024 / BLOCK_SECTOR_SIZE), dev->depth);
+}
+
+block_device_t *block_find(const char *name)
+{
+    size_t len = strlen(name);
+    if (len >= BLOCK_NAME_LEN)
+    {
+        return NULL;
+    }
+    for (block_device_t *dev = block_devices; dev != NULL; dev = dev->next)
+    {
+        if (memcmp(dev->name, name, len + 1) == 0)
+        {
+            return dev;
+        }
+    }
+    return NULL;
+}
+
+block_device_t *block_first(void)
+{
+    return block_devices;
+}
+
+// Tries to extend a pending request in the same direction that io
+// continues or is continued by
+static bool block_merge(block_device_t *dev, block_io_t *io)
+{
+    for (block_request_t *req = dev->pending; req != NULL; req = req->next)
+    {
+        if (req->write != io->write || req->segments >= dev->max_segments
+            || req->count + io->count > dev->max_sectors)
+        {
+            continue;
+        }
+
+        if (req->lba + req->count == io->lba)
+        {
+            req->ios_tail->next = io;
+            req->ios_tail = io;
+        }
+        else if (io->lba + io->count == req->lba)
+        {
+            io->next = req->ios;
+            req->ios = io;
+            req->lba = io->lba;
+        }
+        else
+        {
+            continue;
+        }
+        req->count += io->count;
+        ++req->segments;
+        ++dev->merges;
+        return true;
+    }
+    return false;
+}
+
+static void block_insert(block_device_t *dev, block_request_t *req)
+{
+    block_request_t **link = &dev->pending;
+    while (*link != NULL && (*link)->lba <= req->lba)
+    {
+        link = &(*link)->next;
+    }
+    req->next = *link;
+    *link = req;
+}
+
+// Starts requests while the device has room, returns those that failed
+// to start so they can be completed once the lock is dropped
+static block_request_t *block_dispatch(block_device_t *dev)
+{
+    block_request_t *failed = NULL;
+    while (dev->inflight < dev->depth && dev->pending != NULL)
+    {
+        block_request_t **link = &dev->pending;
+        while (*link != NULL && (*link)->lba < dev->position)
+        {
+            link = &(*link)->next;
+        }
+        if (*link == NULL)
+        {
+            link = &dev->pending;
+        }
+
+        block_request_t *req = *link;
+        *link = req->next;
+        req->next = NULL;
+        dev->position = req->lba + req->count;
+
+        ++dev->inflight;
+        if (!dev->ops->start(dev, req))
+        {
+            --dev->inflight;
+            req->next = failed;
+            failed = req;
+        }
+    }
+    return failed;
+}
+
+static void block_finish(block_request_t *req, bool ok)
+{
+    block_io_t *io = req->ios;
+    kmem_cache_free(block_request_cache, req);
+    while (io != NULL)
+    {
+        // done may free the io
+        block_io_t *next = io->next;
+        io->done(io, ok);
+        io = next;
+    }
+}
+
+static void block_finish_all(block_request_t *list, bool ok)
+{
+    while (list != NULL)
+    {
+        block_request_t *next = list->next;
+        block_finish(list, ok);
+        list = next;
+    }
+}
+
+bool block_submit(block_device_t *dev, block_io_t *io)
+{
+    if (io->count == 0 || io->count > dev->max_sectors
+        || io->lba >= dev->sectors || io->count > dev->sectors - io->lba)
+    {
+        return false;
+    }
+    io->next = NULL;
+
+    uint32_t flags = spin_lock_irqsave(&dev->lock);
+    if (!block_merge(dev, io))
+    {
+        block_request_t *req = kmem_cache_alloc(block_request_cache);
+        if (req == NULL)
+        {
+            spin_unlock_irqrestore(&dev->lock, flags);
+            return false;
+        }
+        *req = (block_request_t) {
+            .lba = io->lba,
+            .count = io->count,
+            .write = io->write,
+            .segments = 1,
+            .ios = io,
+            .ios_tail = io,
+        };
+        block_insert(dev, req);
+    }
+    block_request_t *failed = block_dispatch(dev);
+    spin_unlock_irqrestore(&dev->lock, flags);
+
+    block_finish_all(failed, false);
+    return true;
+}
+
+static void block_defer(block_request_t *list, bool ok)
+{
+    uint32_t flags = irq_save();
+    block_completions_t *done = &block_completions[cpu_id()];
+    while (list != NULL)
+    {
+        block_request_t *req = list;
+        list = list->next;
+        req->ok = ok;
+        req->next = NULL;
+        if (done->tail != NULL)
+        {
+            done->tail->next = req;
+        }
+        else
+        {
+            done->head = req;
+        }
+        done->tail = req;
+    }
+    irq_restore(flags);
+}
+
+void block_complete(block_device_t *dev, block_request_t *req, bool ok)
+{
+    uint32_t flags = spin_lock_irqsave(&dev->lock);
+    --dev->inflight;
+    ++dev->completed;
+    block_request_t *failed = block_dispatch(dev);
+    spin_unlock_irqrestore(&dev->lock, flags);
+
+    req->next = NULL;
+    block_defer(req, ok);
+    block_defer(failed, false);
+    softirq_raise(SOFTIRQ_BLOCK);
+}
+
+static void block_softirq(void)
+{
+    uint32_t flags = irq_save();
+    block_completions_t *done = &block_completions[cpu_id()];
+    block_request_t *req = done->head;
+    done->head = NULL;
+    done->tail = NULL;
+    irq_restore(flags);
+
+    while (req != NULL)
+    {
+        block_request_t *next = req->next;
+        block_finish(req, req->ok);
+        req = next;
+    }
+}
+
+static void block_wait_done(block_io_t *io, bool ok)
+{
+    block_wait_t *wait = io->ctx;
+    // The waiter may return as soon as done is set, take what is needed
+    // from its stack first
+    task_t *task = wait->task;
+    wait->ok = ok;
+    __atomic_store_n(&wait->done, true, __ATOMIC_RELEASE);
+    if (task != NULL)
+    {
+        sched_wake(task);
+    }
+}
+
+static bool block_transfer(block_device_t *dev, uint64_t lba, uint32_t count, void *buffer, bool write)
+{
+    uint8_t *pos = buffer;
+    while (count > 0)
+    {
+        uint32_t chunk = count < dev->max_sectors ? count : dev->max_sectors;
+        block_wait_t wait = { .done = false, .ok = false, .task = current_task() };
+        block_io_t io = {
+            .lba = lba,
+            .count = chunk,
+            .write = write,
+            .buffer = pos,
+            .done = block_wait_done,
+            .ctx = &wait,
+        };
+        if (!block_submit(dev, &io))
+        {
+            return false;
+        }
+
+        // Before the scheduler runs there is nothing to switch to
+        if (wait.task != NULL)
+        {
+            sched_wait(&wait.done);
+        }
+        while (!__atomic_load_n(&wait.done, __ATOMIC_ACQUIRE))
+        {
+            asm volatile("pause");
+        }
+        if (!wait.ok)
+        {
+            return false;
+        }
+
+        lba += chunk;
+        count -= chunk;
+        pos += chunk * BLOCK_SECTOR_SIZE;
+    }
+    return true;
+}
+
+bool block_read(block_device_t *dev, uint64_t lba, uint32_t count, void *buffer)
+{
+    return block_transfer(dev, lba, count, buffer, false);
+}
+
+bool block_write(block_device_t *dev, uint64_t lba, uint32_t count, const void *buffer)
+{
+    return block_transfer(dev, lba, count, (void*) buffer, true);
+}
@@ -0,0 +1,192 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu/ports.h>
+#include <drivers/pci/pci.h>
+#include <libk/io.h>
+#include <sync/spinlock.h>
+
+static pci_device_t pci_devices[PCI_MAX_DEVICES];
+static unsigned pci_device_count;
+
+// An address/data pair is two port accesses, nothing may slip between them
+static spinlock_t pci_lock = SPINLOCK_INIT("pci");
+
+static inline uint32_t pci_address(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset)
+{
+    return (1u << 31) | ((uint32_t) bus << 16) | ((uint32_t) slot << 11)
+        | ((uint32_t) function << 8) | (offset & 0xFC);
+}
+
+static uint32_t pci_config_read(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset)
+{
+    uint32_t flags = spin_lock_irqsave(&pci_lock);
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, function, offset));
+    uint32_t val = inl(PCI_CONFIG_DATA);
+    spin_unlock_irqrestore(&pci_lock, flags);
+    return val;
+}
+
+static void pci_config_write(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset, uint32_t val)
+{
+    uint32_t flags = spin_lock_irqsave(&pci_lock);
+    outl(PCI_CONFIG_ADDRESS, pci_address(bus, slot, function, offset));
+    outl(PCI_CONFIG_DATA, val);
+    spin_unlock_irqrestore(&pci_lock, flags);
+}
+
+uint32_t pci_read32(const pci_device_t *dev, uint8_t offset)
+{
+    return pci_config_read(dev->bus, dev->slot, dev->function, offset);
+}
+
+uint16_t pci_read16(const pci_device_t *dev, uint8_t offset)
+{
+    return pci_read32(dev, offset) >> ((offset & 2) * 8);
+}
+
+uint8_t pci_read8(const pci_device_t *dev, uint8_t offset)
+{
+    return pci_read32(dev, offset) >> ((offset & 3) * 8);
+}
+
+void pci_write32(const pci_device_t *dev, uint8_t offset, uint32_t val)
+{
+    pci_config_write(dev->bus, dev->slot, dev->function, offset, val);
+}
+
+// Status shares a dword with command and clears bits written as one, so
+// a write to the low half puts zeroes in the high half rather than
+// writing back what was read
+void pci_write16(const pci_device_t *dev, uint8_t offset, uint16_t val)
+{
+    uint32_t shift = (offset & 2) * 8;
+    uint32_t old = offset & 2 ? pci_read32(dev, offset) & 0x0000FFFF : 0;
+    pci_write32(dev, offset, old | ((uint32_t) val << shift));
+}
+
+static void pci_probe_function(uint8_t bus, uint8_t slot, uint8_t function)
+{
+    uint32_t id = pci_config_read(bus, slot, function, PCI_VENDOR_ID);
+    if ((id & 0xFFFF) == 0xFFFF)
+    {
+        return;
+    }
+    if (pci_device_count == PCI_MAX_DEVICES)
+    {
+        kprintf("pci: more than %d devices, ignoring %d:%d.%d\n", PCI_MAX_DEVICES, bus, slot, function);
+        return;
+    }
+
+    uint32_t class = pci_config_read(bus, slot, function, PCI_REVISION);
+    uint32_t irq = pci_config_read(bus, slot, function, PCI_INTERRUPT_LINE);
+    pci_devices[pci_device_count++] = (pci_device_t) {
+        .bus = bus,
+        .slot = slot,
+        .function = function,
+        .class = class >> 24,
+        .subclass = class >> 16,
+        .prog_if = class >> 8,
+        .irq = irq,
+        .vendor = id,
+        .device = id >> 16,
+    };
+}
+
+void pci_init(void)
+{
+    // Brute force every bus rather than following bridges, slow only at boot
+    for (unsigned bus = 0; bus < 256; ++bus)
+    {
+        for (uint8_t slot = 0; slot < 32; ++slot)
+        {
+            uint32_t id = pci_config_read(bus, slot, 0, PCI_VENDOR_ID);
+            if ((id & 0xFFFF) == 0xFFFF)
+            {
+                continue;
+            }
+            uint8_t header = pci_config_read(bus, slot, 0, PCI_HEADER_TYPE & 0xFC) >> 16;
+            uint8_t functions = header & PCI_HEADER_MULTIFUNCTION ? 8 : 1;
+            for (uint8_t function = 0; function < functions; ++function)
+            {
+                pci_probe_function(bus, slot, function);
+            }
+        }
+    }
+    kprintf("pci: %d devices\n", pci_device_count);
+}
+
+const pci_device_t *pci_find_class(uint8_t class, uint8_t subclass, uint8_t prog_if, unsigned *index)
+{
+    for (unsigned i = *index; i < pci_device_count; ++i)
+    {
+        const pci_device_t *dev = &pci_devices[i];
+        if ((class == PCI_ANY || dev->class == class)
+            && (subclass == PCI_ANY || dev->subclass == subclass)
+            && (prog_if == PCI_ANY || dev->prog_if == prog_if))
+        {
+            *index = i + 1;
+            return dev;
+        }
+    }
+    *index = pci_device_count;
+    return NULL;
+}
+
+void pci_enable(const pci_device_t *dev, uint16_t command)
+{
+    pci_write16(dev, PCI_COMMAND, pci_read16(dev, PCI_COMMAND) | command);
+}
+
+uint32_t pci_bar(const pci_device_t *dev, unsigned bar)
+{
+    uint32_t val = pci_read32(dev, PCI_BAR0 + bar * 4);
+    return val & PCI_BAR_IO ? val & ~0x3u : val & ~0xFu;
+}
+
+uint8_t pci_find_capability(const pci_device_t *dev, uint8_t id)
+{
+    if (!(pci_read16(dev, PCI_STATUS) & PCI_STATUS_CAPABILITIES))
+    {
+        return 0;
+    }
+    // Bounded in case a broken list loops
+    uint8_t offset = pci_read8(dev, PCI_CAPABILITIES) & 0xFC;
+    for (unsigned i = 0; i < 48 && offset != 0; ++i)
+    {
+        uint16_t header = pci_read16(dev, offset);
+        if ((header & 0xFF) == id)
+        {
+            return offset;
+        }
+        offset = (header >> 8) & 0xFC;
+    }
+    return 0;
+}
+
+bool pci_enable_msi(const pci_device_t *dev, uint32_t address, uint16_t data)
+{
+    uint8_t cap = pci_find_capability(dev, PCI_CAP_MSI);
+    if (cap == 0)
+    {
+        return false;
+    }
+
+    uint16_t control = pci_read16(dev, cap + PCI_MSI_CONTROL);
+    pci_write32(dev, cap + PCI_MSI_ADDRESS, address);
+    if (control & PCI_MSI_CONTROL_64BIT)
+    {
+        pci_write32(dev, cap + PCI_MSI_ADDRESS + 4, 0);
+        pci_write16(dev, cap + PCI_MSI_ADDRESS + 8, data);
+    }
+    else
+    {
+        pci_write16(dev, cap + PCI_MSI_ADDRESS + 4, data);
+    }
+    // A single message, the multiple message enable field stays at zero
+    control &= ~(7 << 4);
+    pci_write16(dev, cap + PCI_MSI_CONTROL, control | PCI_MSI_CONTROL_ENABLE);
+    pci_enable(dev, PCI_COMMAND_INTX_DISABLE);
+    return true;
+}
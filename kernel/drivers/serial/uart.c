@@ -0,0 +1,192 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/irq.h>
+#include <cpu/ports.h>
+#include <drivers/serial/uart.h>
+#include <libk/console.h>
+#include <libk/io.h>
+
+static void uart_console_write(console_t *console, const char *str, size_t len);
+static void uart_console_flush(console_t *console);
+
+static uart_t com1 =
+{
+    .port = UART_COM1_PORT,
+    .irq = UART_COM1_IRQ,
+    .lock = SPINLOCK_INIT("com1"),
+    .console =
+    {
+        .name = "com1",
+        .write = uart_console_write,
+        .flush = uart_console_flush,
+        .ctx = &com1,
+    },
+};
+
+static inline uint32_t uart_pending(uart_t *uart)
+{
+    return uart->head - uart->tail;
+}
+
+// Caller has seen THRE, so the whole FIFO is free
+static void uart_fill_fifo(uart_t *uart)
+{
+    for (int i = 0; i < UART_FIFO_SIZE && uart_pending(uart) != 0; ++i)
+    {
+        outb(uart->port + UART_THR, uart->ring[uart->tail++ % UART_TX_RING_SIZE]);
+    }
+}
+
+// Polls the line status once per FIFO load rather than once per byte. Only
+// used before the interrupt is set up or when a writer outruns the line.
+static void uart_drain_fifo_polled(uart_t *uart)
+{
+    while (!(inb(uart->port + UART_LSR) & UART_LSR_THRE))
+    {
+        asm volatile("pause");
+    }
+    uart_fill_fifo(uart);
+}
+
+static void uart_start_tx(uart_t *uart)
+{
+    if (!uart->irq_driven)
+    {
+        while (uart_pending(uart) != 0)
+        {
+            uart_drain_fifo_polled(uart);
+        }
+        return;
+    }
+
+    if (!uart->tx_active && uart_pending(uart) != 0)
+    {
+        if (inb(uart->port + UART_LSR) & UART_LSR_THRE)
+        {
+            uart_fill_fifo(uart);
+        }
+        uart->tx_active = true;
+        outb(uart->port + UART_IER, UART_IER_THRE);
+    }
+}
+
+static void uart_put(uart_t *uart, char c)
+{
+    // A full ring means the line cannot keep up, block the writer on the
+    // FIFO instead of dropping output
+    if (uart_pending(uart) == UART_TX_RING_SIZE)
+    {
+        uart_drain_fifo_polled(uart);
+    }
+    uart->ring[uart->head++ % UART_TX_RING_SIZE] = c;
+}
+
+static void uart_console_write(console_t *console, const char *str, size_t len)
+{
+    uart_t *uart = console->ctx;
+    uint32_t flags = spin_lock_irqsave(&uart->lock);
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (str[i] == '\n')
+        {
+            uart_put(uart, '\r');
+        }
+        uart_put(uart, str[i]);
+    }
+    uart_start_tx(uart);
+    spin_unlock_irqrestore(&uart->lock, flags);
+}
+
+static void uart_console_flush(console_t *console)
+{
+    uart_t *uart = console->ctx;
+    uint32_t flags = spin_lock_irqsave(&uart->lock);
+    while (uart_pending(uart) != 0)
+    {
+        uart_drain_fifo_polled(uart);
+    }
+    while (!(inb(uart->port + UART_LSR) & UART_LSR_TEMT))
+    {
+        asm volatile("pause");
+    }
+    spin_unlock_irqrestore(&uart->lock, flags);
+}
+
+static void uart_interrupt(interrupt_registers_t *regs, void *ctx)
+{
+    (void) regs;
+    uart_t *uart = ctx;
+
+    spin_lock(&uart->lock);
+    uint8_t iir;
+    while (!((iir = inb(uart->port + UART_IIR)) & UART_IIR_NONE))
+    {
+        switch (iir & UART_IIR_ID_MASK)
+        {
+        case UART_IIR_THRE:
+            if (uart_pending(uart) == 0)
+            {
+                uart->tx_active = false;
+                outb(uart->port + UART_IER, 0);
+            }
+            else
+            {
+                uart_fill_fifo(uart);
+            }
+            break;
+        case UART_IIR_RX:
+        case UART_IIR_TIMEOUT:
+            inb(uart->port + UART_RBR);
+            break;
+        case UART_IIR_LINE:
+            inb(uart->port + UART_LSR);
+            break;
+        default:
+            inb(uart->port + UART_MSR);
+            break;
+        }
+    }
+    spin_unlock(&uart->lock);
+}
+
+bool uart_init(uart_t *uart)
+{
+    uint16_t port = uart->port;
+    outb(port + UART_IER, 0);
+
+    uint16_t divisor = UART_CLOCK / UART_BAUD;
+    outb(port + UART_LCR, UART_LCR_DLAB);
+    outb(port + UART_DLL, divisor & 0xFF);
+    outb(port + UART_DLM, divisor >> 8);
+    outb(port + UART_LCR, UART_LCR_8N1);
+    outb(port + UART_FCR, UART_FCR_ENABLE | UART_FCR_CLEAR_RX | UART_FCR_CLEAR_TX | UART_FCR_TRIGGER_14);
+
+    // Nothing answers on a missing port, so a byte sent in loopback mode
+    // has to come back
+    outb(port + UART_MCR, UART_MCR_LOOPBACK | UART_MCR_OUT1 | UART_MCR_OUT2 | UART_MCR_RTS);
+    outb(port + UART_THR, 0xAE);
+    for (int i = 0; i < 1000 && !(inb(port + UART_LSR) & UART_LSR_DATA_READY); ++i)
+    {
+        io_wait();
+    }
+    if (inb(port + UART_RBR) != 0xAE)
+    {
+        return false;
+    }
+    outb(port + UART_MCR, UART_MCR_DTR | UART_MCR_RTS | UART_MCR_OUT2);
+
+    uart->present = true;
+    uart->irq_driven = irq_register(uart->irq, uart_interrupt, uart);
+    return true;
+}
+
+void serial_init(void)
+{
+    if (!uart_init(&com1))
+    {
+        return;
+    }
+    console_register(&com1.console);
+    kprintf("serial: com1 at %x, %s transmit\n", com1.port, com1.irq_driven ? "interrupt driven" : "polled");
+}
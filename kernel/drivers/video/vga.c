@@ -1,46 +1,176 @@
+#include <stdbool.h>
 #include <stdint.h>
 
+#include <cpu/ports.h>
+#include <libk/console.h>
 #include <libk/string.h>
+#include <sync/ticketlock.h>
 #include <drivers/video/vga.h>
 #include <tty/tty.h>
 
+#define TTY_ALL_DIRTY ((1u << VGA_HEIGHT) - 1)
+
 static size_t tty_row;
 static size_t tty_col;
 static uint8_t tty_color;
 static uint16_t *tty_buffer;
 
+// Rows are drawn into RAM first and copied out to the uncached VGA memory
+// on flush. The shadow is a ring, tty_top is the shadow row at the top of
+// the screen and tty_origin the VGA memory row the CRTC starts scanning at.
+static uint16_t tty_shadow[VGA_HEIGHT][VGA_WIDTH];
+static uint32_t tty_dirty;
+static size_t tty_top;
+static size_t tty_origin;
+static bool tty_origin_dirty;
+
+// Taken from interrupt context too when a handler's kprintf drains the log
+static ticketlock_t tty_lock = TICKETLOCK_INIT("tty");
+
+static inline size_t tty_shadow_row(size_t row)
+{
+    return (tty_top + row) % VGA_HEIGHT;
+}
+
 static void vga_printchar(char c, size_t row, size_t col, color_t color)
 {
-    size_t index = row * VGA_WIDTH + col;
-    tty_buffer[index] = vga_entry(c, color);
+    size_t shadow_row = tty_shadow_row(row);
+    tty_shadow[shadow_row][col] = vga_entry(c, color);
+    tty_dirty |= 1u << shadow_row;
+}
+
+static void vga_clear_row(size_t shadow_row)
+{
+    uint16_t blank = vga_entry('\0', tty_color);
+    for (size_t i = 0; i < VGA_WIDTH; ++i)
+    {
+        tty_shadow[shadow_row][i] = blank;
+    }
+    tty_dirty |= 1u << shadow_row;
+}
+
+static void vga_crtc_write(uint8_t reg, uint8_t val)
+{
+    outb(VGA_CRTC_INDEX, reg);
+    outb(VGA_CRTC_DATA, val);
+}
+
+static void tty_scroll(void)
+{
+    // The old top row is recycled as the new bottom row
+    vga_clear_row(tty_top);
+    tty_top = (tty_top + 1) % VGA_HEIGHT;
+
+    // Let the CRTC scroll by moving its start address down one row. Only
+    // once the end of VGA memory is reached does the screen get redrawn
+    // from the top of the window.
+    if (tty_origin + VGA_HEIGHT < VGA_MEMORY_ROWS)
+    {
+        ++tty_origin;
+    }
+    else
+    {
+        tty_origin = 0;
+        tty_dirty = TTY_ALL_DIRTY;
+    }
+    tty_origin_dirty = true;
+}
+
+static void tty_newline(void)
+{
+    tty_col = 0;
+    if (++tty_row >= VGA_HEIGHT)
+    {
+        tty_scroll();
+        tty_row = VGA_HEIGHT - 1;
+    }
+}
+
+static void tty_flush_locked(void)
+{
+    // Copy out runs of consecutive dirty rows with one memcpy each
+    size_t row = 0;
+    while (tty_dirty != 0 && row < VGA_HEIGHT)
+    {
+        if (!(tty_dirty & (1u << tty_shadow_row(row))))
+        {
+            ++row;
+            continue;
+        }
+
+        size_t first = tty_shadow_row(row);
+        size_t count = 0;
+        while (row + count < VGA_HEIGHT
+            && first + count < VGA_HEIGHT
+            && (tty_dirty & (1u << (first + count))))
+        {
+            tty_dirty &= ~(1u << (first + count));
+            ++count;
+        }
+
+        memcpy(&tty_buffer[(tty_origin + row) * VGA_WIDTH], tty_shadow[first], count * VGA_WIDTH * sizeof(uint16_t));
+        row += count;
+    }
+
+    if (tty_origin_dirty)
+    {
+        uint16_t start = tty_origin * VGA_WIDTH;
+        vga_crtc_write(VGA_CRTC_START_HIGH, start >> 8);
+        vga_crtc_write(VGA_CRTC_START_LOW, start & 0xFF);
+        tty_origin_dirty = false;
+    }
+
+    uint16_t cursor = (tty_origin + tty_row) * VGA_WIDTH + tty_col;
+    vga_crtc_write(VGA_CRTC_CURSOR_HIGH, cursor >> 8);
+    vga_crtc_write(VGA_CRTC_CURSOR_LOW, cursor & 0xFF);
 }
 
+void tty_flush(void)
+{
+    uint32_t flags = ticket_lock_irqsave(&tty_lock);
+    tty_flush_locked();
+    ticket_unlock_irqrestore(&tty_lock, flags);
+}
+
+static void vga_console_write(console_t *console, const char *str, size_t len)
+{
+    (void) console;
+    tty_write(str, len);
+}
+
+static console_t vga_console =
+{
+    .name = "vga",
+    .write = vga_console_write,
+};
+
 void tty_init(void)
 {
     tty_row = 0;
     tty_col = 0;
     tty_color = vga_entry_color(DEFAULT_COLOR, BLACK);
     tty_buffer = VGA_BUFFER;
+    tty_top = 0;
+    tty_origin = 0;
 
     for (size_t i = 0; i < VGA_HEIGHT; ++i)
     {
-        for (size_t j = 0; j < VGA_WIDTH; ++j)
-        {
-            size_t index = i * VGA_WIDTH + j;
-            tty_buffer[index] = vga_entry('\0', tty_color);
-        }
+        vga_clear_row(i);
     }
+    tty_origin_dirty = true;
+    tty_flush();
+    console_register(&vga_console);
 }
 
 void tty_write(const char *data, size_t len)
 {
+    uint32_t flags = ticket_lock_irqsave(&tty_lock);
     for (size_t i = 0; i < len; ++i)
     {
         // TODO: Better handling of special chars
         if (data[i] == '\n')
         {
-            tty_col = 0;
-            ++tty_row;
+            tty_newline();
         }
         else
         {
@@ -48,15 +178,12 @@ void tty_write(const char *data, size_t len)
             tty_col++;
             if (tty_col >= VGA_WIDTH)
             {
-                tty_col = 0;
-                tty_row++;
-                if (tty_row >= VGA_HEIGHT)
-                {
-                    tty_row = 0;
-                }
+                tty_newline();
             }
         }
     }
+    tty_flush_locked();
+    ticket_unlock_irqrestore(&tty_lock, flags);
 }
 
 void tty_writestring(const char *str)
@@ -78,4 +205,4 @@ void tty_colortest(void)
     }
     tty_setcolor(DEFAULT_COLOR);
     tty_writestring("\n");
-}
\ No newline at end of file
+}
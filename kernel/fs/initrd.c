@@ -0,0 +1,336 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <boot/cmdline.h>
+#include <boot/multiboot.h>
+#include <fs/initrd.h>
+#include <libk/hash.h>
+#include <libk/io.h>
+#include <libk/string.h>
+#include <mm/kmalloc.h>
+#include <mm/pmm.h>
+
+#define USTAR_BLOCK_SIZE 512
+#define USTAR_NAME_MAX (155 + 1 + 100)
+
+#define USTAR_TYPE_FILE '0'
+#define USTAR_TYPE_FILE_OLD '\0'
+#define USTAR_TYPE_DIR '5'
+
+typedef struct ustar_header_t
+{
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char type;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} __attribute__((packed)) ustar_header_t;
+
+static initrd_file_t *initrd_files;
+static size_t initrd_files_count;
+
+// Open addressing table of indices into initrd_files plus one, zero marks
+// an empty slot. Sized to at least twice the entry count so probes stay short.
+static uint32_t *initrd_index;
+static uint32_t initrd_index_mask;
+
+static size_t ustar_field_len(const char *field, size_t max)
+{
+    size_t len = 0;
+    while (len < max && field[len] != '\0')
+    {
+        ++len;
+    }
+    return len;
+}
+
+static uint32_t ustar_octal(const char *field, size_t max)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < max && field[i] >= '0' && field[i] <= '7'; ++i)
+    {
+        value = (value << 3) | (uint32_t)(field[i] - '0');
+    }
+    return value;
+}
+
+static bool ustar_checksum_ok(const ustar_header_t *hdr)
+{
+    const uint8_t *bytes = (const uint8_t*)hdr;
+    uint32_t sum = 0;
+    for (size_t i = 0; i < sizeof(*hdr); ++i)
+    {
+        bool in_checksum = i >= offsetof(ustar_header_t, checksum) &&
+                           i < offsetof(ustar_header_t, checksum) + sizeof(hdr->checksum);
+        sum += in_checksum ? ' ' : bytes[i];
+    }
+    return sum == ustar_octal(hdr->checksum, sizeof(hdr->checksum));
+}
+
+static bool ustar_is_end(const uint8_t *block)
+{
+    const uint32_t *words = (const uint32_t*)block;
+    for (size_t i = 0; i < USTAR_BLOCK_SIZE / sizeof(uint32_t); ++i)
+    {
+        if (words[i] != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Joins prefix and name and strips the "./" and "/" decorations tar adds,
+// so "./etc/motd" and "/etc/" come out as "etc/motd" and "etc"
+static size_t ustar_path(const ustar_header_t *hdr, char *out)
+{
+    size_t len = 0;
+    size_t prefix_len = ustar_field_len(hdr->prefix, sizeof(hdr->prefix));
+    if (prefix_len != 0)
+    {
+        memcpy(out, hdr->prefix, prefix_len);
+        len = prefix_len;
+        out[len++] = '/';
+    }
+    size_t name_len = ustar_field_len(hdr->name, sizeof(hdr->name));
+    memcpy(out + len, hdr->name, name_len);
+    len += name_len;
+
+    size_t start = 0;
+    while (start < len && (out[start] == '/' || (out[start] == '.' && start + 1 < len && out[start + 1] == '/')))
+    {
+        start += out[start] == '/' ? 1 : 2;
+    }
+    if (len - start == 1 && out[start] == '.')
+    {
+        start = len;
+    }
+    while (len > start && out[len - 1] == '/')
+    {
+        --len;
+    }
+    memmove(out, out + start, len - start);
+    return len - start;
+}
+
+// Walks the archive once. Without a files array it only counts entries and
+// the name bytes they need, with one it fills both in.
+static size_t initrd_scan(const uint8_t *base, size_t size, initrd_file_t *files, char *names, size_t *names_size)
+{
+    size_t count = 0;
+    size_t names_used = 0;
+    size_t offset = 0;
+    char path[USTAR_NAME_MAX];
+
+    while (offset + USTAR_BLOCK_SIZE <= size)
+    {
+        const ustar_header_t *hdr = (const ustar_header_t*)(base + offset);
+        if (ustar_is_end(base + offset))
+        {
+            break;
+        }
+        if (memcmp(hdr->magic, "ustar", 5) != 0 || !ustar_checksum_ok(hdr))
+        {
+            if (files == NULL)
+            {
+                kprintf("initrd: bad header at offset %u, ignoring the rest\n", offset);
+            }
+            break;
+        }
+
+        size_t file_size = ustar_octal(hdr->size, sizeof(hdr->size));
+        size_t data = offset + USTAR_BLOCK_SIZE;
+        if (file_size > size - data)
+        {
+            if (files == NULL)
+            {
+                kprintf("initrd: archive truncated at offset %u\n", offset);
+            }
+            break;
+        }
+        offset = data + ((file_size + USTAR_BLOCK_SIZE - 1) & ~(size_t)(USTAR_BLOCK_SIZE - 1));
+
+        // Links, devices and fifos have nothing to serve
+        bool is_file = hdr->type == USTAR_TYPE_FILE || hdr->type == USTAR_TYPE_FILE_OLD;
+        if (!is_file && hdr->type != USTAR_TYPE_DIR)
+        {
+            continue;
+        }
+        size_t path_len = ustar_path(hdr, path);
+        if (path_len == 0)
+        {
+            continue;
+        }
+
+        if (files != NULL)
+        {
+            char *name = names + names_used;
+            memcpy(name, path, path_len);
+            name[path_len] = '\0';
+            files[count] = (initrd_file_t){
+                .name = name,
+                .name_len = path_len,
+                .hash = fnv1a(path, path_len),
+                .type = is_file ? INITRD_FILE : INITRD_DIR,
+                .data = base + data,
+                .size = is_file ? file_size : 0,
+            };
+        }
+        names_used += path_len + 1;
+        ++count;
+    }
+
+    if (names_size != NULL)
+    {
+        *names_size = names_used;
+    }
+    return count;
+}
+
+static bool initrd_build_index(void)
+{
+    uint32_t slots = 16;
+    while (slots < initrd_files_count * 2)
+    {
+        slots <<= 1;
+    }
+    initrd_index = kmalloc(slots * sizeof(uint32_t), KMALLOC_ZERO);
+    if (initrd_index == NULL)
+    {
+        return false;
+    }
+    initrd_index_mask = slots - 1;
+
+    for (size_t i = 0; i < initrd_files_count; ++i)
+    {
+        const initrd_file_t *file = &initrd_files[i];
+        uint32_t slot = file->hash & initrd_index_mask;
+        // A path that appears twice in an archive resolves to the later
+        // entry, the same as extracting it would
+        while (initrd_index[slot] != 0)
+        {
+            const initrd_file_t *other = &initrd_files[initrd_index[slot] - 1];
+            if (other->hash == file->hash && other->name_len == file->name_len &&
+                memcmp(other->name, file->name, file->name_len) == 0)
+            {
+                break;
+            }
+            slot = (slot + 1) & initrd_index_mask;
+        }
+        initrd_index[slot] = i + 1;
+    }
+    return true;
+}
+
+static multiboot_module_t *initrd_find_module(multiboot_info_t *mbi)
+{
+    if (!(mbi->flags & MULTIBOOT_INFO_MODS) || mbi->mods_count == 0)
+    {
+        return NULL;
+    }
+    multiboot_module_t *mods = phys_to_virt(mbi->mods_addr);
+    for (uint32_t i = 0; i < mbi->mods_count; ++i)
+    {
+        if (mods[i].cmdline != 0 && cmdline_has_word(phys_to_virt(mods[i].cmdline), INITRD_MODULE_NAME))
+        {
+            return &mods[i];
+        }
+    }
+    return &mods[0];
+}
+
+bool initrd_init(multiboot_info_t *mbi)
+{
+    multiboot_module_t *mod = initrd_find_module(mbi);
+    if (mod == NULL)
+    {
+        kprintf("initrd: no module loaded\n");
+        return false;
+    }
+    // The archive is read where GRUB put it, which has to be direct mapped
+    if (mod->mod_end <= mod->mod_start || mod->mod_end > DIRECT_MAP_SIZE)
+    {
+        kprintf("initrd: module at 0x%x-0x%x is not usable\n", mod->mod_start, mod->mod_end);
+        return false;
+    }
+
+    const uint8_t *base = phys_to_virt(mod->mod_start);
+    size_t size = mod->mod_end - mod->mod_start;
+    size_t names_size;
+    size_t count = initrd_scan(base, size, NULL, NULL, &names_size);
+    if (count == 0)
+    {
+        kprintf("initrd: archive is empty\n");
+        return false;
+    }
+
+    initrd_file_t *files = kmalloc(count * sizeof(initrd_file_t), 0);
+    char *names = kmalloc(names_size, 0);
+    if (files == NULL || names == NULL)
+    {
+        kprintf("initrd: out of memory for %u entries\n", count);
+        kfree(files);
+        kfree(names);
+        return false;
+    }
+    initrd_scan(base, size, files, names, NULL);
+    initrd_files = files;
+    initrd_files_count = count;
+
+    if (!initrd_build_index())
+    {
+        kprintf("initrd: out of memory for the index\n");
+        initrd_files_count = 0;
+        return false;
+    }
+
+    kprintf("initrd: %u entries, %u KiB at 0x%x\n", count, size / 1024, mod->mod_start);
+    return true;
+}
+
+const initrd_file_t *initrd_lookup(const char *path)
+{
+    if (initrd_index == NULL)
+    {
+        return NULL;
+    }
+    while (*path == '/')
+    {
+        ++path;
+    }
+
+    size_t len = strlen(path);
+    uint32_t hash = fnv1a(path, len);
+    for (uint32_t slot = hash & initrd_index_mask; initrd_index[slot] != 0; slot = (slot + 1) & initrd_index_mask)
+    {
+        const initrd_file_t *file = &initrd_files[initrd_index[slot] - 1];
+        if (file->hash == hash && file->name_len == len && memcmp(file->name, path, len) == 0)
+        {
+            return file;
+        }
+    }
+    return NULL;
+}
+
+size_t initrd_count(void)
+{
+    return initrd_files_count;
+}
+
+const initrd_file_t *initrd_entry(size_t index)
+{
+    return index < initrd_files_count ? &initrd_files[index] : NULL;
+}
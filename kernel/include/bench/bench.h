@@ -0,0 +1,36 @@
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BENCH_WARMUP 32
+#define BENCH_SAMPLES 1024
+
+// QEMU's isa-debug-exit device, the exit status becomes (code << 1) | 1
+#define QEMU_DEBUG_EXIT_PORT 0xF4
+
+typedef struct bench_case_t
+{
+    const char *name;
+    // Optional, runs once before the case is timed
+    void (*setup)(uintptr_t arg);
+    void (*fn)(uintptr_t arg);
+    uintptr_t arg;
+    // CPU_FEATURE_BIT mask the case needs, it is skipped otherwise
+    uint32_t requires;
+} bench_case_t;
+
+// Cases are collected by the linker between bench_cases_start and
+// bench_cases_end, so registering one needs no central list
+#define BENCH_CASE(id, label, setup_fn, func, argument, features) \
+    static const bench_case_t bench_case_##id \
+    __attribute__((used, section(".bench_cases"), aligned(sizeof(void*)))) = \
+    { label, setup_fn, func, argument, features }
+
+#define BENCH(func) BENCH_CASE(func, #func, NULL, func, 0, 0)
+
+// Times every registered case, prints the results and powers off QEMU
+__attribute__((noreturn)) void bench_run(void);
+
+#endif
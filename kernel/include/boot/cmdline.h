@@ -0,0 +1,15 @@
+#ifndef BOOT_CMDLINE_H
+#define BOOT_CMDLINE_H
+
+#include <stdbool.h>
+
+#include <boot/multiboot.h>
+
+// Keeps the kernel command line the loader passed, if any
+void cmdline_init(multiboot_info_t *mbi);
+// Whether word appears on the kernel command line as a whole word
+bool cmdline_has(const char *word);
+// The same test against any space separated line, such as a module's
+bool cmdline_has_word(const char *line, const char *word);
+
+#endif
@@ -1,6 +1,16 @@
 #ifndef KERNEL_CPU_H
 #define KERNEL_CPU_H
 
+#include <stdbool.h>
+
+#define MAX_CPUS 32
+
+void arch_early_init(void);
 void arch_init(void);
+bool in_interrupt(void);
+
+void smp_init(void);
+unsigned cpu_count(void);
+void smp_send_reschedule(unsigned cpu);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,36 @@
+#ifndef DEBUG_BOOTTIME_H
+#define DEBUG_BOOTTIME_H
+
+#include <stdint.h>
+
+#include <cpu/tsc.h>
+
+#define BOOT_STAGES_MAX 32
+
+// A stage runs from its own stamp to the next one
+typedef struct boot_stage_t
+{
+    const char *name;
+    uint64_t tsc;
+} boot_stage_t;
+
+// Filled in by the boot CPU only, and kept after boot so the timeline of
+// the running kernel can be read back
+extern boot_stage_t boot_stages[BOOT_STAGES_MAX];
+extern uint32_t boot_stage_count;
+
+// Marks the start of an init phase, costs one rdtsc and a store
+#define BOOT_STAGE(stage_name) do { \
+    if (boot_stage_count < BOOT_STAGES_MAX) \
+    { \
+        boot_stages[boot_stage_count].name = (stage_name); \
+        boot_stages[boot_stage_count].tsc = rdtsc(); \
+        ++boot_stage_count; \
+    } \
+} while (0)
+
+// Closes the last stage and prints how long each took, in microseconds
+// once the TSC is calibrated and in cycles before
+void boot_timeline_print(void);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef DEBUG_KSYMS_H
+#define DEBUG_KSYMS_H
+
+#include <stdint.h>
+
+typedef struct ksym_t
+{
+    uintptr_t addr;
+    // Offset of the name in ksyms_names
+    uint32_t name;
+} ksym_t;
+
+// Generated by scripts/ksyms.sh from the first link pass and linked into
+// the second. Weak so the first pass links without them.
+extern const ksym_t ksyms_table[] __attribute__((weak));
+extern const uint32_t ksyms_count __attribute__((weak));
+extern const char ksyms_names[] __attribute__((weak));
+
+uint32_t ksym_total(void);
+// Index of the function containing addr, or -1 outside the kernel text
+int ksym_index(uintptr_t addr);
+const char *ksym_name(int index);
+uintptr_t ksym_addr(int index);
+// Name of the function containing addr and addr's offset into it
+const char *ksym_lookup(uintptr_t addr, uintptr_t *offset);
+
+#endif
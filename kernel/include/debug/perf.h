@@ -0,0 +1,47 @@
+#ifndef DEBUG_PERF_H
+#define DEBUG_PERF_H
+
+#include <stdint.h>
+
+#define PERF_MAX_EVENTS 8
+
+typedef enum perf_event_t
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_REF_CYCLES,
+    PERF_LLC_REFERENCES,
+    PERF_LLC_MISSES,
+    PERF_BRANCHES,
+    PERF_BRANCH_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_ITLB_MISSES,
+    PERF_EVENT_COUNT,
+} perf_event_t;
+
+// Counters are per CPU and count everything that runs on it, a region
+// should not block or it picks up whatever the CPU ran meanwhile
+typedef struct perf_scope_t
+{
+    uint64_t start[PERF_MAX_EVENTS];
+    unsigned cpu;
+} perf_scope_t;
+
+typedef struct perf_region_t
+{
+    const char *name;
+    uint64_t calls;
+    uint64_t totals[PERF_MAX_EVENTS];
+} perf_region_t;
+
+#define PERF_REGION_INIT(region_name) { .name = (region_name) }
+
+const char *perf_event_name(perf_event_t event);
+
+// Brackets a region, perf_end adds what the counters moved to region
+void perf_begin(perf_scope_t *scope);
+void perf_end(perf_region_t *region, perf_scope_t *scope);
+void perf_reset(perf_region_t *region);
+void perf_report(perf_region_t *region);
+
+#endif
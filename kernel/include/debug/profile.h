@@ -0,0 +1,30 @@
+#ifndef DEBUG_PROFILE_H
+#define DEBUG_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PROFILE_SAMPLES_PER_CPU 8192
+#define PROFILE_TOP_SYMBOLS 20
+
+typedef struct profile_buffer_t
+{
+    // Only the owning CPU's timer interrupt writes, count is published
+    // after the sample so readers never see a half written slot
+    uint32_t count;
+    uint32_t user;
+    uint32_t dropped;
+    uintptr_t *samples;
+} __attribute__((aligned(64))) profile_buffer_t;
+
+bool profile_start(void);
+void profile_stop(void);
+// Prints a flat per-function histogram of everything sampled so far
+void profile_dump(void);
+// Profiles for the given time from a task on this CPU, then dumps
+bool profile_run(uint32_t seconds);
+
+// Called from the timer interrupt with the interrupted pc
+void profile_sample(uintptr_t pc, bool user);
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef AHCI_DRIVER_H
+#define AHCI_DRIVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <drivers/block/block.h>
+#include <drivers/pci/pci.h>
+#include <sync/spinlock.h>
+
+#define AHCI_PROG_IF 0x01
+#define AHCI_ABAR 5
+#define AHCI_MAX_PORTS 32
+#define AHCI_MAX_SLOTS 32
+
+// Generic host control registers
+#define AHCI_CAP 0x00
+#define AHCI_GHC 0x04
+#define AHCI_IS 0x08
+#define AHCI_PI 0x0C
+
+#define AHCI_CAP_NCS_SHIFT 8
+#define AHCI_CAP_NCS_MASK 0x1F
+#define AHCI_CAP_SNCQ (1u << 30)
+
+#define AHCI_GHC_HR (1u << 0)
+#define AHCI_GHC_IE (1u << 1)
+#define AHCI_GHC_AE (1u << 31)
+
+// Port registers, port n starts at AHCI_PORT_BASE + n * AHCI_PORT_SIZE
+#define AHCI_PORT_BASE 0x100
+#define AHCI_PORT_SIZE 0x80
+#define AHCI_PX_CLB 0x00
+#define AHCI_PX_CLBU 0x04
+#define AHCI_PX_FB 0x08
+#define AHCI_PX_FBU 0x0C
+#define AHCI_PX_IS 0x10
+#define AHCI_PX_IE 0x14
+#define AHCI_PX_CMD 0x18
+#define AHCI_PX_TFD 0x20
+#define AHCI_PX_SIG 0x24
+#define AHCI_PX_SSTS 0x28
+#define AHCI_PX_SERR 0x30
+#define AHCI_PX_SACT 0x34
+#define AHCI_PX_CI 0x38
+
+#define AHCI_PX_CMD_ST (1u << 0)
+#define AHCI_PX_CMD_FRE (1u << 4)
+#define AHCI_PX_CMD_FR (1u << 14)
+#define AHCI_PX_CMD_CR (1u << 15)
+
+#define AHCI_PX_IS_DHRS (1u << 0)
+#define AHCI_PX_IS_PSS (1u << 1)
+#define AHCI_PX_IS_SDBS (1u << 3)
+#define AHCI_PX_IS_IFS (1u << 27)
+#define AHCI_PX_IS_HBDS (1u << 28)
+#define AHCI_PX_IS_HBFS (1u << 29)
+#define AHCI_PX_IS_TFES (1u << 30)
+#define AHCI_PX_IS_ERRORS (AHCI_PX_IS_IFS | AHCI_PX_IS_HBDS | AHCI_PX_IS_HBFS | AHCI_PX_IS_TFES)
+
+#define AHCI_SSTS_DET_MASK 0x0F
+#define AHCI_SSTS_DET_PRESENT 3
+#define AHCI_SIG_ATA 0x00000101
+
+#define AHCI_TFD_ERR (1 << 0)
+#define AHCI_TFD_DRQ (1 << 3)
+#define AHCI_TFD_BSY (1 << 7)
+
+#define FIS_TYPE_REG_H2D 0x27
+#define FIS_H2D_COMMAND (1 << 7)
+#define FIS_DEVICE_LBA (1 << 6)
+
+#define ATA_CMD_READ_FPDMA 0x60
+#define ATA_CMD_WRITE_FPDMA 0x61
+
+// Command header flags
+#define AHCI_CMD_FIS_DWORDS 5
+#define AHCI_CMD_WRITE (1 << 6)
+
+// A PRD covers up to 4 MiB, its byte count is stored minus one
+#define AHCI_PRD_MAX_BYTES 0x400000
+#define AHCI_PRDT_ENTRIES 24
+#define AHCI_MAX_SECTORS 2048
+
+typedef struct ahci_fis_h2d_t
+{
+    uint8_t type;
+    uint8_t flags;
+    uint8_t command;
+    uint8_t feature_low;
+    uint8_t lba0;
+    uint8_t lba1;
+    uint8_t lba2;
+    uint8_t device;
+    uint8_t lba3;
+    uint8_t lba4;
+    uint8_t lba5;
+    uint8_t feature_high;
+    uint8_t count_low;
+    uint8_t count_high;
+    uint8_t icc;
+    uint8_t control;
+    uint32_t reserved;
+} __attribute__((packed)) ahci_fis_h2d_t;
+
+typedef struct ahci_cmd_header_t
+{
+    uint16_t flags;
+    uint16_t prdt_length;
+    volatile uint32_t prd_bytes;
+    uint32_t table;
+    uint32_t table_high;
+    uint32_t reserved[4];
+} __attribute__((packed)) ahci_cmd_header_t;
+
+typedef struct ahci_prd_t
+{
+    uint32_t addr;
+    uint32_t addr_high;
+    uint32_t reserved;
+    uint32_t bytes;
+} __attribute__((packed)) ahci_prd_t;
+
+// 128 byte aligned, sized to a power of two so the tables pack into frames
+typedef struct ahci_cmd_table_t
+{
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    ahci_prd_t prdt[AHCI_PRDT_ENTRIES];
+} __attribute__((packed, aligned(128))) ahci_cmd_table_t;
+
+struct ahci_hba_t;
+
+typedef struct ahci_port_t
+{
+    block_device_t dev;
+    struct ahci_hba_t *hba;
+    volatile uint32_t *regs;
+    unsigned index;
+    bool ncq;
+
+    // Command list and received FIS area share a frame, the tables for
+    // all slots follow in a block of their own
+    ahci_cmd_header_t *cmd_list;
+    uint32_t cmd_list_phys;
+    ahci_cmd_table_t *tables;
+    uint32_t tables_phys;
+
+    spinlock_t lock;
+    uint32_t slot_mask;
+    uint32_t issued;
+    block_request_t *slots[AHCI_MAX_SLOTS];
+} ahci_port_t;
+
+typedef struct ahci_hba_t
+{
+    const pci_device_t *pci;
+    volatile uint32_t *regs;
+    uint32_t cap;
+    unsigned slots;
+    ahci_port_t *ports[AHCI_MAX_PORTS];
+} ahci_hba_t;
+
+void ahci_init(void);
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef ATA_DRIVER_H
+#define ATA_DRIVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <drivers/block/block.h>
+#include <sync/spinlock.h>
+
+#define ATA_PRIMARY_IO 0x1F0
+#define ATA_PRIMARY_CTRL 0x3F6
+#define ATA_PRIMARY_IRQ 14
+#define ATA_SECONDARY_IO 0x170
+#define ATA_SECONDARY_CTRL 0x376
+#define ATA_SECONDARY_IRQ 15
+
+// Register offsets from the I/O base
+#define ATA_DATA 0
+#define ATA_ERROR 1
+#define ATA_FEATURES 1
+#define ATA_COUNT 2
+#define ATA_LBA_LOW 3
+#define ATA_LBA_MID 4
+#define ATA_LBA_HIGH 5
+#define ATA_DRIVE 6
+#define ATA_STATUS 7
+#define ATA_COMMAND 7
+
+// The control block has the alternate status and device control register
+#define ATA_CTRL_NIEN (1 << 1)
+
+#define ATA_DRIVE_LBA 0x40
+#define ATA_DRIVE_SLAVE (1 << 4)
+#define ATA_DRIVE_OBSOLETE 0xA0
+
+#define ATA_STATUS_ERR (1 << 0)
+#define ATA_STATUS_DRQ (1 << 3)
+#define ATA_STATUS_DF (1 << 5)
+#define ATA_STATUS_DRDY (1 << 6)
+#define ATA_STATUS_BSY (1 << 7)
+
+#define ATA_CMD_READ_PIO 0x20
+#define ATA_CMD_READ_PIO_EXT 0x24
+#define ATA_CMD_READ_DMA_EXT 0x25
+#define ATA_CMD_WRITE_PIO 0x30
+#define ATA_CMD_WRITE_PIO_EXT 0x34
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_CMD_READ_DMA 0xC8
+#define ATA_CMD_WRITE_DMA 0xCA
+#define ATA_CMD_IDENTIFY 0xEC
+
+// IDENTIFY DEVICE words
+#define ATA_ID_CAPABILITIES 49
+#define ATA_ID_LBA28_SECTORS 60
+#define ATA_ID_QUEUE_DEPTH 75
+#define ATA_ID_SATA_CAPABILITIES 76
+#define ATA_ID_COMMAND_SETS 83
+#define ATA_ID_LBA48_SECTORS 100
+
+#define ATA_ID_CAP_DMA (1 << 8)
+#define ATA_ID_CAP_LBA (1 << 9)
+#define ATA_ID_SATA_NCQ (1 << 8)
+#define ATA_ID_CMD_LBA48 (1 << 10)
+
+// Bus master IDE registers, the secondary channel's sit 8 bytes higher
+#define BMIDE_COMMAND 0
+#define BMIDE_STATUS 2
+#define BMIDE_PRDT 4
+#define BMIDE_CHANNEL_STRIDE 8
+
+#define BMIDE_CMD_START (1 << 0)
+#define BMIDE_CMD_READ (1 << 3)
+#define BMIDE_STATUS_ACTIVE (1 << 0)
+#define BMIDE_STATUS_ERROR (1 << 1)
+#define BMIDE_STATUS_IRQ (1 << 2)
+
+// A PRD may not cross a 64 KiB boundary, a byte count of zero means 64 KiB
+#define ATA_PRD_EOT 0x8000
+#define ATA_PRD_BOUNDARY 0x10000
+#define ATA_PRDT_ENTRIES 512
+
+#define ATA_MAX_SECTORS 256
+#define ATA_MAX_SEGMENTS 32
+
+typedef struct ata_prd_t
+{
+    uint32_t addr;
+    uint16_t bytes;
+    uint16_t flags;
+} __attribute__((packed)) ata_prd_t;
+
+struct ata_channel_t;
+
+typedef struct ata_drive_t
+{
+    block_device_t dev;
+    struct ata_channel_t *channel;
+    bool present;
+    bool slave;
+    bool lba48;
+    bool dma;
+} ata_drive_t;
+
+// Both drives of a channel share its registers, only one command runs at a
+// time. Requests for the idle drive wait in the channel's own queue.
+typedef struct ata_channel_t
+{
+    uint16_t io;
+    uint16_t ctrl;
+    uint16_t bmide;
+    uint8_t irq;
+    spinlock_t lock;
+    ata_drive_t drives[2];
+
+    block_request_t *active;
+    ata_drive_t *active_drive;
+    bool active_dma;
+    block_request_t *waiting;
+    block_request_t *waiting_tail;
+
+    // PIO progress through the active request
+    block_io_t *pio_io;
+    uint32_t pio_offset;
+    uint32_t pio_left;
+
+    ata_prd_t *prdt;
+    uint32_t prdt_phys;
+} ata_channel_t;
+
+void ata_init(void);
+
+#endif
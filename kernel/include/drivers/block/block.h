@@ -0,0 +1,99 @@
+#ifndef BLOCK_DRIVER_H
+#define BLOCK_DRIVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sync/spinlock.h>
+
+#define BLOCK_SECTOR_SIZE 512
+#define BLOCK_NAME_LEN 8
+
+struct block_io_t;
+typedef void (*block_done_t)(struct block_io_t *io, bool ok);
+
+// One caller's transfer. The buffer has to be direct mapped kernel memory
+// (kmalloc or frames) so drivers can hand its physical address to DMA.
+// done runs in softirq context once the transfer finished and must not
+// sleep.
+typedef struct block_io_t
+{
+    uint64_t lba;
+    uint32_t count;
+    bool write;
+    void *buffer;
+    block_done_t done;
+    void *ctx;
+    struct block_io_t *next;
+} block_io_t;
+
+// What drivers see: a run of consecutive sectors built from one or more
+// ios merged by the queue. ios are in LBA order, their buffers need not
+// be contiguous.
+typedef struct block_request_t
+{
+    uint64_t lba;
+    uint32_t count;
+    bool write;
+    uint32_t segments;
+    block_io_t *ios;
+    block_io_t *ios_tail;
+    // Free for the driver while the request is in flight
+    uint32_t tag;
+    // Result, kept from block_complete until the softirq finishes it
+    bool ok;
+    struct block_request_t *next;
+} block_request_t;
+
+struct block_device_t;
+
+typedef struct block_ops_t
+{
+    // Called with the queue lock held and interrupts off. Starts the
+    // request on the hardware and returns, the driver reports the result
+    // through block_complete, usually from its interrupt handler.
+    bool (*start)(struct block_device_t *dev, block_request_t *req);
+} block_ops_t;
+
+typedef struct block_device_t
+{
+    char name[BLOCK_NAME_LEN];
+    uint64_t sectors;
+    // Limits for merged requests, and how many may be in flight at once
+    uint32_t max_sectors;
+    uint32_t max_segments;
+    uint32_t depth;
+    const block_ops_t *ops;
+    void *ctx;
+
+    // Requests waiting for the device sorted by LBA. They are dispatched
+    // in one sweep upwards from the last position, then back from the
+    // lowest one, so the head rarely seeks backwards.
+    spinlock_t lock;
+    block_request_t *pending;
+    uint32_t inflight;
+    uint64_t position;
+    uint64_t merges;
+    uint64_t completed;
+    struct block_device_t *next;
+} block_device_t;
+
+void block_init(void);
+void block_register(block_device_t *dev);
+block_device_t *block_find(const char *name);
+block_device_t *block_first(void);
+
+// Queues io, merging it into a pending request for adjacent sectors when
+// possible. Returns false if it can never be satisfied.
+bool block_submit(block_device_t *dev, block_io_t *io);
+// For drivers, finishes a request started through ops->start. Further
+// requests are dispatched right away, the ios' done callbacks run from
+// the block softirq once the driver's interrupt handler returned.
+void block_complete(block_device_t *dev, block_request_t *req, bool ok);
+
+// Synchronous wrappers, they sleep until the transfer is done
+bool block_read(block_device_t *dev, uint64_t lba, uint32_t count, void *buffer);
+bool block_write(block_device_t *dev, uint64_t lba, uint32_t count, const void *buffer);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef PCI_DRIVER_H
+#define PCI_DRIVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Configuration mechanism #1
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+
+#define PCI_MAX_DEVICES 64
+#define PCI_ANY 0xFF
+
+// Configuration space offsets
+#define PCI_VENDOR_ID 0x00
+#define PCI_DEVICE_ID 0x02
+#define PCI_COMMAND 0x04
+#define PCI_STATUS 0x06
+#define PCI_REVISION 0x08
+#define PCI_PROG_IF 0x09
+#define PCI_SUBCLASS 0x0A
+#define PCI_CLASS 0x0B
+#define PCI_HEADER_TYPE 0x0E
+#define PCI_BAR0 0x10
+#define PCI_CAPABILITIES 0x34
+#define PCI_INTERRUPT_LINE 0x3C
+
+#define PCI_COMMAND_IO (1 << 0)
+#define PCI_COMMAND_MEMORY (1 << 1)
+#define PCI_COMMAND_MASTER (1 << 2)
+#define PCI_COMMAND_INTX_DISABLE (1 << 10)
+
+#define PCI_STATUS_CAPABILITIES (1 << 4)
+#define PCI_HEADER_MULTIFUNCTION (1 << 7)
+
+#define PCI_BAR_IO (1 << 0)
+#define PCI_BAR_TYPE_64 (2 << 1)
+
+#define PCI_CAP_MSI 0x05
+#define PCI_MSI_CONTROL 2
+#define PCI_MSI_ADDRESS 4
+#define PCI_MSI_CONTROL_ENABLE (1 << 0)
+#define PCI_MSI_CONTROL_64BIT (1 << 7)
+
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_STORAGE_IDE 0x01
+#define PCI_STORAGE_SATA 0x06
+
+typedef struct pci_device_t
+{
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t function;
+    uint8_t class;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t irq;
+    uint16_t vendor;
+    uint16_t device;
+} pci_device_t;
+
+void pci_init(void);
+
+uint32_t pci_read32(const pci_device_t *dev, uint8_t offset);
+uint16_t pci_read16(const pci_device_t *dev, uint8_t offset);
+uint8_t pci_read8(const pci_device_t *dev, uint8_t offset);
+void pci_write32(const pci_device_t *dev, uint8_t offset, uint32_t val);
+void pci_write16(const pci_device_t *dev, uint8_t offset, uint16_t val);
+
+// Finds the next device of a class after *index, any field may be PCI_ANY
+const pci_device_t *pci_find_class(uint8_t class, uint8_t subclass, uint8_t prog_if, unsigned *index);
+
+void pci_enable(const pci_device_t *dev, uint16_t command);
+// Address of a BAR with the type bits masked off, zero if it is unset
+uint32_t pci_bar(const pci_device_t *dev, unsigned bar);
+// Offset of a capability in configuration space, zero if it is missing
+uint8_t pci_find_capability(const pci_device_t *dev, uint8_t id);
+// Points the device's MSI capability at address/data and turns off INTx
+bool pci_enable_msi(const pci_device_t *dev, uint32_t address, uint16_t data);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef UART_DRIVER_H
+#define UART_DRIVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libk/console.h>
+#include <sync/spinlock.h>
+
+#define UART_COM1_PORT 0x3F8
+#define UART_COM1_IRQ 4
+
+#define UART_CLOCK 115200
+#define UART_BAUD 115200
+#define UART_FIFO_SIZE 16
+// Must be a power of two
+#define UART_TX_RING_SIZE 4096
+
+// Register offsets from the base port, DLL/DLM overlay THR/IER while
+// LCR.DLAB is set
+#define UART_THR 0
+#define UART_RBR 0
+#define UART_DLL 0
+#define UART_IER 1
+#define UART_DLM 1
+#define UART_IIR 2
+#define UART_FCR 2
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+#define UART_MSR 6
+
+#define UART_IER_THRE (1 << 1)
+
+#define UART_IIR_NONE (1 << 0)
+#define UART_IIR_ID_MASK 0x0E
+#define UART_IIR_MODEM 0x00
+#define UART_IIR_THRE 0x02
+#define UART_IIR_RX 0x04
+#define UART_IIR_LINE 0x06
+#define UART_IIR_TIMEOUT 0x0C
+
+#define UART_FCR_ENABLE (1 << 0)
+#define UART_FCR_CLEAR_RX (1 << 1)
+#define UART_FCR_CLEAR_TX (1 << 2)
+#define UART_FCR_TRIGGER_14 (3 << 6)
+
+#define UART_LCR_8N1 0x03
+#define UART_LCR_DLAB (1 << 7)
+
+#define UART_MCR_DTR (1 << 0)
+#define UART_MCR_RTS (1 << 1)
+#define UART_MCR_OUT1 (1 << 2)
+// Gates the interrupt line on PC serial ports
+#define UART_MCR_OUT2 (1 << 3)
+#define UART_MCR_LOOPBACK (1 << 4)
+
+#define UART_LSR_DATA_READY (1 << 0)
+#define UART_LSR_THRE (1 << 5)
+// Both the FIFO and the shift register are empty
+#define UART_LSR_TEMT (1 << 6)
+
+typedef struct uart_t
+{
+    uint16_t port;
+    unsigned irq;
+    bool present;
+    bool irq_driven;
+    // The THRE interrupt is armed and will keep refilling the FIFO
+    bool tx_active;
+    spinlock_t lock;
+    uint32_t head;
+    uint32_t tail;
+    char ring[UART_TX_RING_SIZE];
+    console_t console;
+} uart_t;
+
+bool uart_init(uart_t *uart);
+// Brings up COM1 as a console once interrupts can be routed
+void serial_init(void);
+
+#endif
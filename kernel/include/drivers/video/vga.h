@@ -3,11 +3,21 @@
 
 #include <stdint.h>
 
+#include <mm/pmm.h>
 #include <tty/tty.h>
 
 #define VGA_WIDTH 80
 #define VGA_HEIGHT 25
-#define VGA_BUFFER (uint16_t*) 0xB8000
+#define VGA_BUFFER ((uint16_t*) phys_to_virt(0xB8000))
+// The colour text window at 0xB8000 is 32 KiB, enough for 204 rows
+#define VGA_MEMORY_ROWS (0x8000 / (VGA_WIDTH * 2))
+
+#define VGA_CRTC_INDEX 0x3D4
+#define VGA_CRTC_DATA 0x3D5
+#define VGA_CRTC_START_HIGH 0x0C
+#define VGA_CRTC_START_LOW 0x0D
+#define VGA_CRTC_CURSOR_HIGH 0x0E
+#define VGA_CRTC_CURSOR_LOW 0x0F
 
 static inline uint8_t vga_entry_color(color_t fg, color_t bg)
 {
@@ -0,0 +1,40 @@
+#ifndef FS_INITRD_H
+#define FS_INITRD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <boot/multiboot.h>
+
+#define INITRD_MODULE_NAME "initrd"
+
+typedef enum initrd_type_t
+{
+    INITRD_FILE,
+    INITRD_DIR,
+} initrd_type_t;
+
+// File data is never copied, it points straight into the module's pages
+// through the direct map and stays valid for the lifetime of the kernel
+typedef struct initrd_file_t
+{
+    const char *name;
+    size_t name_len;
+    uint32_t hash;
+    initrd_type_t type;
+    const void *data;
+    size_t size;
+} initrd_file_t;
+
+// Indexes the ustar archive GRUB loaded as the "initrd" module, or the
+// first module if none is named that. Needs kmalloc.
+bool initrd_init(multiboot_info_t *mbi);
+
+// Paths are relative to the archive root, a leading '/' is ignored
+const initrd_file_t *initrd_lookup(const char *path);
+
+size_t initrd_count(void);
+const initrd_file_t *initrd_entry(size_t index);
+
+#endif
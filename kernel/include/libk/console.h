@@ -0,0 +1,25 @@
+#ifndef LIBK_CONSOLE_H
+#define LIBK_CONSOLE_H
+
+#include <stddef.h>
+
+// An output device the log is drained to. write may be called from any
+// context, including interrupt handlers, and must do its own locking.
+typedef struct console_t
+{
+    const char *name;
+    void (*write)(struct console_t *console, const char *str, size_t len);
+    // Optional, waits until everything written has left the device
+    void (*flush)(struct console_t *console);
+    void *ctx;
+    struct console_t *next;
+} console_t;
+
+// Adds console to the sinks and replays the log history still in the ring
+// to it, so late consoles see the boot messages too
+void console_register(console_t *console);
+void console_write(const char *str, size_t len);
+// Drains the log and every console, for when the machine is about to stop
+void console_flush(void);
+
+#endif
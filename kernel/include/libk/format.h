@@ -0,0 +1,18 @@
+#ifndef LIBK_FORMAT_H
+#define LIBK_FORMAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Enough for any 64-bit value in decimal or hex, without a terminator
+#define FORMAT_MAX_DIGITS 20
+
+// Integer conversion for kprintf. Each routine writes its digits backwards
+// so they end just before end, and returns a pointer to the first digit.
+// Nothing is terminated and no sign or prefix is added.
+char *format_u32(char *end, uint32_t value);
+char *format_u64(char *end, uint64_t value);
+char *format_hex32(char *end, uint32_t value, bool upper);
+char *format_hex64(char *end, uint64_t value, bool upper);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef LIBK_HASH_H
+#define LIBK_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FNV1A_OFFSET 2166136261u
+#define FNV1A_PRIME 16777619u
+
+// 32-bit FNV-1a, short keys like paths and names hash well enough with it
+static inline uint32_t fnv1a(const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    uint32_t hash = FNV1A_OFFSET;
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV1A_PRIME;
+    }
+    return hash;
+}
+
+// Finalizer from MurmurHash3, spreads integer keys like block numbers over
+// every bit so masking off the low ones still picks a good bucket
+static inline uint32_t hash_u32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x85EBCA6B;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35;
+    x ^= x >> 16;
+    return x;
+}
+
+#endif
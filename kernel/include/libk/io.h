@@ -4,5 +4,8 @@
 #include <stddef.h>
 
 void kprintf(const char *format, ...);
+// Formats like kprintf into str, truncating to fit. Unlike snprintf the
+// result is the length actually written, not the length wanted.
+size_t ksnprintf(char *str, size_t size, const char *format, ...);
 
 #endif
\ No newline at end of file
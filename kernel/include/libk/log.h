@@ -0,0 +1,44 @@
+#ifndef LIBK_LOG_H
+#define LIBK_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_SLOT_SIZE 64
+#define LOG_SLOTS 256
+#define LOG_SLOT_TEXT (LOG_SLOT_SIZE - sizeof(uint32_t) - sizeof(uint16_t))
+
+// A slot is committed once seq holds its ring position plus one, so slots
+// left over from an earlier lap of the ring never look ready to drain
+typedef struct log_slot_t
+{
+    uint32_t seq;
+    uint16_t len;
+    char text[LOG_SLOT_TEXT];
+} log_slot_t;
+
+typedef struct log_ring_t
+{
+    uint32_t head __attribute__((aligned(64)));
+    uint32_t tail __attribute__((aligned(64)));
+    uint32_t draining;
+    uint32_t dropped;
+    log_slot_t slots[LOG_SLOTS] __attribute__((aligned(64)));
+} log_ring_t;
+
+// Left global so the log can be read back with a debugger after a crash
+extern log_ring_t log_ring;
+
+struct console_t;
+
+void log_init(void);
+void log_write(const char *str, size_t len);
+void log_flush(void);
+// For interrupt handlers, a worker drains the ring to the consoles later
+void log_flush_deferred(void);
+void log_dump(void);
+// Replays what has already been drained to console, then calls publish
+// before any further flush can reach the consoles
+void log_replay(struct console_t *console, void (*publish)(struct console_t *console));
+
+#endif
@@ -9,6 +9,27 @@ void* memmove(void*, const void*, size_t);
 void* memset(void*, int, size_t);
 size_t strlen(const char*);
 
+// Binds memcpy, memset, memcmp and strlen to the fastest variants for this
+// CPU. Must run on the boot CPU after cpu_features_init and fpu_init.
+void string_init(void);
+
+// Individual implementations behind the patched entry points, exposed for
+// benchmarking
+int memcmp_words(const void*, const void*, size_t);
+int memcmp_sse2(const void*, const void*, size_t);
+void* memcpy_bytes(void* __restrict, const void* __restrict, size_t);
+void* memcpy_words(void* __restrict, const void* __restrict, size_t);
+void* memcpy_rep(void* __restrict, const void* __restrict, size_t);
+void* memcpy_erms(void* __restrict, const void* __restrict, size_t);
+void* memcpy_sse2(void* __restrict, const void* __restrict, size_t);
+void* memset_words(void*, int, size_t);
+void* memset_rep(void*, int, size_t);
+void* memset_erms(void*, int, size_t);
+void* memset_sse2(void*, int, size_t);
+size_t strlen_bytes(const char*);
+size_t strlen_words(const char*);
+size_t strlen_sse2(const char*);
+
 char *itoa(int num, char *str, int base);
 
 #endif
\ No newline at end of file
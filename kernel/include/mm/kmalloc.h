@@ -0,0 +1,16 @@
+#ifndef MM_KMALLOC_H
+#define MM_KMALLOC_H
+
+#include <stddef.h>
+
+#define KMALLOC_ZERO (1 << 0)
+
+// Sizes up to this are served from slab caches, anything bigger gets
+// whole frames straight from the frame allocator
+#define KMALLOC_MAX_CACHE_SIZE 4096
+
+void kmalloc_init(void);
+void *kmalloc(size_t size, int flags);
+void kfree(void *ptr);
+
+#endif
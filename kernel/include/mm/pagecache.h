@@ -0,0 +1,70 @@
+#ifndef MM_PAGECACHE_H
+#define MM_PAGECACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <drivers/block/block.h>
+#include <mm/pmm.h>
+
+#define PAGECACHE_BUCKETS 1024
+#define PAGECACHE_SECTORS_PER_PAGE (PAGE_SIZE / BLOCK_SECTOR_SIZE)
+
+// Sequential reads start with this many pages ahead and double up to the
+// maximum while they stay sequential
+#define PAGECACHE_READAHEAD_MIN 4
+#define PAGECACHE_READAHEAD_MAX 32
+#define PAGECACHE_READAHEAD_STREAMS 8
+
+#define CACHE_PAGE_UPTODATE (1 << 0)
+#define CACHE_PAGE_LOCKED (1 << 1)
+#define CACHE_PAGE_ERROR (1 << 2)
+#define CACHE_PAGE_ACTIVE (1 << 3)
+#define CACHE_PAGE_REFERENCED (1 << 4)
+
+struct cache_waiter_t;
+
+// One frame of a block device. Pages enter the inactive list and move to
+// the active one when touched a second time, so a single sequential scan
+// cannot push out data that is used repeatedly.
+typedef struct cache_page_t
+{
+    block_device_t *dev;
+    uint64_t index;
+    void *data;
+    uint32_t flags;
+    // Users holding the page, it is never evicted while above zero
+    uint32_t pins;
+    block_io_t io;
+    struct cache_waiter_t *waiters;
+    struct cache_page_t *hash_next;
+    struct cache_page_t *lru_prev;
+    struct cache_page_t *lru_next;
+} cache_page_t;
+
+typedef struct pagecache_stats_t
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t readahead;
+    uint64_t evictions;
+    uint32_t pages;
+    uint32_t active;
+    uint32_t limit;
+} pagecache_stats_t;
+
+void pagecache_init(void);
+
+// Returns page index of dev pinned and up to date, NULL on I/O error or
+// when no page can be freed for it. May sleep.
+cache_page_t *pagecache_get(block_device_t *dev, uint64_t index);
+void pagecache_put(cache_page_t *page);
+
+// Byte granular access through the cache, writes go through to the device
+bool pagecache_read(block_device_t *dev, uint64_t offset, size_t len, void *buffer);
+bool pagecache_write(block_device_t *dev, uint64_t offset, size_t len, const void *buffer);
+
+void pagecache_get_stats(pagecache_stats_t *stats);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef MM_PMM_H
+#define MM_PMM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <boot/multiboot.h>
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define PAGE_ALIGN_DOWN(addr) ((addr) & ~(PAGE_SIZE - 1))
+#define PAGE_ALIGN_UP(addr) (((addr) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+// Largest contiguous allocation is 2^PMM_MAX_ORDER frames (4 MiB)
+#define PMM_MAX_ORDER 10
+
+#define PMM_FRAME_FREE (1 << 0)
+
+// Idle CPUs keep up to this many frames zeroed ahead of time, never more
+// than a 1/PMM_ZERO_POOL_SHARE of memory, and stop once free memory drops
+// below 1/PMM_ZERO_RESERVE_SHARE of it
+#define PMM_ZERO_POOL_MAX 256
+#define PMM_ZERO_POOL_SHARE 64
+#define PMM_ZERO_RESERVE_SHARE 8
+
+typedef struct pmm_frame_t
+{
+    union
+    {
+        // Buddy list links while the frame is free
+        struct
+        {
+            uint32_t next;
+            uint32_t prev;
+        };
+        // Owner bookkeeping while it is allocated
+        struct
+        {
+            void *slab;
+            uint32_t private;
+        };
+    };
+    uint8_t order;
+    uint8_t flags;
+    // Mappings of the frame, allocation sets it to one. Only meaningful for
+    // single frames handed out to address spaces.
+    uint16_t refcount;
+} pmm_frame_t;
+
+// The kernel lives in the top 1 GiB. Its first 896 MiB map the bottom of
+// physical memory one to one, the rest is mapped page by page on demand.
+#define KERNEL_VMA 0xC0000000
+#define DIRECT_MAP_SIZE 0x38000000
+#define KERNEL_MAP_START (KERNEL_VMA + DIRECT_MAP_SIZE)
+
+static inline void *phys_to_virt(uintptr_t phys)
+{
+    return (void*) (phys + KERNEL_VMA);
+}
+
+static inline uintptr_t virt_to_phys(const void *virt)
+{
+    return (uintptr_t) virt - KERNEL_VMA;
+}
+
+void pmm_init(multiboot_info_t *mbi);
+
+// Both return the physical address of the block, or 0 when out of memory
+uintptr_t pmm_alloc_frame(void);
+uintptr_t pmm_alloc_frames(unsigned order);
+void pmm_free_frame(uintptr_t addr);
+void pmm_free_frames(uintptr_t addr, unsigned order);
+
+// A single frame with every byte zero, from the pre-zeroed pool when it
+// has one. Freed like any other frame.
+uintptr_t pmm_alloc_zeroed_frame(void);
+// Zeroes one more frame into the pool, false when there is nothing to do.
+// Called from the idle loop with interrupts enabled.
+bool pmm_zero_idle(void);
+
+// Reference counting for frames shared between address spaces, the last
+// put frees the frame
+void pmm_frame_get(uintptr_t addr);
+void pmm_frame_put(uintptr_t addr);
+unsigned pmm_frame_refs(uintptr_t addr);
+
+pmm_frame_t *pmm_frame(uintptr_t addr);
+size_t pmm_free_count(void);
+size_t pmm_total_count(void);
+
+#endif
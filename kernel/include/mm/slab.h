@@ -0,0 +1,103 @@
+#ifndef MM_SLAB_H
+#define MM_SLAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu.h>
+#include <sync/spinlock.h>
+
+// Rounds per magazine, sized so a magazine fills one cache line
+#define KMEM_MAGAZINE_SIZE 14
+// Empty magazines the depot keeps before handing them back
+#define KMEM_DEPOT_EMPTY_MAX 8
+
+// Runs once per object when its slab is created. Objects must be handed
+// back to kmem_cache_free in their constructed state.
+typedef void (*kmem_ctor_t)(void *obj);
+
+typedef struct kmem_slab_t
+{
+    struct kmem_slab_t *next;
+    struct kmem_slab_t *prev;
+    struct kmem_cache_t *cache;
+    uint8_t *objects;
+    uint16_t free_count;
+    // Indices of free objects, used as a LIFO so the hottest object is
+    // always handed out next
+    uint16_t free_stack[];
+} kmem_slab_t;
+
+typedef struct kmem_magazine_t
+{
+    struct kmem_magazine_t *next;
+    uint32_t rounds;
+    void *objects[KMEM_MAGAZINE_SIZE];
+} kmem_magazine_t;
+
+// A CPU allocates from and frees into its loaded magazine with interrupts
+// off and no lock. previous is always full or empty, swapping the two
+// absorbs allocs and frees alternating at a magazine boundary, so only
+// every KMEM_MAGAZINE_SIZE-th operation goes to the depot.
+typedef struct kmem_cpu_cache_t
+{
+    kmem_magazine_t *loaded;
+    kmem_magazine_t *previous;
+    uint32_t allocs;
+    uint32_t frees;
+} __attribute__((aligned(64))) kmem_cpu_cache_t;
+
+typedef struct kmem_cache_stats_t
+{
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t slabs;
+    uint32_t inuse;
+} kmem_cache_stats_t;
+
+typedef struct kmem_cache_t
+{
+    const char *name;
+    size_t size;
+    size_t align;
+    kmem_ctor_t ctor;
+    unsigned order;
+    uint16_t objects_per_slab;
+    uint16_t header_size;
+    uint16_t colors;
+    uint16_t color_step;
+    uint16_t color_next;
+
+    kmem_slab_t *partial;
+    kmem_slab_t *full;
+    kmem_slab_t *empty;
+
+    kmem_cache_stats_t stats;
+    spinlock_t lock;
+    struct kmem_cache_t *next_cache;
+
+    // Full and empty magazines shared between CPUs, under depot_lock
+    bool magazines;
+    spinlock_t depot_lock;
+    kmem_magazine_t *depot_full;
+    kmem_magazine_t *depot_empty;
+    uint32_t depot_full_count;
+    uint32_t depot_empty_count;
+    kmem_cpu_cache_t cpus[MAX_CPUS];
+} kmem_cache_t;
+
+void slab_init(void);
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align, kmem_ctor_t ctor);
+void *kmem_cache_alloc(kmem_cache_t *cache);
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+// Returns the objects in full depot magazines to their slabs, and the
+// spare empty magazines with them. CPUs keep their loaded magazines.
+// Allocations that run out of frames call it and retry once.
+void kmem_cache_reap(void);
+void kmem_cache_dump(void);
+
+#endif
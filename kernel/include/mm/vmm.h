@@ -0,0 +1,62 @@
+#ifndef MM_VMM_H
+#define MM_VMM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu/paging.h>
+#include <sync/spinlock.h>
+
+#define VMA_READ (1 << 0)
+#define VMA_WRITE (1 << 1)
+#define VMA_USER (1 << 2)
+// Writes are seen by every address space the mapping was forked into,
+// private mappings are copied on the first write instead
+#define VMA_SHARED (1 << 3)
+
+// An anonymous mapping. Nothing is backed until it is touched: reads map
+// a shared zero frame, writes a private frame of their own.
+typedef struct vma_t
+{
+    uintptr_t start;
+    uintptr_t end;
+    uint32_t flags;
+    struct vma_t *next;
+} vma_t;
+
+// The user half of a page directory plus the areas allowed in it. It is
+// only ever loaded on the CPU it was created on, the one its tasks are
+// pinned to, so TLB maintenance never has to leave that CPU.
+typedef struct address_space_t
+{
+    pde_t *pd;
+    // Sorted by address and non-overlapping
+    vma_t *vmas;
+    // Always taken with interrupts off, a task preempted while holding it
+    // would leave a fault in the same address space spinning
+    spinlock_t lock;
+    uint32_t refcount;
+    uint8_t cpu;
+    size_t resident;
+} address_space_t;
+
+void vmm_init(void);
+
+address_space_t *vmm_create(void);
+// Private writable pages become copy-on-write in both parent and child.
+// Must run on the parent's CPU, the child belongs to the same one.
+address_space_t *vmm_fork(address_space_t *parent);
+void vmm_get(address_space_t *as);
+void vmm_put(address_space_t *as);
+
+// Both operate on page aligned ranges in the user half
+bool vmm_map(address_space_t *as, uintptr_t start, size_t len, uint32_t flags);
+void vmm_unmap(address_space_t *as, uintptr_t start, size_t len);
+
+// Switches the calling task into as, NULL goes back to the kernel's
+bool vmm_enter(address_space_t *as);
+// Called by the scheduler when the next task runs in another address space
+void vmm_switch(address_space_t *as);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef SCHED_SCHED_H
+#define SCHED_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu.h>
+#include <cpu/percpu.h>
+#include <sched/task.h>
+#include <sync/spinlock.h>
+
+// Lower numbers run first, the idle task sits below all of them
+#define SCHED_PRIORITIES 32
+#define SCHED_PRIORITY_DEFAULT 16
+#define SCHED_PRIORITY_IDLE SCHED_PRIORITIES
+
+#define SCHED_TIMESLICE_TICKS 5
+
+typedef struct task_queue_t
+{
+    task_t *head;
+    task_t *tail;
+} task_queue_t;
+
+// One per CPU. Bit n of bitmap is set while queues[n] is non-empty so the
+// next task is found with a single bit scan. Only the owning CPU picks
+// from it, the lock is for other CPUs waking tasks onto it.
+typedef struct runqueue_t
+{
+    spinlock_t lock;
+    uint32_t bitmap;
+    task_queue_t queues[SCHED_PRIORITIES];
+    task_t *current;
+    task_t *idle;
+    task_t *dead;
+    uint32_t nr_running;
+    uint32_t preempt_count;
+    volatile bool need_resched;
+    uint64_t switches;
+} __attribute__((aligned(64))) runqueue_t;
+
+extern runqueue_t runqueues[MAX_CPUS];
+
+static inline runqueue_t *this_runqueue(void)
+{
+    return &runqueues[cpu_id()];
+}
+
+static inline task_t *current_task(void)
+{
+    return this_runqueue()->current;
+}
+
+void sched_init(void);
+void sched_init_ap(void);
+__attribute__((noreturn)) void sched_idle(void);
+void schedule(void);
+void sched_yield(void);
+void sched_block(void);
+// Blocks until *done is set by whoever then calls sched_wake on the task,
+// safe against the wake arriving from another CPU at any point
+void sched_wait(volatile bool *done);
+void sched_wake(task_t *task);
+void sched_enqueue(task_t *task);
+void sched_interrupt_exit(void);
+// Reaps the task that switched away for good, called right after every
+// switch_context including a new task's first
+void sched_finish_switch(void);
+
+void preempt_disable(void);
+void preempt_enable(void);
+// For callers that may hold a spinlock or run with interrupts off, a
+// pending reschedule waits for the next interrupt exit instead
+void preempt_enable_no_resched(void);
+
+#endif
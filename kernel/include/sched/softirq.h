@@ -0,0 +1,48 @@
+#ifndef SCHED_SOFTIRQ_H
+#define SCHED_SOFTIRQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Lower numbers run first
+typedef enum softirq_t
+{
+    SOFTIRQ_BLOCK,
+    SOFTIRQ_TASKLET,
+    SOFTIRQ_LOG,
+    SOFTIRQ_COUNT,
+} softirq_t;
+
+// Rounds of newly raised softirqs handled before the rest is left for the
+// next interrupt exit, so a flood cannot starve tasks
+#define SOFTIRQ_MAX_RESTART 4
+
+typedef void (*softirq_handler_t)(void);
+
+#define TASKLET_SCHEDULED (1 << 0)
+#define TASKLET_RUNNING (1 << 1)
+
+// Runs fn(arg) once in softirq context on the CPU that scheduled it.
+// Scheduling it again before it ran has no effect, and a tasklet never
+// runs on two CPUs at once.
+typedef struct tasklet_t
+{
+    void (*fn)(void *arg);
+    void *arg;
+    uint32_t state;
+    struct tasklet_t *next;
+} tasklet_t;
+
+#define TASKLET_INIT(fn_, arg_) { .fn = (fn_), .arg = (arg_) }
+
+void softirq_register(softirq_t nr, softirq_handler_t handler);
+// Marks nr pending on this CPU. From an interrupt handler it runs once the
+// outermost handler returns, from a task with interrupts enabled right away.
+void softirq_raise(softirq_t nr);
+// Runs what is pending with interrupts enabled, counted as interrupt
+// context so handlers must not sleep. Called with interrupts disabled.
+void softirq_run(void);
+
+void tasklet_schedule(tasklet_t *tasklet);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef SCHED_TASK_H
+#define SCHED_TASK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TASK_STACK_SIZE 0x4000
+#define TASK_NAME_LEN 16
+
+typedef void (*task_entry_t)(void *arg);
+
+typedef enum task_state_t
+{
+    TASK_RUNNABLE,
+    TASK_BLOCKED,
+    TASK_DEAD,
+} task_state_t;
+
+typedef struct task_t
+{
+    // Saved stack pointer while switched out, switch_context relies on it
+    // being the first member
+    uint32_t esp;
+    uint32_t tid;
+    char name[TASK_NAME_LEN];
+    task_state_t state;
+    uint8_t priority;
+    uint8_t cpu;
+    uint16_t timeslice;
+    // Set while linked on a runqueue, protected by that runqueue's lock
+    bool queued;
+    task_entry_t entry;
+    void *arg;
+    void *stack;
+    // Allocated on the task's first FPU/SSE instruction
+    void *fpu_state;
+    // User half the task runs with, NULL for the kernel's alone
+    struct address_space_t *mm;
+    struct task_t *next;
+    struct task_t *prev;
+    uint64_t runtime_ns;
+    uint64_t switched_in;
+} task_t;
+
+task_t *task_create(const char *name, task_entry_t entry, void *arg, uint8_t priority);
+__attribute__((noreturn)) void task_exit(void);
+
+#endif
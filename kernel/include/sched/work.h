@@ -0,0 +1,53 @@
+#ifndef SCHED_WORK_H
+#define SCHED_WORK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu.h>
+
+// Must stay a power of two, the deque indices wrap around it
+#define WORK_DEQUE_SIZE 256
+
+struct work_t;
+typedef void (*work_fn_t)(struct work_t *work);
+
+// Embedded in whatever the work is about, fn gets it back and finds its
+// container. fn runs in a kernel worker task and may sleep.
+typedef struct work_t
+{
+    work_fn_t fn;
+    uint32_t pending;
+    struct work_t *next;
+} work_t;
+
+#define WORK_INIT(fn_) { .fn = (fn_) }
+
+// Chase-Lev deque. The owning CPU pushes and pops at the bottom with
+// interrupts off, other CPUs' workers steal from the top with a CAS.
+// Indices only grow, their difference is the number of entries.
+typedef struct work_deque_t
+{
+    uint32_t top __attribute__((aligned(64)));
+    uint32_t bottom __attribute__((aligned(64)));
+    struct work_t *slots[WORK_DEQUE_SIZE];
+} work_deque_t;
+
+typedef struct worker_t
+{
+    work_deque_t deque;
+    struct task_t *task;
+    uint32_t sleeping;
+    volatile bool wake;
+    uint32_t executed;
+    uint32_t stolen;
+} __attribute__((aligned(64))) worker_t;
+
+// Starts the calling CPU's worker, once per CPU after its scheduler
+void work_init_cpu(void);
+// Queues work on this CPU's deque, from any context including interrupt
+// handlers. Returns false if it was still pending from an earlier call.
+bool work_queue(work_t *work);
+void work_dump(void);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef SYNC_LOCKSTAT_H
+#define SYNC_LOCKSTAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Built with LOCK_STATS (make DEBUG=1) every lock counts its acquisitions
+// and the cycles spent spinning for it. Locks show up in lock_stats_dump()
+// once they have been taken.
+#ifdef LOCK_STATS
+
+#include <cpu/tsc.h>
+
+typedef struct lock_stats_t
+{
+    const char *name;
+    uint64_t acquires;
+    uint64_t contended;
+    uint64_t spin_cycles;
+    uint64_t max_spin_cycles;
+    struct lock_stats_t *next;
+    bool registered;
+} lock_stats_t;
+
+#define LOCK_STATS_INIT(lock_name) { .name = (lock_name) }
+
+void lock_stats_register(lock_stats_t *stats);
+void lock_stats_dump(void);
+
+static inline uint64_t lock_stats_start(void)
+{
+    return rdtsc();
+}
+
+// Must be called with the lock held, the lock protects its own counters
+static inline void lock_stats_acquired(lock_stats_t *stats, uint64_t start, bool contended)
+{
+    if (!stats->registered)
+    {
+        lock_stats_register(stats);
+    }
+
+    ++stats->acquires;
+    if (contended)
+    {
+        uint64_t spin = rdtsc() - start;
+        ++stats->contended;
+        stats->spin_cycles += spin;
+        if (spin > stats->max_spin_cycles)
+        {
+            stats->max_spin_cycles = spin;
+        }
+    }
+}
+
+#else
+
+typedef struct lock_stats_t
+{
+} lock_stats_t;
+
+#define LOCK_STATS_INIT(lock_name) { }
+
+static inline void lock_stats_dump(void)
+{
+}
+
+static inline uint64_t lock_stats_start(void)
+{
+    return 0;
+}
+
+static inline void lock_stats_acquired(lock_stats_t *stats, uint64_t start, bool contended)
+{
+    (void) stats;
+    (void) start;
+    (void) contended;
+}
+
+#endif
+
+#endif
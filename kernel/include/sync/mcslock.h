@@ -0,0 +1,78 @@
+#ifndef SYNC_MCSLOCK_H
+#define SYNC_MCSLOCK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu/irqflags.h>
+#include <sync/lockstat.h>
+
+// Each waiter spins on its own node, usually on its stack, so a contended
+// lock costs one cache line transfer per handoff instead of a storm
+typedef struct mcs_node_t
+{
+    struct mcs_node_t *volatile next;
+    volatile uint32_t locked;
+} mcs_node_t;
+
+typedef struct mcslock_t
+{
+    mcs_node_t *volatile tail;
+    lock_stats_t stats;
+} mcslock_t;
+
+#define MCSLOCK_INIT(name) { .tail = NULL, .stats = LOCK_STATS_INIT(name) }
+
+static inline void mcs_lock(mcslock_t *lock, mcs_node_t *node)
+{
+    uint64_t start = lock_stats_start();
+    node->next = NULL;
+    node->locked = 1;
+
+    mcs_node_t *prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+    if (prev != NULL)
+    {
+        __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE))
+        {
+            asm volatile("pause");
+        }
+    }
+    lock_stats_acquired(&lock->stats, start, prev != NULL);
+}
+
+static inline void mcs_unlock(mcslock_t *lock, mcs_node_t *node)
+{
+    mcs_node_t *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    if (next == NULL)
+    {
+        mcs_node_t *expected = node;
+        if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, false,
+            __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        {
+            return;
+        }
+        // A waiter swapped itself in but has not linked up yet
+        while ((next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) == NULL)
+        {
+            asm volatile("pause");
+        }
+    }
+    __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t mcs_lock_irqsave(mcslock_t *lock, mcs_node_t *node)
+{
+    uint32_t flags = irq_save();
+    mcs_lock(lock, node);
+    return flags;
+}
+
+static inline void mcs_unlock_irqrestore(mcslock_t *lock, mcs_node_t *node, uint32_t flags)
+{
+    mcs_unlock(lock, node);
+    irq_restore(flags);
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef SYNC_SEQLOCK_H
+#define SYNC_SEQLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <sync/spinlock.h>
+
+// Readers never write shared memory, they retry if a writer ran meanwhile.
+// The sequence is odd while a write is in progress.
+typedef struct seqlock_t
+{
+    volatile uint32_t seq;
+    spinlock_t lock;
+} seqlock_t;
+
+#define SEQLOCK_INIT(name) { .seq = 0, .lock = SPINLOCK_INIT(name) }
+
+static inline uint32_t read_seqbegin(const seqlock_t *sl)
+{
+    uint32_t seq;
+    while ((seq = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE)) & 1)
+    {
+        asm volatile("pause");
+    }
+    return seq;
+}
+
+static inline bool read_seqretry(const seqlock_t *sl, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&sl->seq, __ATOMIC_RELAXED) != seq;
+}
+
+static inline uint32_t write_seqlock_irqsave(seqlock_t *sl)
+{
+    uint32_t flags = spin_lock_irqsave(&sl->lock);
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return flags;
+}
+
+static inline void write_sequnlock_irqrestore(seqlock_t *sl, uint32_t flags)
+{
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELEASE);
+    spin_unlock_irqrestore(&sl->lock, flags);
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef SYNC_SPINLOCK_H
+#define SYNC_SPINLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/irqflags.h>
+#include <sync/lockstat.h>
+
+typedef struct spinlock_t
+{
+    volatile uint32_t locked;
+    lock_stats_t stats;
+} spinlock_t;
+
+#define SPINLOCK_INIT(name) { .locked = 0, .stats = LOCK_STATS_INIT(name) }
+
+static inline bool spin_trylock(spinlock_t *lock)
+{
+    return !__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE);
+}
+
+// Spins on a plain load so waiters keep the line shared instead of
+// bouncing it between CPUs with locked writes
+static inline void spin_lock(spinlock_t *lock)
+{
+    uint64_t start = lock_stats_start();
+    bool contended = false;
+    while (!spin_trylock(lock))
+    {
+        contended = true;
+        while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED))
+        {
+            asm volatile("pause");
+        }
+    }
+    lock_stats_acquired(&lock->stats, start, contended);
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+    __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+// For locks also taken from interrupt handlers
+static inline uint32_t spin_lock_irqsave(spinlock_t *lock)
+{
+    uint32_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags)
+{
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+#endif
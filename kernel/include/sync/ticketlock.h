@@ -0,0 +1,52 @@
+#ifndef SYNC_TICKETLOCK_H
+#define SYNC_TICKETLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/irqflags.h>
+#include <sync/lockstat.h>
+
+// Waiters are served strictly in arrival order
+typedef struct ticketlock_t
+{
+    volatile uint32_t next;
+    volatile uint32_t owner;
+    lock_stats_t stats;
+} ticketlock_t;
+
+#define TICKETLOCK_INIT(name) { .next = 0, .owner = 0, .stats = LOCK_STATS_INIT(name) }
+
+static inline void ticket_lock(ticketlock_t *lock)
+{
+    uint64_t start = lock_stats_start();
+    uint32_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    bool contended = false;
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket)
+    {
+        contended = true;
+        asm volatile("pause");
+    }
+    lock_stats_acquired(&lock->stats, start, contended);
+}
+
+static inline void ticket_unlock(ticketlock_t *lock)
+{
+    // Only the holder writes owner, no locked instruction needed
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t ticket_lock_irqsave(ticketlock_t *lock)
+{
+    uint32_t flags = irq_save();
+    ticket_lock(lock);
+    return flags;
+}
+
+static inline void ticket_unlock_irqrestore(ticketlock_t *lock, uint32_t flags)
+{
+    ticket_unlock(lock);
+    irq_restore(flags);
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SYSCALL_SYSCALL_H
+#define SYSCALL_SYSCALL_H
+
+#include <stdint.h>
+
+#include <cpu/interrupts.h>
+
+// The number goes in eax and up to four arguments in ebx, esi, edi and
+// ebp, the result comes back in eax. ecx and edx carry the SYSENTER
+// return stack and address, so they are the same for int 0x80 too.
+#define SYSCALL_VECTOR 0x80
+
+#define SYS_EXIT 0
+#define SYS_YIELD 1
+#define SYS_WRITE 2
+#define SYS_GETTID 3
+#define SYS_CLOCK 4
+#define SYSCALL_COUNT 5
+
+#define SYSCALL_ENOSYS (-38)
+#define SYSCALL_EFAULT (-14)
+#define SYSCALL_EINVAL (-22)
+
+typedef int32_t (*syscall_fn_t)(uint32_t a, uint32_t b, uint32_t c, uint32_t d);
+
+void syscall_init(void);
+void syscall_dispatch(interrupt_registers_t *regs);
+
+#endif
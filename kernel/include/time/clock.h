@@ -0,0 +1,29 @@
+#ifndef TIME_CLOCK_H
+#define TIME_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_USEC 1000ULL
+
+#define CLOCK_HZ 100
+
+typedef void (*clock_tick_handler_t)(void *ctx);
+
+void clock_init(void);
+void clock_init_ap(void);
+uint64_t ktime_ns(void);
+uint32_t clock_tsc_khz(void);
+uint64_t clock_ticks(void);
+
+// The tick handler runs in interrupt context on every timer expiry
+void clock_set_tick_handler(clock_tick_handler_t handler, void *ctx);
+bool clock_set_periodic(uint32_t hz);
+bool clock_set_oneshot(uint64_t delta_ns);
+void clock_stop(void);
+
+void clock_delay_ns(uint64_t ns);
+
+#endif
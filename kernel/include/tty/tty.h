@@ -27,6 +27,7 @@ typedef enum color_t
 
 void tty_init(void);
 void tty_write(const char *data, size_t len);
+void tty_flush(void);
 void tty_writestring(const char *str);
 void tty_setcolor(color_t color);
 void tty_colortest(void);
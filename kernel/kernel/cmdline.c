@@ -0,0 +1,46 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <boot/cmdline.h>
+#include <boot/multiboot.h>
+#include <libk/string.h>
+#include <mm/pmm.h>
+
+// pmm_init reserves the string, so it stays valid for the whole run
+static const char *kernel_cmdline = "";
+
+void cmdline_init(multiboot_info_t *mbi)
+{
+    if ((mbi->flags & MULTIBOOT_INFO_CMDLINE) && mbi->cmdline != 0)
+    {
+        kernel_cmdline = phys_to_virt(mbi->cmdline);
+    }
+}
+
+bool cmdline_has(const char *word)
+{
+    return cmdline_has_word(kernel_cmdline, word);
+}
+
+bool cmdline_has_word(const char *line, const char *word)
+{
+    size_t len = strlen(word);
+    const char *p = line;
+    while (*p != '\0')
+    {
+        while (*p == ' ')
+        {
+            ++p;
+        }
+        const char *start = p;
+        while (*p != '\0' && *p != ' ')
+        {
+            ++p;
+        }
+        if ((size_t)(p - start) == len && memcmp(start, word, len) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
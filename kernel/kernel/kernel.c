@@ -1,23 +1,93 @@
+#include <stdint.h>
+
+#include <boot/cmdline.h>
+#include <boot/multiboot.h>
+#include <bench/bench.h>
 #include <cpu.h>
+#include <debug/boottime.h>
+#include <debug/profile.h>
+#include <drivers/block/block.h>
+#include <drivers/pci/pci.h>
+#include <drivers/serial/uart.h>
+#include <fs/initrd.h>
 #include <tty/tty.h>
 #include <libk/io.h>
+#include <libk/log.h>
+#include <libk/string.h>
+#include <mm/kmalloc.h>
+#include <mm/pagecache.h>
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+#include <sched/sched.h>
+#include <sched/work.h>
+#include <sync/lockstat.h>
 
 #define KERNEL_NAME "Molecule"
 #define KERNEL_VER "0.0.1 - Genesis"
 
-void kernel_main(void)
+void kernel_main(uint32_t magic, uint32_t mbi_addr)
 {
+    BOOT_STAGE("cpu");
+    arch_early_init();
+    BOOT_STAGE("console");
+    string_init();
     tty_init();
     tty_setcolor(WHITE);
     kprintf("[ %s %s ]\n", KERNEL_NAME, KERNEL_VER);
     tty_setcolor(DEFAULT_COLOR);
 
-    tty_colortest();
+    // Paging setup in arch_init takes its page tables from the frame allocator
+    BOOT_STAGE("memory");
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC)
+    {
+        multiboot_info_t *mbi = phys_to_virt(mbi_addr);
+        cmdline_init(mbi);
+        pmm_init(mbi);
+        kmalloc_init();
+        initrd_init(mbi);
+    }
+    else
+    {
+        kprintf("Not booted by a multiboot loader, no memory map\n");
+    }
+
+    // Slow on real VGA, only run when asked for on the command line
+    if (cmdline_has("colortest"))
+    {
+        BOOT_STAGE("colortest");
+        tty_colortest();
+    }
 
     arch_init();
+    BOOT_STAGE("vmm");
+    vmm_init();
+    BOOT_STAGE("drivers");
+    serial_init();
+    pci_init();
+    block_init();
+    pagecache_init();
+    BOOT_STAGE("sched");
+    sched_init();
+    work_init_cpu();
+    log_init();
+    BOOT_STAGE("smp");
+    smp_init();
+    boot_timeline_print();
+
+#ifdef BENCH_KERNEL
+    bench_run();
+#endif
+#ifdef PROFILE_SECONDS
+    profile_run(PROFILE_SECONDS);
+#endif
+    // Contention seen during boot, an empty stub without LOCK_STATS
+    lock_stats_dump();
+
     kprintf("Welcome to ");
     tty_setcolor(LIGHT_CYAN);
     kprintf("Molecule");
     tty_setcolor(DEFAULT_COLOR);
     kprintf("!\n");
+
+    sched_idle();
 }
\ No newline at end of file
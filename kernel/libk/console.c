@@ -0,0 +1,44 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libk/console.h>
+#include <libk/log.h>
+
+static console_t *consoles;
+
+// Writers walk the list without a lock, so the console must be complete
+// before it is published. Consoles are never removed.
+static void console_publish(console_t *console)
+{
+    console_t *head = __atomic_load_n(&consoles, __ATOMIC_RELAXED);
+    do
+    {
+        console->next = head;
+    } while (!__atomic_compare_exchange_n(&consoles, &head, console, true,
+        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void console_register(console_t *console)
+{
+    log_replay(console, console_publish);
+}
+
+void console_write(const char *str, size_t len)
+{
+    for (console_t *console = __atomic_load_n(&consoles, __ATOMIC_ACQUIRE); console != NULL; console = console->next)
+    {
+        console->write(console, str, len);
+    }
+}
+
+void console_flush(void)
+{
+    log_flush();
+    for (console_t *console = __atomic_load_n(&consoles, __ATOMIC_ACQUIRE); console != NULL; console = console->next)
+    {
+        if (console->flush != NULL)
+        {
+            console->flush(console);
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libk/format.h>
+
+#define DEC_CHUNK 1000000000u
+#define DEC_CHUNK_DIGITS 9
+
+// Every pair 00..99, so decimal conversion takes one division per two digits
+static const char dec_pairs[200] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char hex_lower[16] = "0123456789abcdef";
+static const char hex_upper[16] = "0123456789ABCDEF";
+
+char *format_u32(char *end, uint32_t value)
+{
+    char *p = end;
+    while (value >= 100)
+    {
+        // Division by a constant compiles to a multiply
+        const char *pair = &dec_pairs[(value % 100) * 2];
+        value /= 100;
+        p -= 2;
+        p[0] = pair[0];
+        p[1] = pair[1];
+    }
+    if (value >= 10)
+    {
+        p -= 2;
+        p[0] = dec_pairs[value * 2];
+        p[1] = dec_pairs[value * 2 + 1];
+    }
+    else
+    {
+        *--p = '0' + value;
+    }
+    return p;
+}
+
+char *format_u64(char *end, uint64_t value)
+{
+    // 64-bit division is a libgcc call here, so peel off nine digits at a
+    // time until the rest fits the 32-bit path. That is at most twice.
+    char *p = end;
+    while (value > UINT32_MAX)
+    {
+        uint32_t chunk = value % DEC_CHUNK;
+        value /= DEC_CHUNK;
+        char *start = format_u32(p, chunk);
+        while (start > p - DEC_CHUNK_DIGITS)
+        {
+            *--start = '0';
+        }
+        p = start;
+    }
+    return format_u32(p, (uint32_t) value);
+}
+
+char *format_hex32(char *end, uint32_t value, bool upper)
+{
+    const char *digits = upper ? hex_upper : hex_lower;
+    char *p = end;
+    do
+    {
+        *--p = digits[value & 0xF];
+        value >>= 4;
+    } while (value != 0);
+    return p;
+}
+
+char *format_hex64(char *end, uint64_t value, bool upper)
+{
+    uint32_t high = value >> 32;
+    if (high == 0)
+    {
+        return format_hex32(end, (uint32_t) value, upper);
+    }
+
+    // The low half needs all eight of its digits once a high half follows
+    const char *digits = upper ? hex_upper : hex_lower;
+    char *p = end;
+    uint32_t low = (uint32_t) value;
+    for (int i = 0; i < 8; ++i)
+    {
+        *--p = digits[low & 0xF];
+        low >>= 4;
+    }
+    return format_hex32(p, high, upper);
+}
@@ -1,21 +1,96 @@
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
+#include <cpu.h>
+#include <libk/format.h>
 #include <libk/io.h>
+#include <libk/log.h>
 #include <libk/string.h>
-#include <tty/tty.h>
 
-static void kprint(const char *str, size_t len)
+#define KPRINTF_BUFFER_SIZE 256
+
+typedef struct kprintf_buffer_t
+{
+    char *data;
+    size_t size;
+    size_t len;
+    // A full buffer is committed to the log, otherwise output is truncated
+    bool to_log;
+} kprintf_buffer_t;
+
+// Messages are assembled on the stack and committed to the log in as few
+// pieces as possible, so concurrent writers do not interleave mid-line
+static void kprint(kprintf_buffer_t *buf, const char *str, size_t len)
 {
-    tty_write(str, len);
+    while (len != 0)
+    {
+        size_t space = buf->size - buf->len;
+        if (space == 0)
+        {
+            if (!buf->to_log)
+            {
+                return;
+            }
+            log_write(buf->data, buf->len);
+            buf->len = 0;
+            space = buf->size;
+        }
+
+        size_t n = len < space ? len : space;
+        memcpy(buf->data + buf->len, str, n);
+        buf->len += n;
+        str += n;
+        len -= n;
+    }
 }
 
-void kprintf(const char *format, ...)
+static void kprint_fill(kprintf_buffer_t *buf, char c, size_t count)
 {
-    va_list parameters;
-    va_start(parameters, format);
+    static const char spaces[16] = "                ";
+    static const char zeros[16] = "0000000000000000";
+    const char *fill = c == '0' ? zeros : spaces;
+    while (count != 0)
+    {
+        size_t n = count < sizeof(spaces) ? count : sizeof(spaces);
+        kprint(buf, fill, n);
+        count -= n;
+    }
+}
+
+typedef struct format_spec_t
+{
+    bool left;
+    char pad;
+    size_t width;
+    // 0 for int, 1 for long, 2 for long long
+    int length;
+} format_spec_t;
 
-    int written = 0;
+// Zero padding goes between the sign or 0x and the digits
+static void kprint_field(kprintf_buffer_t *buf, const format_spec_t *spec, const char *prefix, size_t prefix_len, const char *str, size_t len)
+{
+    size_t total = prefix_len + len;
+    size_t pad = spec->width > total ? spec->width - total : 0;
+    if (!spec->left && spec->pad == ' ')
+    {
+        kprint_fill(buf, ' ', pad);
+    }
+    kprint(buf, prefix, prefix_len);
+    if (!spec->left && spec->pad == '0')
+    {
+        kprint_fill(buf, '0', pad);
+    }
+    kprint(buf, str, len);
+    if (spec->left)
+    {
+        kprint_fill(buf, ' ', pad);
+    }
+}
+
+static void kvformat(kprintf_buffer_t *buf, const char *format, va_list parameters)
+{
     while (*format != '\0')
     {
         if (format[0] != '%' || format[1] == '%')
@@ -29,57 +104,167 @@ void kprintf(const char *format, ...)
             {
                 ++amount;
             }
-            kprint(format, amount * 1);
+            kprint(buf, format, amount);
             format += amount;
-            written += amount;
             continue;
         }
 
         const char *format_begun_at = format++;
-        if (*format == 'c')
+        format_spec_t spec = { false, ' ', 0, 0 };
+        for (;; ++format)
+        {
+            if (*format == '-')
+            {
+                spec.left = true;
+            }
+            else if (*format == '0')
+            {
+                spec.pad = '0';
+            }
+            else
+            {
+                break;
+            }
+        }
+        while (*format >= '0' && *format <= '9')
+        {
+            spec.width = spec.width * 10 + (*format++ - '0');
+        }
+        if (*format == 'l')
         {
             ++format;
-            char c = (char) va_arg(parameters, int);
-            kprint(&c, 1);
-            ++written;
+            spec.length = 1;
+            if (*format == 'l')
+            {
+                ++format;
+                spec.length = 2;
+            }
         }
-        else if (*format == 's')
+        else if (*format == 'z')
         {
             ++format;
+        }
+
+        char num_buf[FORMAT_MAX_DIGITS];
+        char *num_end = num_buf + sizeof(num_buf);
+        char c = *format++;
+        if (c == 'c')
+        {
+            char ch = (char) va_arg(parameters, int);
+            kprint_field(buf, &spec, NULL, 0, &ch, 1);
+        }
+        else if (c == 's')
+        {
             const char *str = va_arg(parameters, const char*);
-            size_t len = strlen(str);
-            kprint(str, len);
-            written += len;
+            if (str == NULL)
+            {
+                str = "(null)";
+            }
+            kprint_field(buf, &spec, NULL, 0, str, strlen(str));
         }
-        else if (*format == 'd')
+        else if (c == 'd' || c == 'i')
         {
-            ++format;
-            int i = va_arg(parameters, int);
-            char buf[50];
-            itoa(i, buf, 10);
-            size_t len = strlen(buf);
-            kprint(buf, len);
-            written += len;
+            int64_t value;
+            if (spec.length == 2)
+            {
+                value = va_arg(parameters, long long);
+            }
+            else if (spec.length == 1)
+            {
+                value = va_arg(parameters, long);
+            }
+            else
+            {
+                value = va_arg(parameters, int);
+            }
+            // Negating in unsigned arithmetic keeps the most negative value
+            uint64_t magnitude = value < 0 ? 0 - (uint64_t) value : (uint64_t) value;
+            char *digits = format_u64(num_end, magnitude);
+            kprint_field(buf, &spec, "-", value < 0, digits, num_end - digits);
         }
-        else if (*format == 'x')
+        else if (c == 'u' || c == 'x' || c == 'X')
         {
-            ++format;
-            int i = va_arg(parameters, int);
-            char buf[50];
-            buf[0] = '0';
-            buf[1] = 'x';
-            itoa(i, buf + 2, 16);
-            size_t len = strlen(buf);
-            kprint(buf, len);
-            written += len;
+            uint64_t value;
+            if (spec.length == 2)
+            {
+                value = va_arg(parameters, unsigned long long);
+            }
+            else if (spec.length == 1)
+            {
+                value = va_arg(parameters, unsigned long);
+            }
+            else
+            {
+                value = va_arg(parameters, unsigned int);
+            }
+            if (c == 'u')
+            {
+                char *digits = format_u64(num_end, value);
+                kprint_field(buf, &spec, NULL, 0, digits, num_end - digits);
+            }
+            else
+            {
+                // The kernel has always printed hex with its 0x
+                char *digits = format_hex64(num_end, value, c == 'X');
+                kprint_field(buf, &spec, "0x", 2, digits, num_end - digits);
+            }
+        }
+        else if (c == 'p')
+        {
+            uintptr_t value = (uintptr_t) va_arg(parameters, void*);
+            char *digits = format_hex32(num_end, value, false);
+            // Pointers always show every digit so columns line up
+            while (digits > num_end - (int) (sizeof(void*) * 2))
+            {
+                *--digits = '0';
+            }
+            kprint_field(buf, &spec, "0x", 2, digits, num_end - digits);
         }
         else
         {
             format = format_begun_at;
             size_t len = strlen(format);
-            kprint(format, len);
-            written += len;
+            kprint(buf, format, len);
             format += len;
         }
     }
-}
\ No newline at end of file
+}
+
+void kprintf(const char *format, ...)
+{
+    char storage[KPRINTF_BUFFER_SIZE];
+    kprintf_buffer_t buf = { storage, sizeof(storage), 0, true };
+
+    va_list parameters;
+    va_start(parameters, format);
+    kvformat(&buf, format, parameters);
+    va_end(parameters);
+
+    log_write(buf.data, buf.len);
+
+    // Interrupt handlers leave the slow console work to a worker
+    if (!in_interrupt())
+    {
+        log_flush();
+    }
+    else
+    {
+        log_flush_deferred();
+    }
+}
+
+size_t ksnprintf(char *str, size_t size, const char *format, ...)
+{
+    kprintf_buffer_t buf = { str, size != 0 ? size - 1 : 0, 0, false };
+
+    va_list parameters;
+    va_start(parameters, format);
+    kvformat(&buf, format, parameters);
+    va_end(parameters);
+
+    if (size != 0)
+    {
+        str[buf.len] = '\0';
+    }
+    return buf.len;
+}
@@ -0,0 +1,179 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libk/console.h>
+#include <libk/io.h>
+#include <libk/log.h>
+#include <libk/string.h>
+#include <sched/softirq.h>
+#include <sched/work.h>
+
+log_ring_t log_ring;
+
+static void log_flush_work(work_t *work)
+{
+    (void) work;
+    log_flush();
+}
+
+static work_t log_work = WORK_INIT(log_flush_work);
+
+// Runs with no locks held, unlike the handler that logged, so it is safe
+// to wake a worker from here
+static void log_softirq(void)
+{
+    work_queue(&log_work);
+}
+
+static inline log_slot_t *log_slot(uint32_t seq)
+{
+    return &log_ring.slots[seq % LOG_SLOTS];
+}
+
+static inline bool log_committed(uint32_t seq)
+{
+    return __atomic_load_n(&log_slot(seq)->seq, __ATOMIC_ACQUIRE) == seq + 1;
+}
+
+void log_write(const char *str, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+
+    uint32_t count = (len + LOG_SLOT_TEXT - 1) / LOG_SLOT_TEXT;
+    uint32_t head = __atomic_load_n(&log_ring.head, __ATOMIC_RELAXED);
+    do
+    {
+        // Never overwrite slots the console has not drained yet
+        uint32_t tail = __atomic_load_n(&log_ring.tail, __ATOMIC_ACQUIRE);
+        if (head - tail + count > LOG_SLOTS)
+        {
+            __atomic_fetch_add(&log_ring.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&log_ring.head, &head, head + count, true,
+        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        log_slot_t *slot = log_slot(head + i);
+        // A value no reader of this slot asks for, so a replay of the
+        // record being overwritten notices the copy it took may be torn
+        __atomic_store_n(&slot->seq, head + i, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        size_t n = len < LOG_SLOT_TEXT ? len : LOG_SLOT_TEXT;
+        memcpy(slot->text, str, n);
+        slot->len = n;
+        __atomic_store_n(&slot->seq, head + i + 1, __ATOMIC_RELEASE);
+        str += n;
+        len -= n;
+    }
+}
+
+void log_flush(void)
+{
+    // Only one context drains at a time, anyone else leaves it to them
+    while (!__atomic_exchange_n(&log_ring.draining, 1, __ATOMIC_ACQUIRE))
+    {
+        uint32_t tail = log_ring.tail;
+        while (log_committed(tail))
+        {
+            log_slot_t *slot = log_slot(tail);
+            console_write(slot->text, slot->len);
+            __atomic_store_n(&log_ring.tail, ++tail, __ATOMIC_RELEASE);
+        }
+
+        uint32_t dropped = __atomic_exchange_n(&log_ring.dropped, 0, __ATOMIC_RELAXED);
+        if (dropped != 0)
+        {
+            char buf[48] = "[log: ";
+            itoa(dropped, buf + 6, 10);
+            size_t len = strlen(buf);
+            memcpy(buf + len, " messages dropped]\n", 20);
+            console_write(buf, len + 19);
+        }
+
+        __atomic_store_n(&log_ring.draining, 0, __ATOMIC_RELEASE);
+
+        // A record committed after we stopped looking would otherwise sit
+        // in the ring until the next flush
+        if (!log_committed(tail))
+        {
+            break;
+        }
+    }
+}
+
+void log_init(void)
+{
+    softirq_register(SOFTIRQ_LOG, log_softirq);
+}
+
+void log_flush_deferred(void)
+{
+    softirq_raise(SOFTIRQ_LOG);
+}
+
+// Slots behind the tail may be reused while they are read, the copy only
+// counts if the slot still holds the same record afterwards
+static size_t log_read_slot(uint32_t seq, char *text)
+{
+    log_slot_t *slot = log_slot(seq);
+    if (!log_committed(seq))
+    {
+        return 0;
+    }
+    size_t len = slot->len;
+    if (len > LOG_SLOT_TEXT)
+    {
+        return 0;
+    }
+    memcpy(text, slot->text, len);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq + 1 ? len : 0;
+}
+
+void log_dump(void)
+{
+    uint32_t head = __atomic_load_n(&log_ring.head, __ATOMIC_ACQUIRE);
+    uint32_t seq = head > LOG_SLOTS ? head - LOG_SLOTS : 0;
+    for (; seq != head; ++seq)
+    {
+        char text[LOG_SLOT_TEXT];
+        size_t len = log_read_slot(seq, text);
+        if (len != 0)
+        {
+            console_write(text, len);
+        }
+    }
+}
+
+void log_replay(console_t *console, void (*publish)(console_t *console))
+{
+    // Holding the drain keeps flushes out until the console is published,
+    // so it gets everything drained before that from here and everything
+    // after from the flushes, each exactly once and in order
+    while (__atomic_exchange_n(&log_ring.draining, 1, __ATOMIC_ACQUIRE))
+    {
+        asm volatile("pause");
+    }
+
+    uint32_t tail = log_ring.tail;
+    uint32_t seq = tail > LOG_SLOTS ? tail - LOG_SLOTS : 0;
+    for (; seq != tail; ++seq)
+    {
+        char text[LOG_SLOT_TEXT];
+        size_t len = log_read_slot(seq, text);
+        if (len != 0)
+        {
+            console->write(console, text, len);
+        }
+    }
+    publish(console);
+    __atomic_store_n(&log_ring.draining, 0, __ATOMIC_RELEASE);
+
+    // Flushes that found the drain taken left their records behind
+    log_flush();
+}
@@ -1,25 +1,42 @@
 #include <stdbool.h>
+#include <stdint.h>
 
+#include <cpu/features.h>
+#include <cpu/fpu.h>
+#include <cpu/patch.h>
+#include <libk/format.h>
 #include <libk/string.h>
 
-static void reverse(char *str, size_t len)
-{
-    int start = 0;
-    int end = len - 1;
-    while (start < end)
-    {
-        char tmp = str[start];
-        str[start] = str[end];
-        str[end] = tmp;
-        ++start;
-        --end;
-    }
-}
+// Copies below this size are not worth aligning for.
+#define STRING_WORD_THRESHOLD 16
+// Copies at or above this size go through the rep-string, ERMS or SSE2 path.
+#define STRING_LARGE_THRESHOLD 256
+// Copies at or above this size bypass the cache with non-temporal stores.
+#define STRING_NT_THRESHOLD (256 * 1024)
 
-int memcmp(const void *aptr, const void *bptr, size_t size)
+typedef uint32_t __attribute__((may_alias, aligned(1))) unaligned_u32_t;
+typedef uint32_t __attribute__((may_alias)) aliased_u32_t;
+
+// The public entry points are single jumps bound by string_init. Until then
+// they go to variants that are correct on any CPU.
+PATCHABLE_JUMP(memcpy, memcpy_rep);
+PATCHABLE_JUMP(memset, memset_rep);
+PATCHABLE_JUMP(memcmp, memcmp_words);
+PATCHABLE_JUMP(strlen, strlen_words);
+
+int memcmp_words(const void *aptr, const void *bptr, size_t size)
 {
     const unsigned char *a = (const unsigned char*) aptr;
     const unsigned char *b = (const unsigned char*) bptr;
+
+    // Skip over equal words, then let the byte loop find the first difference
+    while (size >= 4 && *(const unaligned_u32_t*) a == *(const unaligned_u32_t*) b)
+    {
+        a += 4;
+        b += 4;
+        size -= 4;
+    }
+
     for (size_t i = 0; i < size; ++i)
     {
         if (a[i] < b[i])
@@ -35,10 +52,57 @@ int memcmp(const void *aptr, const void *bptr, size_t size)
     return 0;
 }
 
-void* memcpy(void* restrict dstptr, const void* restrict srcptr, size_t size)
+void* memcpy_bytes(void* restrict dstptr, const void* restrict srcptr, size_t size)
+{
+    unsigned char *dst = (unsigned char*) dstptr;
+    const unsigned char *src = (const unsigned char*) srcptr;
+    for (size_t i = 0; i < size; ++i)
+    {
+        dst[i] = src[i];
+    }
+
+    return dstptr;
+}
+
+void* memcpy_words(void* restrict dstptr, const void* restrict srcptr, size_t size)
 {
     unsigned char *dst = (unsigned char*) dstptr;
     const unsigned char *src = (const unsigned char*) srcptr;
+
+    // Align the destination, unaligned loads are cheap but split stores are not
+    size_t head = (-(uintptr_t) dst) & 3;
+    if (head > size)
+    {
+        head = size;
+    }
+    for (size_t i = 0; i < head; ++i)
+    {
+        *dst++ = *src++;
+    }
+    size -= head;
+
+    aliased_u32_t *dw = (aliased_u32_t*) dst;
+    const unaligned_u32_t *sw = (const unaligned_u32_t*) src;
+    for (; size >= 16; size -= 16)
+    {
+        uint32_t w0 = sw[0];
+        uint32_t w1 = sw[1];
+        uint32_t w2 = sw[2];
+        uint32_t w3 = sw[3];
+        dw[0] = w0;
+        dw[1] = w1;
+        dw[2] = w2;
+        dw[3] = w3;
+        dw += 4;
+        sw += 4;
+    }
+    for (; size >= 4; size -= 4)
+    {
+        *dw++ = *sw++;
+    }
+
+    dst = (unsigned char*) dw;
+    src = (const unsigned char*) sw;
     for (size_t i = 0; i < size; ++i)
     {
         dst[i] = src[i];
@@ -47,39 +111,354 @@ void* memcpy(void* restrict dstptr, const void* restrict srcptr, size_t size)
     return dstptr;
 }
 
+void* memcpy_rep(void* restrict dstptr, const void* restrict srcptr, size_t size)
+{
+    void *dst = dstptr;
+    size_t head = (-(uintptr_t) dst) & 3;
+    if (head > size)
+    {
+        head = size;
+    }
+    size_t words = (size - head) / 4;
+    size_t tail = (size - head) & 3;
+
+    asm volatile("rep movsb\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep movsl\n\t"
+                 "mov %4, %%ecx\n\t"
+                 "rep movsb"
+                 : "+D"(dst), "+S"(srcptr), "+c"(head)
+                 : "g"(words), "g"(tail)
+                 : "memory");
+
+    return dstptr;
+}
+
+// Kept out of line so no SSE register use can be scheduled ahead of
+// kernel_fpu_begin in the caller
+__attribute__((target("sse2"), noinline))
+static void memcpy_sse2_body(void* restrict dstptr, const void* restrict srcptr, size_t size)
+{
+    unsigned char *dst = (unsigned char*) dstptr;
+    const unsigned char *src = (const unsigned char*) srcptr;
+
+    size_t head = (-(uintptr_t) dst) & 15;
+    if (head > size)
+    {
+        head = size;
+    }
+    memcpy_words(dst, src, head);
+    dst += head;
+    src += head;
+    size -= head;
+
+    size_t blocks = size / 64;
+    if (blocks != 0 && size >= STRING_NT_THRESHOLD)
+    {
+        // Streaming stores keep a huge copy from evicting the whole cache
+        asm volatile("1:\n\t"
+                     "movdqu (%1), %%xmm0\n\t"
+                     "movdqu 16(%1), %%xmm1\n\t"
+                     "movdqu 32(%1), %%xmm2\n\t"
+                     "movdqu 48(%1), %%xmm3\n\t"
+                     "movntdq %%xmm0, (%0)\n\t"
+                     "movntdq %%xmm1, 16(%0)\n\t"
+                     "movntdq %%xmm2, 32(%0)\n\t"
+                     "movntdq %%xmm3, 48(%0)\n\t"
+                     "add $64, %1\n\t"
+                     "add $64, %0\n\t"
+                     "dec %2\n\t"
+                     "jnz 1b\n\t"
+                     "sfence"
+                     : "+r"(dst), "+r"(src), "+r"(blocks)
+                     :
+                     : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+    }
+    else if (blocks != 0)
+    {
+        asm volatile("1:\n\t"
+                     "movdqu (%1), %%xmm0\n\t"
+                     "movdqu 16(%1), %%xmm1\n\t"
+                     "movdqu 32(%1), %%xmm2\n\t"
+                     "movdqu 48(%1), %%xmm3\n\t"
+                     "movdqa %%xmm0, (%0)\n\t"
+                     "movdqa %%xmm1, 16(%0)\n\t"
+                     "movdqa %%xmm2, 32(%0)\n\t"
+                     "movdqa %%xmm3, 48(%0)\n\t"
+                     "add $64, %1\n\t"
+                     "add $64, %0\n\t"
+                     "dec %2\n\t"
+                     "jnz 1b"
+                     : "+r"(dst), "+r"(src), "+r"(blocks)
+                     :
+                     : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+    }
+
+    memcpy_words(dst, src, size & 63);
+}
+
+void* memcpy_sse2(void* restrict dstptr, const void* restrict srcptr, size_t size)
+{
+    // The registers may hold a task's live state, or an interrupted
+    // caller may already be using them
+    if (!kernel_fpu_begin())
+    {
+        return memcpy_rep(dstptr, srcptr, size);
+    }
+    memcpy_sse2_body(dstptr, srcptr, size);
+    kernel_fpu_end();
+    return dstptr;
+}
+
+// Fast-string microcode handles alignment itself, so a single rep movsb
+// beats splitting the copy
+void* memcpy_erms(void* restrict dstptr, const void* restrict srcptr, size_t size)
+{
+    void *dst = dstptr;
+    asm volatile("rep movsb"
+                 : "+D"(dst), "+S"(srcptr), "+c"(size)
+                 :
+                 : "memory");
+    return dstptr;
+}
+
+typedef void *(*memcpy_fn_t)(void* __restrict, const void* __restrict, size_t);
+
+// Inlined into each tier with a constant large copy routine, so the size
+// dispatch costs no indirect call
+__attribute__((always_inline))
+static inline void* memcpy_tiered(void* restrict dstptr, const void* restrict srcptr, size_t size, memcpy_fn_t large)
+{
+    if (size < STRING_WORD_THRESHOLD)
+    {
+        return memcpy_bytes(dstptr, srcptr, size);
+    }
+    if (size >= STRING_LARGE_THRESHOLD)
+    {
+        return large(dstptr, srcptr, size);
+    }
+    return memcpy_words(dstptr, srcptr, size);
+}
+
+static void* memcpy_tiered_rep(void* restrict dstptr, const void* restrict srcptr, size_t size)
+{
+    return memcpy_tiered(dstptr, srcptr, size, memcpy_rep);
+}
+
+static void* memcpy_tiered_erms(void* restrict dstptr, const void* restrict srcptr, size_t size)
+{
+    return memcpy_tiered(dstptr, srcptr, size, memcpy_erms);
+}
+
+static void* memcpy_tiered_sse2(void* restrict dstptr, const void* restrict srcptr, size_t size)
+{
+    return memcpy_tiered(dstptr, srcptr, size, memcpy_sse2);
+}
+
 void* memmove(void *dstptr, const void *srcptr, size_t size)
 {
     unsigned char *dst = (unsigned char*) dstptr;
     const unsigned char *src = (const unsigned char*) srcptr;
-    if (dst < src)
+    if (dst <= src || dst >= src + size)
     {
-        for (size_t i = 0; i < size; ++i)
+        // A forward copy never reads a byte it has already overwritten here
+        if (size >= STRING_LARGE_THRESHOLD)
         {
-            dst[i] = src[i];
+            return memcpy_rep(dstptr, srcptr, size);
         }
+        return memcpy_words(dstptr, srcptr, size);
     }
-    else
+
+    // Overlapping with dst above src, copy from the end downwards
+    while (size != 0 && ((uintptr_t) (dst + size) & 3) != 0)
     {
-        for (size_t i = size; i != 0; --i)
-        {
-            dst[i - 1] = src[i - 1];
-        }
+        --size;
+        dst[size] = src[size];
+    }
+    for (; size >= 4; size -= 4)
+    {
+        uint32_t w = *(const unaligned_u32_t*) (src + size - 4);
+        *(aliased_u32_t*) (dst + size - 4) = w;
+    }
+    while (size != 0)
+    {
+        --size;
+        dst[size] = src[size];
     }
 
     return dstptr;
 }
 
-void* memset(void *bufptr, int value, size_t size)
+void* memset_words(void *bufptr, int value, size_t size)
+{
+    unsigned char *buf = (unsigned char*) bufptr;
+    unsigned char byte = (unsigned char) value;
+    uint32_t pattern = byte * 0x01010101u;
+
+    while (size != 0 && ((uintptr_t) buf & 3) != 0)
+    {
+        *buf++ = byte;
+        --size;
+    }
+
+    aliased_u32_t *bw = (aliased_u32_t*) buf;
+    for (; size >= 16; size -= 16)
+    {
+        bw[0] = pattern;
+        bw[1] = pattern;
+        bw[2] = pattern;
+        bw[3] = pattern;
+        bw += 4;
+    }
+    for (; size >= 4; size -= 4)
+    {
+        *bw++ = pattern;
+    }
+
+    buf = (unsigned char*) bw;
+    for (size_t i = 0; i < size; ++i)
+    {
+        buf[i] = byte;
+    }
+
+    return bufptr;
+}
+
+void* memset_rep(void *bufptr, int value, size_t size)
+{
+    void *buf = bufptr;
+    uint32_t pattern = (unsigned char) value * 0x01010101u;
+    size_t head = (-(uintptr_t) buf) & 3;
+    if (head > size)
+    {
+        head = size;
+    }
+    size_t words = (size - head) / 4;
+    size_t tail = (size - head) & 3;
+
+    asm volatile("rep stosb\n\t"
+                 "mov %2, %%ecx\n\t"
+                 "rep stosl\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep stosb"
+                 : "+D"(buf), "+c"(head)
+                 : "g"(words), "g"(tail), "a"(pattern)
+                 : "memory");
+
+    return bufptr;
+}
+
+__attribute__((target("sse2"), noinline))
+static void memset_sse2_body(void *bufptr, int value, size_t size)
 {
     unsigned char *buf = (unsigned char*) bufptr;
-    for(size_t i = 0; i < size; ++i)
+
+    size_t head = (-(uintptr_t) buf) & 15;
+    if (head > size)
+    {
+        head = size;
+    }
+    memset_words(buf, value, head);
+    buf += head;
+    size -= head;
+
+    size_t blocks = size / 64;
+    uint32_t pattern = (unsigned char) value * 0x01010101u;
+    if (blocks != 0 && size >= STRING_NT_THRESHOLD)
+    {
+        asm volatile("movd %2, %%xmm0\n\t"
+                     "pshufd $0, %%xmm0, %%xmm0\n\t"
+                     "1:\n\t"
+                     "movntdq %%xmm0, (%0)\n\t"
+                     "movntdq %%xmm0, 16(%0)\n\t"
+                     "movntdq %%xmm0, 32(%0)\n\t"
+                     "movntdq %%xmm0, 48(%0)\n\t"
+                     "add $64, %0\n\t"
+                     "dec %1\n\t"
+                     "jnz 1b\n\t"
+                     "sfence"
+                     : "+r"(buf), "+r"(blocks)
+                     : "r"(pattern)
+                     : "memory", "xmm0");
+    }
+    else if (blocks != 0)
+    {
+        asm volatile("movd %2, %%xmm0\n\t"
+                     "pshufd $0, %%xmm0, %%xmm0\n\t"
+                     "1:\n\t"
+                     "movdqa %%xmm0, (%0)\n\t"
+                     "movdqa %%xmm0, 16(%0)\n\t"
+                     "movdqa %%xmm0, 32(%0)\n\t"
+                     "movdqa %%xmm0, 48(%0)\n\t"
+                     "add $64, %0\n\t"
+                     "dec %1\n\t"
+                     "jnz 1b"
+                     : "+r"(buf), "+r"(blocks)
+                     : "r"(pattern)
+                     : "memory", "xmm0");
+    }
+
+    memset_words(buf, value, size & 63);
+}
+
+void* memset_sse2(void *bufptr, int value, size_t size)
+{
+    if (!kernel_fpu_begin())
     {
-        buf[i] = (unsigned char) value;
+        return memset_rep(bufptr, value, size);
     }
+    memset_sse2_body(bufptr, value, size);
+    kernel_fpu_end();
     return bufptr;
 }
 
-size_t strlen(const char *str)
+void* memset_erms(void *bufptr, int value, size_t size)
+{
+    void *buf = bufptr;
+    asm volatile("rep stosb"
+                 : "+D"(buf), "+c"(size)
+                 : "a"(value)
+                 : "memory");
+    return bufptr;
+}
+
+typedef void *(*memset_fn_t)(void*, int, size_t);
+
+__attribute__((always_inline))
+static inline void* memset_tiered(void *bufptr, int value, size_t size, memset_fn_t large)
+{
+    if (size < STRING_WORD_THRESHOLD)
+    {
+        unsigned char *buf = (unsigned char*) bufptr;
+        for(size_t i = 0; i < size; ++i)
+        {
+            buf[i] = (unsigned char) value;
+        }
+        return bufptr;
+    }
+    if (size >= STRING_LARGE_THRESHOLD)
+    {
+        return large(bufptr, value, size);
+    }
+    return memset_words(bufptr, value, size);
+}
+
+static void* memset_tiered_rep(void *bufptr, int value, size_t size)
+{
+    return memset_tiered(bufptr, value, size, memset_rep);
+}
+
+static void* memset_tiered_erms(void *bufptr, int value, size_t size)
+{
+    return memset_tiered(bufptr, value, size, memset_erms);
+}
+
+static void* memset_tiered_sse2(void *bufptr, int value, size_t size)
+{
+    return memset_tiered(bufptr, value, size, memset_sse2);
+}
+
+size_t strlen_bytes(const char *str)
 {
     size_t len = 0;
     while (str[len])
@@ -89,37 +468,234 @@ size_t strlen(const char *str)
     return len;
 }
 
-char *itoa(int num, char *str, int base)
+// Large comparisons only, turning the SSE unit on costs more than a short
+// memcmp takes
+__attribute__((target("sse2"), noinline))
+static int memcmp_sse2_body(const unsigned char *a, const unsigned char *b, size_t size)
 {
-    int i = 0;
-    bool is_negative = false;
+    for (; size >= 16; size -= 16)
+    {
+        uint32_t mask;
+        asm volatile("movdqu (%1), %%xmm0\n\t"
+                     "movdqu (%2), %%xmm1\n\t"
+                     "pcmpeqb %%xmm1, %%xmm0\n\t"
+                     "pmovmskb %%xmm0, %0"
+                     : "=r"(mask)
+                     : "r"(a), "r"(b)
+                     : "memory", "xmm0", "xmm1");
+        if (mask != 0xFFFF)
+        {
+            unsigned i = __builtin_ctz(~mask);
+            return a[i] < b[i] ? -1 : 1;
+        }
+        a += 16;
+        b += 16;
+    }
+    return memcmp_words(a, b, size);
+}
 
-    if (num == 0)
+int memcmp_sse2(const void *aptr, const void *bptr, size_t size)
+{
+    if (!kernel_fpu_begin())
     {
-        str[i++] = '0';
-        str[i] = '\0';
-        return str;
+        return memcmp_words(aptr, bptr, size);
     }
+    int result = memcmp_sse2_body(aptr, bptr, size);
+    kernel_fpu_end();
+    return result;
+}
 
-    if (num < 10 && base == 10)
+static int memcmp_tiered_sse2(const void *aptr, const void *bptr, size_t size)
+{
+    if (size < STRING_LARGE_THRESHOLD)
     {
-        is_negative = true;
-        num = -num;
+        return memcmp_words(aptr, bptr, size);
     }
+    return memcmp_sse2(aptr, bptr, size);
+}
+
+#define STRLEN_HAS_ZERO(w) (((w) - 0x01010101u) & ~(w) & 0x80808080u)
 
-    while (num != 0)
+// Advances *pos a word at a time over at least max bytes. Aligned loads
+// never cross into the next page, so reading past the terminator is safe.
+__attribute__((always_inline))
+static inline bool strlen_scan_words(const char **pos, size_t max)
+{
+    const char *str = *pos;
+    while (((uintptr_t) str & 3) != 0)
     {
-        int rem = num % base;
-        str[i++] = (rem > 9) ? (rem - 10) + 'a' : rem + '0';
-        num /= base;
+        if (*str == '\0')
+        {
+            *pos = str;
+            return true;
+        }
+        ++str;
     }
 
-    if (is_negative)
+    const aliased_u32_t *word = (const aliased_u32_t*) str;
+    for (size_t scanned = 0; scanned < max; scanned += 4, ++word)
     {
-        str[i++] = '-';
+        uint32_t w = *word;
+        if (STRLEN_HAS_ZERO(w))
+        {
+            str = (const char*) word;
+            while (*str != '\0')
+            {
+                ++str;
+            }
+            *pos = str;
+            return true;
+        }
+    }
+    *pos = (const char*) word;
+    return false;
+}
+
+size_t strlen_words(const char *str)
+{
+    // Unbounded, the scan only stops at the terminator
+    const char *end = str;
+    strlen_scan_words(&end, SIZE_MAX);
+    return end - str;
+}
+
+__attribute__((target("sse2"), noinline))
+static size_t strlen_sse2_body(const char *str)
+{
+    // Starting from the enclosing aligned block keeps every load in a page
+    // the string already touches
+    const char *block = (const char*) ((uintptr_t) str & ~15);
+    uint32_t mask;
+    asm volatile("pxor %%xmm0, %%xmm0\n\t"
+                 "movdqa (%1), %%xmm1\n\t"
+                 "pcmpeqb %%xmm0, %%xmm1\n\t"
+                 "pmovmskb %%xmm1, %0"
+                 : "=r"(mask)
+                 : "r"(block)
+                 : "memory", "xmm0", "xmm1");
+    mask >>= (uintptr_t) str & 15;
+    if (mask != 0)
+    {
+        return __builtin_ctz(mask);
+    }
+
+    asm volatile("pxor %%xmm0, %%xmm0\n"
+                 "1:\n\t"
+                 "add $16, %0\n\t"
+                 "movdqa (%0), %%xmm1\n\t"
+                 "pcmpeqb %%xmm0, %%xmm1\n\t"
+                 "pmovmskb %%xmm1, %1\n\t"
+                 "test %1, %1\n\t"
+                 "jz 1b"
+                 : "+r"(block), "=&r"(mask)
+                 :
+                 : "memory", "xmm0", "xmm1");
+    return block + __builtin_ctz(mask) - str;
+}
+
+size_t strlen_sse2(const char *str)
+{
+    if (!kernel_fpu_begin())
+    {
+        return strlen_words(str);
+    }
+    size_t len = strlen_sse2_body(str);
+    kernel_fpu_end();
+    return len;
+}
+
+// Most strings are short, so only those still going after the first few
+// hundred bytes are handed to SSE2
+static size_t strlen_tiered_sse2(const char *str)
+{
+    const char *end = str;
+    if (strlen_scan_words(&end, STRING_LARGE_THRESHOLD))
+    {
+        return end - str;
     }
-    str[i] = '\0';
-    reverse(str, i);
+    return (end - str) + strlen_sse2(end);
+}
+
+// SSE registers fault until fpu_init has set CR4.OSFXSR, which it does
+// whenever FXSR is present
+#define STRING_SSE2_FEATURES (CPU_FEATURE_BIT(CPU_FEATURE_FXSR) | CPU_FEATURE_BIT(CPU_FEATURE_SSE2))
+
+static const patch_choice_t memcpy_choices[] =
+{
+    { CPU_FEATURE_BIT(CPU_FEATURE_ERMS), memcpy_tiered_erms },
+    { STRING_SSE2_FEATURES, memcpy_tiered_sse2 },
+    { 0, memcpy_tiered_rep },
+};
 
+static const patch_choice_t memset_choices[] =
+{
+    { CPU_FEATURE_BIT(CPU_FEATURE_ERMS), memset_tiered_erms },
+    { STRING_SSE2_FEATURES, memset_tiered_sse2 },
+    { 0, memset_tiered_rep },
+};
+
+static const patch_choice_t memcmp_choices[] =
+{
+    { STRING_SSE2_FEATURES, memcmp_tiered_sse2 },
+    { 0, memcmp_words },
+};
+
+static const patch_choice_t strlen_choices[] =
+{
+    { STRING_SSE2_FEATURES, strlen_tiered_sse2 },
+    { 0, strlen_words },
+};
+
+#define PATCH_CHOICES(choices) choices, sizeof(choices) / sizeof(choices[0])
+
+void string_init(void)
+{
+    patch_select(memcpy, PATCH_CHOICES(memcpy_choices));
+    patch_select(memset, PATCH_CHOICES(memset_choices));
+    patch_select(memcmp, PATCH_CHOICES(memcmp_choices));
+    patch_select(strlen, PATCH_CHOICES(strlen_choices));
+}
+
+char *itoa(int num, char *str, int base)
+{
+    if (base < 2 || base > 36)
+    {
+        str[0] = '\0';
+        return str;
+    }
+
+    // Only decimal is signed, other bases show the two's complement bits
+    bool is_negative = base == 10 && num < 0;
+    uint32_t value = is_negative ? 0u - (uint32_t) num : (uint32_t) num;
+
+    char buf[33];
+    char *end = buf + sizeof(buf);
+    char *p;
+    if (base == 10)
+    {
+        p = format_u32(end, value);
+    }
+    else if (base == 16)
+    {
+        p = format_hex32(end, value, false);
+    }
+    else
+    {
+        p = end;
+        do
+        {
+            uint32_t rem = value % base;
+            *--p = (rem > 9) ? (rem - 10) + 'a' : rem + '0';
+            value /= base;
+        } while (value != 0);
+    }
+
+    if (is_negative)
+    {
+        *--p = '-';
+    }
+    size_t len = end - p;
+    memcpy(str, p, len);
+    str[len] = '\0';
     return str;
-}
\ No newline at end of file
+}
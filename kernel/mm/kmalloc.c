@@ -0,0 +1,100 @@
+#include <stdint.h>
+
+#include <libk/io.h>
+#include <libk/string.h>
+#include <mm/kmalloc.h>
+#include <mm/pmm.h>
+#include <mm/slab.h>
+
+#define KMALLOC_MIN_SHIFT 4
+#define KMALLOC_MAX_SHIFT 12
+#define KMALLOC_CACHES (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+
+static const char *kmalloc_names[KMALLOC_CACHES] =
+{
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128", "kmalloc-256",
+    "kmalloc-512", "kmalloc-1024", "kmalloc-2048", "kmalloc-4096",
+};
+
+static kmem_cache_t *kmalloc_caches[KMALLOC_CACHES];
+
+static inline unsigned size_to_order(size_t size, unsigned min_shift)
+{
+    if (size <= (1u << min_shift))
+    {
+        return 0;
+    }
+    return 32 - __builtin_clz(size - 1) - min_shift;
+}
+
+void kmalloc_init(void)
+{
+    slab_init();
+    for (unsigned i = 0; i < KMALLOC_CACHES; ++i)
+    {
+        size_t size = 1u << (i + KMALLOC_MIN_SHIFT);
+        // Power of two objects stay naturally aligned, up to a cache line
+        kmalloc_caches[i] = kmem_cache_create(kmalloc_names[i], size, size < 64 ? size : 64, NULL);
+    }
+}
+
+void *kmalloc(size_t size, int flags)
+{
+    // Zeroed requests of about a page take a whole frame from the
+    // pre-zeroed pool, kfree sees an order 0 frame and frees it as such
+    if ((flags & KMALLOC_ZERO) && size > PAGE_SIZE / 2 && size <= PAGE_SIZE)
+    {
+        uintptr_t phys = pmm_alloc_zeroed_frame();
+        return phys != 0 ? phys_to_virt(phys) : NULL;
+    }
+
+    void *ptr;
+    if (size <= KMALLOC_MAX_CACHE_SIZE)
+    {
+        ptr = kmem_cache_alloc(kmalloc_caches[size_to_order(size, KMALLOC_MIN_SHIFT)]);
+    }
+    else
+    {
+        // Large allocations take whole frames, the frame records the order
+        unsigned order = size_to_order(size, PAGE_SHIFT);
+        uintptr_t phys = pmm_alloc_frames(order);
+        if (phys == 0)
+        {
+            kmem_cache_reap();
+            phys = pmm_alloc_frames(order);
+        }
+        ptr = phys != 0 ? phys_to_virt(phys) : NULL;
+    }
+
+    if (ptr != NULL && (flags & KMALLOC_ZERO))
+    {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void kfree(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    uintptr_t phys = virt_to_phys(ptr);
+    pmm_frame_t *frame = pmm_frame(phys);
+    if (frame == NULL)
+    {
+        kprintf("kfree: %x is not a heap pointer\n", ptr);
+        return;
+    }
+
+    kmem_slab_t *slab = frame->slab;
+    if (slab != NULL)
+    {
+        kmem_cache_free(slab->cache, ptr);
+    }
+    else
+    {
+        pmm_free_frames(phys, frame->order);
+    }
+}
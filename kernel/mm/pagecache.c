@@ -0,0 +1,545 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <drivers/block/block.h>
+#include <libk/hash.h>
+#include <libk/io.h>
+#include <libk/string.h>
+#include <mm/pagecache.h>
+#include <mm/pmm.h>
+#include <mm/slab.h>
+#include <sched/sched.h>
+#include <sched/task.h>
+#include <sync/spinlock.h>
+
+typedef struct cache_waiter_t
+{
+    volatile bool done;
+    task_t *task;
+    struct cache_waiter_t *next;
+} cache_waiter_t;
+
+typedef struct lru_list_t
+{
+    cache_page_t *head;
+    cache_page_t *tail;
+    uint32_t count;
+} lru_list_t;
+
+// Sequential detection is per device, the block layer below sees no files
+typedef struct readahead_t
+{
+    block_device_t *dev;
+    uint64_t next;
+    // Highest page already read ahead
+    uint64_t ahead;
+    uint32_t window;
+} readahead_t;
+
+// One lock covers the index, the lists and page state. Completions take
+// it from interrupt context, so it is always held with interrupts off.
+static spinlock_t pagecache_lock = SPINLOCK_INIT("pagecache");
+static kmem_cache_t *page_cache;
+static cache_page_t *buckets[PAGECACHE_BUCKETS];
+static lru_list_t active;
+static lru_list_t inactive;
+static readahead_t streams[PAGECACHE_READAHEAD_STREAMS];
+static unsigned stream_clock;
+static pagecache_stats_t stats;
+
+void pagecache_init(void)
+{
+    page_cache = kmem_cache_create("cache_page", sizeof(cache_page_t), 0, NULL);
+    if (page_cache == NULL)
+    {
+        kprintf("pagecache: no memory for the page cache\n");
+        return;
+    }
+    // Leave most of memory to everything else, clean pages are cheap to
+    // drop but the cache should not push the allocator into eviction on
+    // every request
+    stats.limit = pmm_total_count() / 4;
+    kprintf("pagecache: up to %u MiB\n", stats.limit / (1024 * 1024 / PAGE_SIZE));
+}
+
+static uint32_t pagecache_bucket(block_device_t *dev, uint64_t index)
+{
+    uint32_t key = hash_u32((uint32_t) index ^ (uint32_t) (index >> 32)) ^ (uint32_t) (uintptr_t) dev;
+    return hash_u32(key) & (PAGECACHE_BUCKETS - 1);
+}
+
+static cache_page_t *pagecache_lookup(block_device_t *dev, uint64_t index)
+{
+    for (cache_page_t *page = buckets[pagecache_bucket(dev, index)]; page != NULL; page = page->hash_next)
+    {
+        if (page->dev == dev && page->index == index)
+        {
+            return page;
+        }
+    }
+    return NULL;
+}
+
+static void pagecache_unhash(cache_page_t *page)
+{
+    cache_page_t **link = &buckets[pagecache_bucket(page->dev, page->index)];
+    while (*link != page)
+    {
+        link = &(*link)->hash_next;
+    }
+    *link = page->hash_next;
+    page->hash_next = NULL;
+}
+
+static void lru_push(lru_list_t *list, cache_page_t *page)
+{
+    page->lru_prev = NULL;
+    page->lru_next = list->head;
+    if (list->head != NULL)
+    {
+        list->head->lru_prev = page;
+    }
+    else
+    {
+        list->tail = page;
+    }
+    list->head = page;
+    ++list->count;
+}
+
+static void lru_remove(lru_list_t *list, cache_page_t *page)
+{
+    if (page->lru_prev != NULL)
+    {
+        page->lru_prev->lru_next = page->lru_next;
+    }
+    else
+    {
+        list->head = page->lru_next;
+    }
+    if (page->lru_next != NULL)
+    {
+        page->lru_next->lru_prev = page->lru_prev;
+    }
+    else
+    {
+        list->tail = page->lru_prev;
+    }
+    page->lru_prev = NULL;
+    page->lru_next = NULL;
+    --list->count;
+}
+
+static lru_list_t *pagecache_list(cache_page_t *page)
+{
+    return (page->flags & CACHE_PAGE_ACTIVE) ? &active : &inactive;
+}
+
+// Moves the oldest active page back to the inactive list, it has to be
+// referenced twice again to return
+static void pagecache_deactivate(void)
+{
+    cache_page_t *page = active.tail;
+    lru_remove(&active, page);
+    page->flags &= ~(CACHE_PAGE_ACTIVE | CACHE_PAGE_REFERENCED);
+    lru_push(&inactive, page);
+}
+
+// Keeps the inactive list at least as long as the active one so new pages
+// get a fair chance to prove they are used again
+static void pagecache_balance(void)
+{
+    while (active.count > inactive.count)
+    {
+        pagecache_deactivate();
+    }
+}
+
+static void pagecache_touch(cache_page_t *page)
+{
+    if (page->flags & CACHE_PAGE_ACTIVE)
+    {
+        lru_remove(&active, page);
+        lru_push(&active, page);
+    }
+    else if (page->flags & CACHE_PAGE_REFERENCED)
+    {
+        lru_remove(&inactive, page);
+        page->flags = (page->flags & ~CACHE_PAGE_REFERENCED) | CACHE_PAGE_ACTIVE;
+        lru_push(&active, page);
+        pagecache_balance();
+    }
+    else
+    {
+        page->flags |= CACHE_PAGE_REFERENCED;
+    }
+}
+
+static void pagecache_free(cache_page_t *page)
+{
+    pmm_free_frame(virt_to_phys(page->data));
+    kmem_cache_free(page_cache, page);
+    --stats.pages;
+}
+
+// Drops the least recently used page nobody holds, ageing active pages
+// when everything inactive is busy
+static bool pagecache_evict(void)
+{
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (cache_page_t *page = inactive.tail; page != NULL; page = page->lru_prev)
+        {
+            if (page->pins == 0 && !(page->flags & CACHE_PAGE_LOCKED))
+            {
+                lru_remove(&inactive, page);
+                pagecache_unhash(page);
+                pagecache_free(page);
+                ++stats.evictions;
+                return true;
+            }
+        }
+        for (uint32_t i = 0; i < PAGECACHE_READAHEAD_MAX && active.count > 0; ++i)
+        {
+            pagecache_deactivate();
+        }
+    }
+    return false;
+}
+
+// Creates a locked page in the index for index of dev, its contents still
+// have to be read by the caller
+static cache_page_t *pagecache_create(block_device_t *dev, uint64_t index)
+{
+    if (stats.pages >= stats.limit && !pagecache_evict())
+    {
+        return NULL;
+    }
+    uintptr_t frame = pmm_alloc_frame();
+    if (frame == 0 && (!pagecache_evict() || (frame = pmm_alloc_frame()) == 0))
+    {
+        return NULL;
+    }
+    cache_page_t *page = kmem_cache_alloc(page_cache);
+    if (page == NULL)
+    {
+        pmm_free_frame(frame);
+        return NULL;
+    }
+
+    *page = (cache_page_t) {
+        .dev = dev,
+        .index = index,
+        .data = phys_to_virt(frame),
+        .flags = CACHE_PAGE_LOCKED,
+    };
+    uint32_t bucket = pagecache_bucket(dev, index);
+    page->hash_next = buckets[bucket];
+    buckets[bucket] = page;
+    lru_push(&inactive, page);
+    ++stats.pages;
+    return page;
+}
+
+static uint64_t pagecache_dev_pages(block_device_t *dev)
+{
+    return (dev->sectors + PAGECACHE_SECTORS_PER_PAGE - 1) / PAGECACHE_SECTORS_PER_PAGE;
+}
+
+static readahead_t *pagecache_stream(block_device_t *dev)
+{
+    for (unsigned i = 0; i < PAGECACHE_READAHEAD_STREAMS; ++i)
+    {
+        if (streams[i].dev == dev)
+        {
+            return &streams[i];
+        }
+    }
+    readahead_t *ra = &streams[stream_clock++ % PAGECACHE_READAHEAD_STREAMS];
+    *ra = (readahead_t) { .dev = dev, .next = UINT64_MAX };
+    return ra;
+}
+
+// Records an access to index and creates the pages to read ahead of it
+// when the device is being read sequentially. The window doubles each
+// time the reader catches up with half of it.
+static unsigned pagecache_readahead(block_device_t *dev, uint64_t index, cache_page_t **batch)
+{
+    readahead_t *ra = pagecache_stream(dev);
+    // Small reads come back to the same page, that neither continues nor
+    // breaks the sequence
+    if (index + 1 == ra->next)
+    {
+        return 0;
+    }
+    if (index != ra->next)
+    {
+        ra->next = index + 1;
+        ra->ahead = index;
+        ra->window = 0;
+        return 0;
+    }
+    ra->next = index + 1;
+    if (ra->window != 0 && ra->ahead > index + ra->window / 2)
+    {
+        return 0;
+    }
+    ra->window = ra->window == 0 ? PAGECACHE_READAHEAD_MIN : ra->window * 2;
+    if (ra->window > PAGECACHE_READAHEAD_MAX)
+    {
+        ra->window = PAGECACHE_READAHEAD_MAX;
+    }
+    // Pages read too far ahead would be evicted again before their turn
+    if (ra->window > stats.limit / 4)
+    {
+        ra->window = stats.limit / 4;
+    }
+
+    uint64_t start = (ra->ahead > index ? ra->ahead : index) + 1;
+    uint64_t end = index + ra->window;
+    uint64_t pages = pagecache_dev_pages(dev);
+    if (end >= pages)
+    {
+        end = pages - 1;
+    }
+
+    unsigned count = 0;
+    for (uint64_t next = start; next <= end; ++next)
+    {
+        if (pagecache_lookup(dev, next) == NULL)
+        {
+            cache_page_t *page = pagecache_create(dev, next);
+            if (page == NULL)
+            {
+                break;
+            }
+            batch[count++] = page;
+        }
+        ra->ahead = next;
+    }
+    stats.readahead += count;
+    return count;
+}
+
+static void pagecache_io_done(block_io_t *io, bool ok)
+{
+    cache_page_t *page = io->ctx;
+    uint32_t flags = spin_lock_irqsave(&pagecache_lock);
+    page->flags &= ~CACHE_PAGE_LOCKED;
+    if (ok)
+    {
+        page->flags |= CACHE_PAGE_UPTODATE;
+    }
+    else
+    {
+        // Failed pages leave the index so the next access retries, the
+        // last holder frees them
+        page->flags |= CACHE_PAGE_ERROR;
+        lru_remove(pagecache_list(page), page);
+        pagecache_unhash(page);
+    }
+
+    cache_waiter_t *wait = page->waiters;
+    page->waiters = NULL;
+    while (wait != NULL)
+    {
+        // The waiter may return as soon as done is set
+        cache_waiter_t *next = wait->next;
+        task_t *task = wait->task;
+        __atomic_store_n(&wait->done, true, __ATOMIC_RELEASE);
+        if (task != NULL)
+        {
+            sched_wake(task);
+        }
+        wait = next;
+    }
+
+    if ((page->flags & CACHE_PAGE_ERROR) && page->pins == 0)
+    {
+        pagecache_free(page);
+    }
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+}
+
+static void pagecache_start_read(cache_page_t *page)
+{
+    uint64_t lba = page->index * PAGECACHE_SECTORS_PER_PAGE;
+    uint64_t left = page->dev->sectors - lba;
+    uint32_t count = left < PAGECACHE_SECTORS_PER_PAGE ? (uint32_t) left : PAGECACHE_SECTORS_PER_PAGE;
+    if (count < PAGECACHE_SECTORS_PER_PAGE)
+    {
+        memset((uint8_t*) page->data + count * BLOCK_SECTOR_SIZE, 0,
+            (PAGECACHE_SECTORS_PER_PAGE - count) * BLOCK_SECTOR_SIZE);
+    }
+
+    page->io = (block_io_t) {
+        .lba = lba,
+        .count = count,
+        .write = false,
+        .buffer = page->data,
+        .done = pagecache_io_done,
+        .ctx = page,
+    };
+    if (!block_submit(page->dev, &page->io))
+    {
+        pagecache_io_done(&page->io, false);
+    }
+}
+
+cache_page_t *pagecache_get(block_device_t *dev, uint64_t index)
+{
+    if (page_cache == NULL || index >= pagecache_dev_pages(dev))
+    {
+        return NULL;
+    }
+
+    cache_page_t *batch[PAGECACHE_READAHEAD_MAX];
+    cache_waiter_t wait = { .done = false, .task = current_task(), .next = NULL };
+    bool created = false;
+
+    uint32_t flags = spin_lock_irqsave(&pagecache_lock);
+    cache_page_t *page = pagecache_lookup(dev, index);
+    if (page != NULL)
+    {
+        ++stats.hits;
+    }
+    else
+    {
+        ++stats.misses;
+        page = pagecache_create(dev, index);
+        if (page == NULL)
+        {
+            spin_unlock_irqrestore(&pagecache_lock, flags);
+            return NULL;
+        }
+        created = true;
+    }
+    ++page->pins;
+    pagecache_touch(page);
+
+    bool locked = page->flags & CACHE_PAGE_LOCKED;
+    if (locked)
+    {
+        wait.next = page->waiters;
+        page->waiters = &wait;
+    }
+    unsigned count = pagecache_readahead(dev, index, batch);
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+
+    // The requested page goes first, the read ahead ones queue behind it
+    // and the block layer merges them into few large requests
+    if (created)
+    {
+        pagecache_start_read(page);
+    }
+    for (unsigned i = 0; i < count; ++i)
+    {
+        pagecache_start_read(batch[i]);
+    }
+
+    if (locked)
+    {
+        // Before the scheduler runs there is nothing to switch to
+        if (wait.task != NULL)
+        {
+            sched_wait(&wait.done);
+        }
+        while (!__atomic_load_n(&wait.done, __ATOMIC_ACQUIRE))
+        {
+            asm volatile("pause");
+        }
+    }
+    if (page->flags & CACHE_PAGE_ERROR)
+    {
+        pagecache_put(page);
+        return NULL;
+    }
+    return page;
+}
+
+void pagecache_put(cache_page_t *page)
+{
+    uint32_t flags = spin_lock_irqsave(&pagecache_lock);
+    if (--page->pins == 0 && (page->flags & CACHE_PAGE_ERROR))
+    {
+        pagecache_free(page);
+    }
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+}
+
+static bool pagecache_in_range(block_device_t *dev, uint64_t offset, size_t len)
+{
+    uint64_t size = dev->sectors * BLOCK_SECTOR_SIZE;
+    return offset <= size && len <= size - offset;
+}
+
+bool pagecache_read(block_device_t *dev, uint64_t offset, size_t len, void *buffer)
+{
+    if (!pagecache_in_range(dev, offset, len))
+    {
+        return false;
+    }
+    uint8_t *pos = buffer;
+    while (len > 0)
+    {
+        size_t in_page = offset % PAGE_SIZE;
+        size_t chunk = PAGE_SIZE - in_page < len ? PAGE_SIZE - in_page : len;
+        cache_page_t *page = pagecache_get(dev, offset / PAGE_SIZE);
+        if (page == NULL)
+        {
+            return false;
+        }
+        memcpy(pos, (uint8_t*) page->data + in_page, chunk);
+        pagecache_put(page);
+
+        offset += chunk;
+        pos += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+bool pagecache_write(block_device_t *dev, uint64_t offset, size_t len, const void *buffer)
+{
+    if (!pagecache_in_range(dev, offset, len))
+    {
+        return false;
+    }
+    const uint8_t *pos = buffer;
+    while (len > 0)
+    {
+        size_t in_page = offset % PAGE_SIZE;
+        size_t chunk = PAGE_SIZE - in_page < len ? PAGE_SIZE - in_page : len;
+        cache_page_t *page = pagecache_get(dev, offset / PAGE_SIZE);
+        if (page == NULL)
+        {
+            return false;
+        }
+        memcpy((uint8_t*) page->data + in_page, pos, chunk);
+
+        // Only the sectors touched go back to the device
+        uint64_t first = offset / BLOCK_SECTOR_SIZE;
+        uint64_t last = (offset + chunk - 1) / BLOCK_SECTOR_SIZE;
+        void *data = (uint8_t*) page->data + (in_page & ~(size_t) (BLOCK_SECTOR_SIZE - 1));
+        bool ok = block_write(dev, first, (uint32_t) (last - first + 1), data);
+        pagecache_put(page);
+        if (!ok)
+        {
+            return false;
+        }
+
+        offset += chunk;
+        pos += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+void pagecache_get_stats(pagecache_stats_t *out)
+{
+    uint32_t flags = spin_lock_irqsave(&pagecache_lock);
+    *out = stats;
+    out->active = active.count;
+    spin_unlock_irqrestore(&pagecache_lock, flags);
+}
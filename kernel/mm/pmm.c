@@ -0,0 +1,598 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <boot/multiboot.h>
+#include <cpu/features.h>
+#include <libk/io.h>
+#include <libk/string.h>
+#include <mm/pmm.h>
+#include <sync/mcslock.h>
+#include <sync/spinlock.h>
+
+#define PMM_NONE 0xFFFFFFFF
+#define PMM_MAX_RESERVED 32
+
+// Defined in linker.ld
+extern char kernel_start[];
+extern char kernel_end[];
+
+typedef struct pmm_range_t
+{
+    uint64_t start;
+    uint64_t end;
+} pmm_range_t;
+
+// One bit per frame across the whole physical range, set when the frame
+// is allocated or reserved. Free frames are additionally kept in buddy
+// blocks on per-order lists threaded through the frame array.
+static uint32_t *pmm_bitmap;
+static pmm_frame_t *pmm_frames;
+static uint32_t pmm_frame_count;
+static uint32_t pmm_free;
+static uint32_t pmm_usable;
+static uint32_t pmm_free_lists[PMM_MAX_ORDER + 1];
+
+// Every CPU allocates from the one set of lists, so waiters queue up on
+// their own MCS nodes rather than hammering a shared lock word
+static mcslock_t pmm_lock = MCSLOCK_INIT("pmm");
+
+// Frames zeroed by idle CPUs, linked through pmm_frame_t.next. The buddy
+// lists see them as allocated.
+static spinlock_t pmm_zero_lock = SPINLOCK_INIT("pmm_zero");
+static uint32_t pmm_zero_list = PMM_NONE;
+static uint32_t pmm_zero_count;
+static uint32_t pmm_zero_target;
+
+static pmm_range_t pmm_reserved[PMM_MAX_RESERVED];
+static size_t pmm_reserved_count;
+
+static inline bool pmm_test(uint32_t frame)
+{
+    return pmm_bitmap[frame / 32] & (1u << (frame % 32));
+}
+
+static void pmm_mark(uint32_t frame, uint32_t count, bool used)
+{
+    uint32_t end = frame + count;
+    while (frame < end)
+    {
+        // Whole words at a time once the run is aligned
+        if (frame % 32 == 0 && end - frame >= 32)
+        {
+            pmm_bitmap[frame / 32] = used ? 0xFFFFFFFF : 0;
+            frame += 32;
+            continue;
+        }
+
+        if (used)
+        {
+            pmm_bitmap[frame / 32] |= 1u << (frame % 32);
+        }
+        else
+        {
+            pmm_bitmap[frame / 32] &= ~(1u << (frame % 32));
+        }
+        ++frame;
+    }
+}
+
+static void pmm_list_push(uint32_t frame, unsigned order)
+{
+    pmm_frame_t *f = &pmm_frames[frame];
+    f->order = order;
+    f->flags |= PMM_FRAME_FREE;
+    f->prev = PMM_NONE;
+    f->next = pmm_free_lists[order];
+    if (f->next != PMM_NONE)
+    {
+        pmm_frames[f->next].prev = frame;
+    }
+    pmm_free_lists[order] = frame;
+}
+
+static void pmm_list_remove(uint32_t frame, unsigned order)
+{
+    pmm_frame_t *f = &pmm_frames[frame];
+    if (f->prev != PMM_NONE)
+    {
+        pmm_frames[f->prev].next = f->next;
+    }
+    else
+    {
+        pmm_free_lists[order] = f->next;
+    }
+    if (f->next != PMM_NONE)
+    {
+        pmm_frames[f->next].prev = f->prev;
+    }
+    f->flags &= ~PMM_FRAME_FREE;
+}
+
+static void pmm_reserve_range(uint64_t start, uint64_t end)
+{
+    // Ranges touching the same frames share an entry, a module and its
+    // command line usually do
+    for (size_t i = 0; i < pmm_reserved_count; ++i)
+    {
+        pmm_range_t *range = &pmm_reserved[i];
+        if (PAGE_ALIGN_DOWN(start) <= PAGE_ALIGN_UP(range->end) && PAGE_ALIGN_DOWN(range->start) <= PAGE_ALIGN_UP(end))
+        {
+            range->start = start < range->start ? start : range->start;
+            range->end = end > range->end ? end : range->end;
+            return;
+        }
+    }
+    if (pmm_reserved_count < PMM_MAX_RESERVED)
+    {
+        pmm_reserved[pmm_reserved_count].start = start;
+        pmm_reserved[pmm_reserved_count].end = end;
+        ++pmm_reserved_count;
+        return;
+    }
+
+    // Handing the range out as free memory would let it be overwritten,
+    // holding back everything up to the nearest entry is the lesser evil
+    size_t nearest = 0;
+    uint64_t best = UINT64_MAX;
+    for (size_t i = 0; i < pmm_reserved_count; ++i)
+    {
+        uint64_t gap = start >= pmm_reserved[i].end ? start - pmm_reserved[i].end : pmm_reserved[i].start - end;
+        if (gap < best)
+        {
+            best = gap;
+            nearest = i;
+        }
+    }
+    kprintf("pmm: reserved range table full, widening an entry by %d KiB\n", (uint32_t) (best >> 10));
+    pmm_range_t *range = &pmm_reserved[nearest];
+    range->start = start < range->start ? start : range->start;
+    range->end = end > range->end ? end : range->end;
+}
+
+static bool pmm_is_reserved(uint64_t start, uint64_t end)
+{
+    for (size_t i = 0; i < pmm_reserved_count; ++i)
+    {
+        if (start < pmm_reserved[i].end && pmm_reserved[i].start < end)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Modules are used in place after boot, so their pages and the strings
+// describing them have to survive the frame allocator coming up
+static void pmm_reserve_boot_data(multiboot_info_t *mbi)
+{
+    if (mbi->flags & MULTIBOOT_INFO_CMDLINE)
+    {
+        const char *cmdline = phys_to_virt(mbi->cmdline);
+        pmm_reserve_range(mbi->cmdline, mbi->cmdline + strlen(cmdline) + 1);
+    }
+    if (!(mbi->flags & MULTIBOOT_INFO_MODS) || mbi->mods_count == 0)
+    {
+        return;
+    }
+
+    multiboot_module_t *mods = phys_to_virt(mbi->mods_addr);
+    pmm_reserve_range(mbi->mods_addr, mbi->mods_addr + mbi->mods_count * sizeof(*mods));
+    for (uint32_t i = 0; i < mbi->mods_count; ++i)
+    {
+        pmm_reserve_range(mods[i].mod_start, PAGE_ALIGN_UP((uint64_t)mods[i].mod_end));
+        if (mods[i].cmdline != 0)
+        {
+            const char *cmdline = phys_to_virt(mods[i].cmdline);
+            pmm_reserve_range(mods[i].cmdline, mods[i].cmdline + strlen(cmdline) + 1);
+        }
+    }
+}
+
+#define mmap_for_each(mbi, entry) \
+    for (multiboot_mmap_entry_t *entry = phys_to_virt((mbi)->mmap_addr); \
+        (uintptr_t) entry < (uintptr_t) phys_to_virt((mbi)->mmap_addr + (mbi)->mmap_length); \
+        entry = (multiboot_mmap_entry_t*) ((uintptr_t) entry + entry->size + sizeof(entry->size)))
+
+// Finds room for the allocator's own bitmap and frame array in usable
+// memory that nothing else has claimed yet
+static uintptr_t pmm_place_metadata(multiboot_info_t *mbi, size_t size)
+{
+    mmap_for_each(mbi, entry)
+    {
+        if (entry->type != MULTIBOOT_MEMORY_AVAILABLE)
+        {
+            continue;
+        }
+
+        uint64_t start = PAGE_ALIGN_UP(entry->addr);
+        uint64_t end = entry->addr + entry->len;
+        if (end > (uint64_t) pmm_frame_count << PAGE_SHIFT)
+        {
+            end = (uint64_t) pmm_frame_count << PAGE_SHIFT;
+        }
+        if (start < 0x100000)
+        {
+            start = 0x100000;
+        }
+
+        while (start + size <= end)
+        {
+            if (!pmm_is_reserved(start, start + size))
+            {
+                return start;
+            }
+            start += PAGE_SIZE;
+        }
+    }
+    return 0;
+}
+
+void pmm_init(multiboot_info_t *mbi)
+{
+    if (!(mbi->flags & MULTIBOOT_INFO_MEM_MAP))
+    {
+        kprintf("pmm: bootloader did not provide a memory map\n");
+        return;
+    }
+
+    uint64_t top = 0;
+    mmap_for_each(mbi, entry)
+    {
+        if (entry->type == MULTIBOOT_MEMORY_AVAILABLE && entry->addr + entry->len > top)
+        {
+            top = entry->addr + entry->len;
+        }
+    }
+    // Frames are handed out as direct mapped memory, anything above the
+    // direct map is left alone for now
+    if (top > DIRECT_MAP_SIZE)
+    {
+        kprintf("pmm: ignoring memory above %d MiB\n", DIRECT_MAP_SIZE >> 20);
+        top = DIRECT_MAP_SIZE;
+    }
+    pmm_frame_count = top >> PAGE_SHIFT;
+
+    // The first MiB holds the IVT, BIOS data and the EBDA
+    pmm_reserve_range(0, 0x100000);
+    pmm_reserve_range(virt_to_phys(kernel_start), PAGE_ALIGN_UP(virt_to_phys(kernel_end)));
+    pmm_reserve_range(virt_to_phys(mbi), virt_to_phys(mbi) + sizeof(*mbi));
+    pmm_reserve_range(mbi->mmap_addr, mbi->mmap_addr + mbi->mmap_length);
+    pmm_reserve_boot_data(mbi);
+
+    size_t bitmap_size = ((pmm_frame_count + 31) / 32) * sizeof(uint32_t);
+    size_t meta_size = PAGE_ALIGN_UP(bitmap_size + pmm_frame_count * sizeof(pmm_frame_t));
+    uintptr_t meta = pmm_place_metadata(mbi, meta_size);
+    if (meta == 0)
+    {
+        kprintf("pmm: no room for %d KiB of frame metadata\n", meta_size / 1024);
+        pmm_frame_count = 0;
+        return;
+    }
+    pmm_reserve_range(meta, meta + meta_size);
+
+    pmm_bitmap = phys_to_virt(meta);
+    pmm_frames = phys_to_virt(meta + bitmap_size);
+    memset(pmm_bitmap, 0xFF, bitmap_size);
+    memset(pmm_frames, 0, pmm_frame_count * sizeof(pmm_frame_t));
+    for (unsigned i = 0; i <= PMM_MAX_ORDER; ++i)
+    {
+        pmm_free_lists[i] = PMM_NONE;
+    }
+
+    mmap_for_each(mbi, entry)
+    {
+        if (entry->type != MULTIBOOT_MEMORY_AVAILABLE || entry->addr >= top)
+        {
+            continue;
+        }
+
+        uint64_t end = entry->addr + entry->len;
+        if (end > top)
+        {
+            end = top;
+        }
+        uint32_t first = PAGE_ALIGN_UP(entry->addr) >> PAGE_SHIFT;
+        uint32_t last = end >> PAGE_SHIFT;
+        if (last > first)
+        {
+            pmm_mark(first, last - first, false);
+        }
+    }
+
+    for (size_t i = 0; i < pmm_reserved_count; ++i)
+    {
+        uint64_t start = pmm_reserved[i].start >> PAGE_SHIFT;
+        uint64_t end = PAGE_ALIGN_UP(pmm_reserved[i].end) >> PAGE_SHIFT;
+        if (end > pmm_frame_count)
+        {
+            end = pmm_frame_count;
+        }
+        if (start < end)
+        {
+            pmm_mark(start, end - start, true);
+        }
+    }
+
+    // Carve each run of free frames into the largest aligned buddy blocks
+    uint32_t frame = 0;
+    while (frame < pmm_frame_count)
+    {
+        if (pmm_test(frame))
+        {
+            ++frame;
+            continue;
+        }
+
+        unsigned order = 0;
+        while (order < PMM_MAX_ORDER
+            && (frame & ((2u << order) - 1)) == 0
+            && frame + (2u << order) <= pmm_frame_count)
+        {
+            uint32_t next = frame + (1u << order);
+            bool all_free = true;
+            for (uint32_t i = next; i < next + (1u << order); ++i)
+            {
+                if (pmm_test(i))
+                {
+                    all_free = false;
+                    break;
+                }
+            }
+            if (!all_free)
+            {
+                break;
+            }
+            ++order;
+        }
+
+        pmm_list_push(frame, order);
+        pmm_free += 1u << order;
+        frame += 1u << order;
+    }
+    pmm_usable = pmm_free;
+    pmm_zero_target = pmm_usable / PMM_ZERO_POOL_SHARE;
+    if (pmm_zero_target > PMM_ZERO_POOL_MAX)
+    {
+        pmm_zero_target = PMM_ZERO_POOL_MAX;
+    }
+
+    kprintf("pmm: %d MiB free of %d MiB\n", pmm_free / 256, pmm_frame_count / 256);
+}
+
+static uintptr_t pmm_alloc_locked(unsigned order)
+{
+    unsigned found = order;
+    while (found <= PMM_MAX_ORDER && pmm_free_lists[found] == PMM_NONE)
+    {
+        ++found;
+    }
+    if (found > PMM_MAX_ORDER)
+    {
+        return 0;
+    }
+
+    uint32_t frame = pmm_free_lists[found];
+    pmm_list_remove(frame, found);
+
+    // Hand the unused upper halves back down the lists
+    while (found > order)
+    {
+        --found;
+        pmm_list_push(frame + (1u << found), found);
+    }
+
+    pmm_frames[frame].order = order;
+    pmm_frames[frame].slab = NULL;
+    pmm_frames[frame].private = 0;
+    pmm_frames[frame].refcount = 1;
+    pmm_mark(frame, 1u << order, true);
+    pmm_free -= 1u << order;
+    return (uintptr_t) frame << PAGE_SHIFT;
+}
+
+static uintptr_t pmm_alloc_buddy(unsigned order)
+{
+    mcs_node_t node;
+    uint32_t flags = mcs_lock_irqsave(&pmm_lock, &node);
+    uintptr_t addr = pmm_alloc_locked(order);
+    mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+    return addr;
+}
+
+static uintptr_t pmm_zero_take(void)
+{
+    uint32_t flags = spin_lock_irqsave(&pmm_zero_lock);
+    uint32_t frame = pmm_zero_list;
+    if (frame != PMM_NONE)
+    {
+        pmm_zero_list = pmm_frames[frame].next;
+        --pmm_zero_count;
+    }
+    spin_unlock_irqrestore(&pmm_zero_lock, flags);
+
+    if (frame == PMM_NONE)
+    {
+        return 0;
+    }
+    // The list link shares its word with the owner's slab pointer
+    pmm_frames[frame].slab = NULL;
+    return (uintptr_t) frame << PAGE_SHIFT;
+}
+
+uintptr_t pmm_alloc_frames(unsigned order)
+{
+    if (order > PMM_MAX_ORDER)
+    {
+        return 0;
+    }
+
+    uintptr_t addr = pmm_alloc_buddy(order);
+    // Zeroed frames are still free memory, hand them out before failing
+    if (addr == 0 && order == 0)
+    {
+        addr = pmm_zero_take();
+    }
+    return addr;
+}
+
+uintptr_t pmm_alloc_frame(void)
+{
+    return pmm_alloc_frames(0);
+}
+
+uintptr_t pmm_alloc_zeroed_frame(void)
+{
+    uintptr_t addr = pmm_zero_take();
+    if (addr == 0)
+    {
+        addr = pmm_alloc_buddy(0);
+        if (addr != 0)
+        {
+            memset(phys_to_virt(addr), 0, PAGE_SIZE);
+        }
+    }
+    return addr;
+}
+
+// A frame in the pool may wait a long time for its user, so it is zeroed
+// with non-temporal stores where possible rather than through the cache
+static void pmm_clear_frame(void *page)
+{
+    if (!cpu_has(CPU_FEATURE_SSE2))
+    {
+        memset(page, 0, PAGE_SIZE);
+        return;
+    }
+
+    uint32_t blocks = PAGE_SIZE / 16;
+    asm volatile("1:\n\t"
+                 "movnti %2, (%0)\n\t"
+                 "movnti %2, 4(%0)\n\t"
+                 "movnti %2, 8(%0)\n\t"
+                 "movnti %2, 12(%0)\n\t"
+                 "add $16, %0\n\t"
+                 "dec %1\n\t"
+                 "jnz 1b\n\t"
+                 "sfence"
+                 : "+r"(page), "+r"(blocks)
+                 : "r"(0)
+                 : "memory");
+}
+
+bool pmm_zero_idle(void)
+{
+    // Unlocked reads, a stale value costs one frame too many or too few
+    if (pmm_zero_count >= pmm_zero_target || pmm_free < pmm_usable / PMM_ZERO_RESERVE_SHARE)
+    {
+        return false;
+    }
+    uintptr_t addr = pmm_alloc_buddy(0);
+    if (addr == 0)
+    {
+        return false;
+    }
+    pmm_clear_frame(phys_to_virt(addr));
+
+    uint32_t frame = addr >> PAGE_SHIFT;
+    uint32_t flags = spin_lock_irqsave(&pmm_zero_lock);
+    // Another idle CPU may have filled the pool meanwhile
+    bool keep = pmm_zero_count < pmm_zero_target;
+    if (keep)
+    {
+        pmm_frames[frame].next = pmm_zero_list;
+        pmm_zero_list = frame;
+        ++pmm_zero_count;
+    }
+    spin_unlock_irqrestore(&pmm_zero_lock, flags);
+
+    if (!keep)
+    {
+        pmm_free_frame(addr);
+    }
+    return keep;
+}
+
+static void pmm_free_locked(uint32_t frame, unsigned order)
+{
+    pmm_frames[frame].refcount = 0;
+    pmm_mark(frame, 1u << order, false);
+    pmm_free += 1u << order;
+
+    while (order < PMM_MAX_ORDER)
+    {
+        uint32_t buddy = frame ^ (1u << order);
+        if (buddy >= pmm_frame_count
+            || !(pmm_frames[buddy].flags & PMM_FRAME_FREE)
+            || pmm_frames[buddy].order != order)
+        {
+            break;
+        }
+        pmm_list_remove(buddy, order);
+        frame &= ~(1u << order);
+        ++order;
+    }
+    pmm_list_push(frame, order);
+}
+
+void pmm_free_frames(uintptr_t addr, unsigned order)
+{
+    uint32_t frame = addr >> PAGE_SHIFT;
+    mcs_node_t node;
+    uint32_t flags = mcs_lock_irqsave(&pmm_lock, &node);
+    bool valid = frame < pmm_frame_count && pmm_test(frame);
+    if (valid)
+    {
+        pmm_free_locked(frame, order);
+    }
+    mcs_unlock_irqrestore(&pmm_lock, &node, flags);
+
+    if (!valid)
+    {
+        kprintf("pmm: bad free of frame %x\n", addr);
+    }
+}
+
+void pmm_free_frame(uintptr_t addr)
+{
+    pmm_free_frames(addr, 0);
+}
+
+void pmm_frame_get(uintptr_t addr)
+{
+    pmm_frame_t *f = pmm_frame(addr);
+    if (f != NULL)
+    {
+        __atomic_fetch_add(&f->refcount, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void pmm_frame_put(uintptr_t addr)
+{
+    pmm_frame_t *f = pmm_frame(addr);
+    if (f != NULL && __atomic_sub_fetch(&f->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        pmm_free_frame(addr);
+    }
+}
+
+unsigned pmm_frame_refs(uintptr_t addr)
+{
+    pmm_frame_t *f = pmm_frame(addr);
+    return f != NULL ? __atomic_load_n(&f->refcount, __ATOMIC_ACQUIRE) : 0;
+}
+
+pmm_frame_t *pmm_frame(uintptr_t addr)
+{
+    uint32_t frame = addr >> PAGE_SHIFT;
+    return frame < pmm_frame_count ? &pmm_frames[frame] : NULL;
+}
+
+size_t pmm_free_count(void)
+{
+    return pmm_free + pmm_zero_count;
+}
+
+size_t pmm_total_count(void)
+{
+    return pmm_usable;
+}
@@ -0,0 +1,491 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cpu/irqflags.h>
+#include <cpu/percpu.h>
+#include <libk/io.h>
+#include <libk/string.h>
+#include <mm/pmm.h>
+#include <mm/slab.h>
+
+// Slabs grow until the wasted tail is under 1/8th of the slab or this
+// order is reached
+#define SLAB_MAX_ORDER 3
+#define SLAB_MIN_ALIGN sizeof(void*)
+#define SLAB_COLOR_STEP 64
+
+#define ALIGN_UP(val, align) (((val) + (align) - 1) & ~((align) - 1))
+
+static kmem_cache_t cache_cache;
+static kmem_cache_t magazine_cache;
+static kmem_cache_t *cache_list;
+static spinlock_t cache_list_lock = SPINLOCK_INIT("kmem_cache_list");
+
+static void slab_list_push(kmem_slab_t **list, kmem_slab_t *slab)
+{
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list != NULL)
+    {
+        (*list)->prev = slab;
+    }
+    *list = slab;
+}
+
+static void slab_list_remove(kmem_slab_t **list, kmem_slab_t *slab)
+{
+    if (slab->prev != NULL)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        *list = slab->next;
+    }
+    if (slab->next != NULL)
+    {
+        slab->next->prev = slab->prev;
+    }
+}
+
+static void slab_layout(kmem_cache_t *cache)
+{
+    for (unsigned order = 0; order <= SLAB_MAX_ORDER; ++order)
+    {
+        size_t slab_size = PAGE_SIZE << order;
+        size_t count = (slab_size - sizeof(kmem_slab_t)) / (cache->size + sizeof(uint16_t));
+        size_t header = ALIGN_UP(sizeof(kmem_slab_t) + count * sizeof(uint16_t), cache->align);
+        while (count != 0 && header + count * cache->size > slab_size)
+        {
+            --count;
+            header = ALIGN_UP(sizeof(kmem_slab_t) + count * sizeof(uint16_t), cache->align);
+        }
+        if (count == 0)
+        {
+            continue;
+        }
+
+        size_t waste = slab_size - header - count * cache->size;
+        cache->order = order;
+        cache->objects_per_slab = count;
+        cache->header_size = header;
+        // Spare bytes at the end of the slab let successive slabs start
+        // their objects at different cache line offsets
+        cache->color_step = cache->align > SLAB_COLOR_STEP ? cache->align : SLAB_COLOR_STEP;
+        cache->colors = waste / cache->color_step + 1;
+        if (waste * 8 <= slab_size)
+        {
+            return;
+        }
+    }
+}
+
+static bool cache_setup(kmem_cache_t *cache, const char *name, size_t size, size_t align, kmem_ctor_t ctor)
+{
+    memset(cache, 0, sizeof(*cache));
+    if (align < SLAB_MIN_ALIGN)
+    {
+        align = SLAB_MIN_ALIGN;
+    }
+    cache->name = name;
+    cache->align = align;
+    cache->size = ALIGN_UP(size, align);
+    cache->ctor = ctor;
+    cache->lock = (spinlock_t) SPINLOCK_INIT(name);
+    cache->depot_lock = (spinlock_t) SPINLOCK_INIT(name);
+    cache->magazines = true;
+    slab_layout(cache);
+    if (cache->objects_per_slab == 0)
+    {
+        return false;
+    }
+
+    uint32_t flags = spin_lock_irqsave(&cache_list_lock);
+    cache->next_cache = cache_list;
+    cache_list = cache;
+    spin_unlock_irqrestore(&cache_list_lock, flags);
+    return true;
+}
+
+static kmem_slab_t *slab_grow(kmem_cache_t *cache)
+{
+    uintptr_t phys = pmm_alloc_frames(cache->order);
+    if (phys == 0)
+    {
+        return NULL;
+    }
+
+    kmem_slab_t *slab = phys_to_virt(phys);
+    slab->cache = cache;
+    slab->objects = (uint8_t*) slab + cache->header_size + cache->color_next * cache->color_step;
+    slab->free_count = cache->objects_per_slab;
+    cache->color_next = (cache->color_next + 1) % cache->colors;
+
+    // Hand objects out in address order
+    for (uint16_t i = 0; i < cache->objects_per_slab; ++i)
+    {
+        slab->free_stack[i] = cache->objects_per_slab - 1 - i;
+    }
+
+    if (cache->ctor != NULL)
+    {
+        for (uint16_t i = 0; i < cache->objects_per_slab; ++i)
+        {
+            cache->ctor(slab->objects + i * cache->size);
+        }
+    }
+
+    for (unsigned i = 0; i < (1u << cache->order); ++i)
+    {
+        pmm_frame(phys + i * PAGE_SIZE)->slab = slab;
+    }
+
+    ++cache->stats.slabs;
+    return slab;
+}
+
+static void slab_release(kmem_cache_t *cache, kmem_slab_t *slab)
+{
+    uintptr_t phys = virt_to_phys(slab);
+    for (unsigned i = 0; i < (1u << cache->order); ++i)
+    {
+        pmm_frame(phys + i * PAGE_SIZE)->slab = NULL;
+    }
+    pmm_free_frames(phys, cache->order);
+    --cache->stats.slabs;
+}
+
+void slab_init(void)
+{
+    cache_setup(&cache_cache, "kmem_cache", sizeof(kmem_cache_t), __alignof__(kmem_cache_t), NULL);
+    // Magazines come from a cache without any, so refilling a CPU never
+    // recurses into itself
+    cache_setup(&magazine_cache, "kmem_magazine", sizeof(kmem_magazine_t), 0, NULL);
+    magazine_cache.magazines = false;
+}
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align, kmem_ctor_t ctor)
+{
+    kmem_cache_t *cache = kmem_cache_alloc(&cache_cache);
+    if (cache != NULL && !cache_setup(cache, name, size, align, ctor))
+    {
+        kprintf("slab: %s objects of %d bytes are too large for a cache\n", name, size);
+        kmem_cache_free(&cache_cache, cache);
+        cache = NULL;
+    }
+    return cache;
+}
+
+static void *slab_take(kmem_cache_t *cache)
+{
+    uint32_t flags = spin_lock_irqsave(&cache->lock);
+    kmem_slab_t *slab = cache->partial;
+    if (slab != NULL)
+    {
+        ++cache->stats.hits;
+    }
+    else if ((slab = cache->empty) != NULL)
+    {
+        ++cache->stats.hits;
+        slab_list_remove(&cache->empty, slab);
+        slab_list_push(&cache->partial, slab);
+    }
+    else
+    {
+        ++cache->stats.misses;
+        slab = slab_grow(cache);
+        if (slab == NULL)
+        {
+            spin_unlock_irqrestore(&cache->lock, flags);
+            return NULL;
+        }
+        slab_list_push(&cache->partial, slab);
+    }
+
+    uint16_t index = slab->free_stack[--slab->free_count];
+    if (slab->free_count == 0)
+    {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_push(&cache->full, slab);
+    }
+
+    ++cache->stats.allocs;
+    ++cache->stats.inuse;
+    spin_unlock_irqrestore(&cache->lock, flags);
+    return slab->objects + index * cache->size;
+}
+
+static void *slab_alloc(kmem_cache_t *cache)
+{
+    void *obj = slab_take(cache);
+    if (obj == NULL)
+    {
+        // Out of frames, hand the idle depot objects back and retry. The
+        // cache lock is dropped by now, reaping frees into this cache too.
+        kmem_cache_reap();
+        obj = slab_take(cache);
+    }
+    return obj;
+}
+
+static void slab_free(kmem_cache_t *cache, kmem_slab_t *slab, void *obj)
+{
+    uint16_t index = ((uint8_t*) obj - slab->objects) / cache->size;
+    uint32_t flags = spin_lock_irqsave(&cache->lock);
+    if (slab->free_count == 0)
+    {
+        slab_list_remove(&cache->full, slab);
+        slab_list_push(&cache->partial, slab);
+    }
+    slab->free_stack[slab->free_count++] = index;
+
+    if (slab->free_count == cache->objects_per_slab)
+    {
+        slab_list_remove(&cache->partial, slab);
+        // Keep one empty slab around so a cache hovering at a slab
+        // boundary does not keep going back to the frame allocator
+        if (cache->empty == NULL)
+        {
+            slab_list_push(&cache->empty, slab);
+        }
+        else
+        {
+            slab_release(cache, slab);
+        }
+    }
+
+    ++cache->stats.frees;
+    --cache->stats.inuse;
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+static void magazine_push(kmem_magazine_t **list, kmem_magazine_t *mag)
+{
+    mag->next = *list;
+    *list = mag;
+}
+
+static kmem_magazine_t *magazine_pop(kmem_magazine_t **list)
+{
+    kmem_magazine_t *mag = *list;
+    if (mag != NULL)
+    {
+        *list = mag->next;
+    }
+    return mag;
+}
+
+static void magazine_release(kmem_magazine_t *mag)
+{
+    kmem_slab_t *slab = pmm_frame(virt_to_phys(mag))->slab;
+    slab_free(&magazine_cache, slab, mag);
+}
+
+// Called with interrupts off once both of the CPU's magazines are empty.
+// Trades the empty previous one for a full one from the depot.
+static bool depot_load_full(kmem_cache_t *cache, kmem_cpu_cache_t *cpu)
+{
+    spin_lock(&cache->depot_lock);
+    kmem_magazine_t *full = magazine_pop(&cache->depot_full);
+    if (full == NULL)
+    {
+        spin_unlock(&cache->depot_lock);
+        return false;
+    }
+    --cache->depot_full_count;
+
+    kmem_magazine_t *spare = NULL;
+    if (cpu->previous != NULL)
+    {
+        if (cache->depot_empty_count < KMEM_DEPOT_EMPTY_MAX)
+        {
+            magazine_push(&cache->depot_empty, cpu->previous);
+            ++cache->depot_empty_count;
+        }
+        else
+        {
+            spare = cpu->previous;
+        }
+    }
+    spin_unlock(&cache->depot_lock);
+
+    if (spare != NULL)
+    {
+        magazine_release(spare);
+    }
+    cpu->previous = cpu->loaded;
+    cpu->loaded = full;
+    return true;
+}
+
+// Called with interrupts off once both of the CPU's magazines are full.
+// Trades the full previous one for an empty one, allocating a new
+// magazine when the depot has none.
+static bool depot_load_empty(kmem_cache_t *cache, kmem_cpu_cache_t *cpu)
+{
+    spin_lock(&cache->depot_lock);
+    kmem_magazine_t *empty = magazine_pop(&cache->depot_empty);
+    if (empty != NULL)
+    {
+        --cache->depot_empty_count;
+    }
+    spin_unlock(&cache->depot_lock);
+
+    if (empty == NULL)
+    {
+        empty = slab_alloc(&magazine_cache);
+        if (empty == NULL)
+        {
+            return false;
+        }
+        empty->rounds = 0;
+    }
+
+    if (cpu->previous != NULL)
+    {
+        spin_lock(&cache->depot_lock);
+        magazine_push(&cache->depot_full, cpu->previous);
+        ++cache->depot_full_count;
+        spin_unlock(&cache->depot_lock);
+    }
+    cpu->previous = cpu->loaded;
+    cpu->loaded = empty;
+    return true;
+}
+
+void *kmem_cache_alloc(kmem_cache_t *cache)
+{
+    if (!cache->magazines)
+    {
+        return slab_alloc(cache);
+    }
+
+    uint32_t flags = irq_save();
+    kmem_cpu_cache_t *cpu = &cache->cpus[cpu_id()];
+    if (cpu->loaded == NULL || cpu->loaded->rounds == 0)
+    {
+        if (cpu->previous != NULL && cpu->previous->rounds > 0)
+        {
+            kmem_magazine_t *mag = cpu->loaded;
+            cpu->loaded = cpu->previous;
+            cpu->previous = mag;
+        }
+        else if (!depot_load_full(cache, cpu))
+        {
+            irq_restore(flags);
+            return slab_alloc(cache);
+        }
+    }
+
+    void *obj = cpu->loaded->objects[--cpu->loaded->rounds];
+    ++cpu->allocs;
+    irq_restore(flags);
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t *cache, void *obj)
+{
+    kmem_slab_t *slab = pmm_frame(virt_to_phys(obj))->slab;
+    if (slab == NULL || slab->cache != cache)
+    {
+        kprintf("slab: %x freed to the wrong cache %s\n", obj, cache->name);
+        return;
+    }
+    if (!cache->magazines)
+    {
+        slab_free(cache, slab, obj);
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    kmem_cpu_cache_t *cpu = &cache->cpus[cpu_id()];
+    if (cpu->loaded == NULL || cpu->loaded->rounds == KMEM_MAGAZINE_SIZE)
+    {
+        if (cpu->previous != NULL && cpu->previous->rounds < KMEM_MAGAZINE_SIZE)
+        {
+            kmem_magazine_t *mag = cpu->loaded;
+            cpu->loaded = cpu->previous;
+            cpu->previous = mag;
+        }
+        else if (!depot_load_empty(cache, cpu))
+        {
+            irq_restore(flags);
+            slab_free(cache, slab, obj);
+            return;
+        }
+    }
+
+    cpu->loaded->objects[cpu->loaded->rounds++] = obj;
+    ++cpu->frees;
+    irq_restore(flags);
+}
+
+static void cache_reap(kmem_cache_t *cache)
+{
+    uint32_t flags = spin_lock_irqsave(&cache->depot_lock);
+    kmem_magazine_t *full = cache->depot_full;
+    kmem_magazine_t *empty = cache->depot_empty;
+    cache->depot_full = NULL;
+    cache->depot_empty = NULL;
+    cache->depot_full_count = 0;
+    cache->depot_empty_count = 0;
+    spin_unlock_irqrestore(&cache->depot_lock, flags);
+
+    while (full != NULL)
+    {
+        kmem_magazine_t *next = full->next;
+        for (uint32_t i = 0; i < full->rounds; ++i)
+        {
+            void *obj = full->objects[i];
+            slab_free(cache, pmm_frame(virt_to_phys(obj))->slab, obj);
+        }
+        magazine_release(full);
+        full = next;
+    }
+    while (empty != NULL)
+    {
+        kmem_magazine_t *next = empty->next;
+        magazine_release(empty);
+        empty = next;
+    }
+}
+
+void kmem_cache_reap(void)
+{
+    uint32_t flags = spin_lock_irqsave(&cache_list_lock);
+    kmem_cache_t *list = cache_list;
+    spin_unlock_irqrestore(&cache_list_lock, flags);
+
+    // Caches are never destroyed, the list can be walked unlocked
+    for (kmem_cache_t *cache = list; cache != NULL; cache = cache->next_cache)
+    {
+        if (cache->magazines)
+        {
+            cache_reap(cache);
+        }
+    }
+}
+
+void kmem_cache_dump(void)
+{
+    kprintf("slab caches:\n");
+    for (kmem_cache_t *cache = cache_list; cache != NULL; cache = cache->next_cache)
+    {
+        kmem_cache_stats_t *stats = &cache->stats;
+        kprintf("  %s: %d/%d objs, %d slabs, %d hits, %d misses, %d allocs, %d frees\n",
+            cache->name, stats->inuse, stats->slabs * cache->objects_per_slab, stats->slabs,
+            stats->hits, stats->misses, stats->allocs, stats->frees);
+        if (cache->magazines)
+        {
+            uint32_t allocs = 0;
+            uint32_t frees = 0;
+            for (unsigned i = 0; i < MAX_CPUS; ++i)
+            {
+                allocs += cache->cpus[i].allocs;
+                frees += cache->cpus[i].frees;
+            }
+            kprintf("    magazines: %d allocs, %d frees, depot %d full, %d empty\n",
+                allocs, frees, cache->depot_full_count, cache->depot_empty_count);
+        }
+    }
+}
@@ -0,0 +1,548 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu/fault.h>
+#include <cpu/interrupts.h>
+#include <cpu/irqflags.h>
+#include <cpu/paging.h>
+#include <cpu/percpu.h>
+#include <cpu/regs.h>
+#include <libk/io.h>
+#include <libk/string.h>
+#include <mm/kmalloc.h>
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+#include <sched/sched.h>
+#include <sched/task.h>
+
+#define USER_PDE_COUNT PDE_INDEX(KERNEL_VMA)
+
+// Backs every untouched page that is only read, so reading a large fresh
+// mapping costs no memory. It is never reference counted.
+static uintptr_t vmm_zero_frame;
+
+static inline bool vmm_loaded(address_space_t *as)
+{
+    return read_cr3() == virt_to_phys(as->pd);
+}
+
+static inline void vmm_flush(address_space_t *as, uintptr_t virt)
+{
+    if (vmm_loaded(as))
+    {
+        invlpg(virt);
+    }
+}
+
+static uint32_t vma_page_flags(const vma_t *vma, bool writable)
+{
+    uint32_t flags = 0;
+    if (vma->flags & VMA_USER)
+    {
+        flags |= PAGE_USER;
+    }
+    if (writable && (vma->flags & VMA_WRITE))
+    {
+        flags |= PAGE_WRITE;
+    }
+    return flags;
+}
+
+static vma_t *vmm_find(address_space_t *as, uintptr_t addr)
+{
+    for (vma_t *vma = as->vmas; vma != NULL && vma->start <= addr; vma = vma->next)
+    {
+        if (addr < vma->end)
+        {
+            return vma;
+        }
+    }
+    return NULL;
+}
+
+static void vmm_release_page(address_space_t *as, pte_t *pte, uintptr_t virt)
+{
+    uintptr_t frame = *pte & ~PAGE_FLAGS_MASK;
+    *pte = 0;
+    vmm_flush(as, virt);
+    if (frame != vmm_zero_frame)
+    {
+        pmm_frame_put(frame);
+        --as->resident;
+    }
+}
+
+static void vmm_release_range(address_space_t *as, uintptr_t start, uintptr_t end)
+{
+    uintptr_t virt = start;
+    while (virt < end)
+    {
+        pde_t pde = as->pd[PDE_INDEX(virt)];
+        if (!(pde & PAGE_PRESENT))
+        {
+            // Skip the rest of an absent page table in one step
+            uintptr_t next = (virt & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE;
+            if (next < virt)
+            {
+                break;
+            }
+            virt = next;
+            continue;
+        }
+
+        pte_t *pte = paging_get_pte(as->pd, virt);
+        if (*pte & PAGE_PRESENT)
+        {
+            vmm_release_page(as, pte, virt);
+        }
+        virt += PAGE_SIZE;
+    }
+}
+
+// Maps a fresh frame at virt, zeroed or copied from src
+static bool vmm_map_new(address_space_t *as, const vma_t *vma, uintptr_t virt, uintptr_t src)
+{
+    bool zero = src == 0 || src == vmm_zero_frame;
+    uintptr_t frame = zero ? pmm_alloc_zeroed_frame() : pmm_alloc_frame();
+    if (frame == 0)
+    {
+        return false;
+    }
+    if (!zero)
+    {
+        memcpy(phys_to_virt(frame), phys_to_virt(src), PAGE_SIZE);
+    }
+
+    if (!paging_map(as->pd, virt, frame, vma_page_flags(vma, true)))
+    {
+        pmm_frame_put(frame);
+        return false;
+    }
+    ++as->resident;
+    return true;
+}
+
+static bool vmm_handle_fault(address_space_t *as, uintptr_t addr, uint32_t error)
+{
+    vma_t *vma = vmm_find(as, addr);
+    bool write = error & PAGE_FAULT_WRITE;
+    if (vma == NULL || (error & PAGE_FAULT_RESERVED)
+        || (write && !(vma->flags & VMA_WRITE))
+        || (!write && !(vma->flags & VMA_READ))
+        || ((error & PAGE_FAULT_USER) && !(vma->flags & VMA_USER)))
+    {
+        return false;
+    }
+
+    uintptr_t virt = PAGE_ALIGN_DOWN(addr);
+    pte_t *pte = paging_get_pte(as->pd, virt);
+    if (pte == NULL || !(*pte & PAGE_PRESENT))
+    {
+        // Shared mappings need a real frame from the start, a zero frame
+        // would be copied apart by the first writer
+        if (!write && !(vma->flags & VMA_SHARED))
+        {
+            return paging_map(as->pd, virt, vmm_zero_frame, vma_page_flags(vma, false));
+        }
+        return vmm_map_new(as, vma, virt, 0);
+    }
+
+    if (!write || (*pte & PAGE_WRITE))
+    {
+        // Another fault fixed it up first, only our TLB entry was stale
+        invlpg(virt);
+        return true;
+    }
+
+    uintptr_t frame = *pte & ~PAGE_FLAGS_MASK;
+    if (frame != vmm_zero_frame && pmm_frame_refs(frame) == 1)
+    {
+        // Everyone else already copied or dropped it, no copy needed
+        *pte |= PAGE_WRITE;
+        invlpg(virt);
+        return true;
+    }
+    if (!vmm_map_new(as, vma, virt, frame))
+    {
+        return false;
+    }
+    // vmm_map_new counted the copy, the shared frame no longer counts
+    if (frame != vmm_zero_frame)
+    {
+        pmm_frame_put(frame);
+        --as->resident;
+    }
+    return true;
+}
+
+static void vmm_page_fault(interrupt_registers_t *regs, void *ctx)
+{
+    (void) ctx;
+    uintptr_t addr = read_cr2();
+    task_t *task = current_task();
+    address_space_t *as = task != NULL ? task->mm : NULL;
+    if (addr < KERNEL_VMA && as != NULL)
+    {
+        // Every other holder takes the lock with interrupts off, the fault
+        // cannot have interrupted one on this CPU
+        spin_lock(&as->lock);
+        bool handled = vmm_handle_fault(as, addr, regs->err_code);
+        spin_unlock(&as->lock);
+        if (handled)
+        {
+            return;
+        }
+    }
+
+    // Exceptions have no way to kill the task yet
+    kprintf("vmm: unhandled %s %s fault at 0x%x, eip 0x%x, error %x\n",
+        (regs->err_code & PAGE_FAULT_USER) ? "user" : "kernel",
+        (regs->err_code & PAGE_FAULT_WRITE) ? "write" : "read",
+        addr, regs->eip, regs->err_code);
+    fault_report(regs);
+}
+
+void vmm_init(void)
+{
+    vmm_zero_frame = pmm_alloc_frame();
+    if (vmm_zero_frame == 0)
+    {
+        kprintf("vmm: no memory for the zero frame\n");
+        return;
+    }
+    memset(phys_to_virt(vmm_zero_frame), 0, PAGE_SIZE);
+    register_interrupt_handler(PAGE_FAULT_VECTOR, vmm_page_fault, NULL);
+}
+
+address_space_t *vmm_create(void)
+{
+    address_space_t *as = kmalloc(sizeof(address_space_t), KMALLOC_ZERO);
+    if (as == NULL)
+    {
+        return NULL;
+    }
+    uintptr_t pd = pmm_alloc_frame();
+    if (pd == 0)
+    {
+        kfree(as);
+        return NULL;
+    }
+
+    // Kernel page tables all exist since paging_init, sharing them keeps
+    // every address space in sync with kernel mappings made later
+    as->pd = phys_to_virt(pd);
+    memset(as->pd, 0, USER_PDE_COUNT * sizeof(pde_t));
+    memcpy(as->pd + USER_PDE_COUNT, kernel_page_directory + USER_PDE_COUNT,
+        (PAGE_TABLE_ENTRIES - USER_PDE_COUNT) * sizeof(pde_t));
+    as->lock = (spinlock_t) SPINLOCK_INIT("vmm");
+    as->refcount = 1;
+    as->cpu = cpu_id();
+    return as;
+}
+
+static void vmm_destroy(address_space_t *as)
+{
+    vma_t *vma = as->vmas;
+    while (vma != NULL)
+    {
+        vma_t *next = vma->next;
+        vmm_release_range(as, vma->start, vma->end);
+        kfree(vma);
+        vma = next;
+    }
+    for (size_t i = 0; i < USER_PDE_COUNT; ++i)
+    {
+        if (as->pd[i] & PAGE_PRESENT)
+        {
+            pmm_free_frame(as->pd[i] & ~PAGE_FLAGS_MASK);
+        }
+    }
+    pmm_free_frame(virt_to_phys(as->pd));
+    kfree(as);
+}
+
+void vmm_get(address_space_t *as)
+{
+    __atomic_fetch_add(&as->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void vmm_put(address_space_t *as)
+{
+    if (as != NULL && __atomic_sub_fetch(&as->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        vmm_destroy(as);
+    }
+}
+
+static bool vmm_range_ok(uintptr_t start, size_t len)
+{
+    return len != 0 && (start & (PAGE_SIZE - 1)) == 0 && (len & (PAGE_SIZE - 1)) == 0
+        && start < KERNEL_VMA && len <= KERNEL_VMA - start;
+}
+
+bool vmm_map(address_space_t *as, uintptr_t start, size_t len, uint32_t flags)
+{
+    if (!vmm_range_ok(start, len))
+    {
+        return false;
+    }
+    vma_t *vma = kmalloc(sizeof(vma_t), 0);
+    if (vma == NULL)
+    {
+        return false;
+    }
+    vma->start = start;
+    vma->end = start + len;
+    vma->flags = flags;
+
+    uint32_t irq = spin_lock_irqsave(&as->lock);
+    vma_t **link = &as->vmas;
+    while (*link != NULL && (*link)->end <= start)
+    {
+        link = &(*link)->next;
+    }
+    bool overlaps = *link != NULL && (*link)->start < vma->end;
+    if (!overlaps)
+    {
+        vma->next = *link;
+        *link = vma;
+    }
+    spin_unlock_irqrestore(&as->lock, irq);
+
+    if (overlaps)
+    {
+        kfree(vma);
+        return false;
+    }
+    return true;
+}
+
+void vmm_unmap(address_space_t *as, uintptr_t start, size_t len)
+{
+    if (!vmm_range_ok(start, len))
+    {
+        return;
+    }
+    uintptr_t end = start + len;
+    // Punching a hole splits an area in two, the second half is allocated
+    // up front so nothing allocates under the lock
+    vma_t *spare = kmalloc(sizeof(vma_t), 0);
+
+    uint32_t irq = spin_lock_irqsave(&as->lock);
+    vma_t **link = &as->vmas;
+    while (*link != NULL && (*link)->start < end)
+    {
+        vma_t *vma = *link;
+        if (vma->end <= start)
+        {
+            link = &vma->next;
+            continue;
+        }
+
+        uintptr_t from = vma->start > start ? vma->start : start;
+        uintptr_t to = vma->end < end ? vma->end : end;
+        if (from > vma->start && to < vma->end)
+        {
+            if (spare == NULL)
+            {
+                break;
+            }
+            *spare = (vma_t) { .start = to, .end = vma->end, .flags = vma->flags, .next = vma->next };
+            vma->end = from;
+            vma->next = spare;
+            spare = NULL;
+        }
+        else if (from > vma->start)
+        {
+            vma->end = from;
+        }
+        else if (to < vma->end)
+        {
+            vma->start = to;
+        }
+        else
+        {
+            *link = vma->next;
+            vmm_release_range(as, from, to);
+            kfree(vma);
+            continue;
+        }
+        vmm_release_range(as, from, to);
+        link = &vma->next;
+    }
+    spin_unlock_irqrestore(&as->lock, irq);
+    kfree(spare);
+}
+
+// Gives every page of a shared area a frame before the fork, so both
+// sides end up on the same frames instead of faulting in their own
+static bool vmm_populate(address_space_t *as, const vma_t *vma)
+{
+    for (uintptr_t virt = vma->start; virt < vma->end; virt += PAGE_SIZE)
+    {
+        pte_t *pte = paging_get_pte(as->pd, virt);
+        if ((pte == NULL || !(*pte & PAGE_PRESENT)) && !vmm_map_new(as, vma, virt, 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool vmm_fork_area(address_space_t *parent, address_space_t *child, const vma_t *vma)
+{
+    if ((vma->flags & VMA_SHARED) && !vmm_populate(parent, vma))
+    {
+        return false;
+    }
+
+    bool cow = !(vma->flags & VMA_SHARED) && (vma->flags & VMA_WRITE);
+    for (uintptr_t virt = vma->start; virt < vma->end; virt += PAGE_SIZE)
+    {
+        pte_t *pte = paging_get_pte(parent->pd, virt);
+        if (pte == NULL)
+        {
+            // No page table, nothing in this 4 MiB was touched
+            virt = (virt & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE - PAGE_SIZE;
+            continue;
+        }
+        if (!(*pte & PAGE_PRESENT))
+        {
+            continue;
+        }
+
+        uintptr_t frame = *pte & ~PAGE_FLAGS_MASK;
+        if (cow && (*pte & PAGE_WRITE))
+        {
+            *pte &= ~PAGE_WRITE;
+        }
+        if (!paging_map(child->pd, virt, frame, *pte & PAGE_FLAGS_MASK))
+        {
+            return false;
+        }
+        if (frame != vmm_zero_frame)
+        {
+            pmm_frame_get(frame);
+            ++child->resident;
+        }
+    }
+    return true;
+}
+
+static void vma_free_list(vma_t *list)
+{
+    while (list != NULL)
+    {
+        vma_t *next = list->next;
+        kfree(list);
+        list = next;
+    }
+}
+
+address_space_t *vmm_fork(address_space_t *parent)
+{
+    // Only the parent's CPU ever loads it, so flushing this TLB below is
+    // all the shootdown the write protection needs
+    if (parent->cpu != cpu_id())
+    {
+        return NULL;
+    }
+    address_space_t *child = vmm_create();
+    if (child == NULL)
+    {
+        return NULL;
+    }
+
+    // The copies are allocated up front so nothing allocates under the
+    // lock, going around again if the parent gained areas meanwhile
+    vma_t *spares = NULL;
+    size_t count = 0;
+    uint32_t irq;
+    for (;;)
+    {
+        irq = spin_lock_irqsave(&parent->lock);
+        size_t needed = 0;
+        for (vma_t *vma = parent->vmas; vma != NULL; vma = vma->next)
+        {
+            ++needed;
+        }
+        if (needed <= count)
+        {
+            break;
+        }
+        spin_unlock_irqrestore(&parent->lock, irq);
+
+        while (count < needed)
+        {
+            vma_t *copy = kmalloc(sizeof(vma_t), 0);
+            if (copy == NULL)
+            {
+                vma_free_list(spares);
+                vmm_put(child);
+                return NULL;
+            }
+            copy->next = spares;
+            spares = copy;
+            ++count;
+        }
+    }
+
+    bool ok = true;
+    vma_t **tail = &child->vmas;
+    for (vma_t *vma = parent->vmas; vma != NULL && ok; vma = vma->next)
+    {
+        vma_t *copy = spares;
+        spares = copy->next;
+        *copy = (vma_t) { .start = vma->start, .end = vma->end, .flags = vma->flags, .next = NULL };
+        *tail = copy;
+        tail = &copy->next;
+        ok = vmm_fork_area(parent, child, vma);
+    }
+    // The parent's writable entries just went read-only
+    if (vmm_loaded(parent))
+    {
+        write_cr3(read_cr3());
+    }
+    spin_unlock_irqrestore(&parent->lock, irq);
+    vma_free_list(spares);
+
+    if (!ok)
+    {
+        vmm_put(child);
+        return NULL;
+    }
+    return child;
+}
+
+void vmm_switch(address_space_t *as)
+{
+    pde_t *pd = as != NULL ? as->pd : kernel_page_directory;
+    uintptr_t phys = virt_to_phys(pd);
+    if (read_cr3() != phys)
+    {
+        write_cr3(phys);
+    }
+}
+
+bool vmm_enter(address_space_t *as)
+{
+    task_t *task = current_task();
+    if (task == NULL || (as != NULL && as->cpu != cpu_id()))
+    {
+        return false;
+    }
+    if (as != NULL)
+    {
+        vmm_get(as);
+    }
+
+    uint32_t flags = irq_save();
+    address_space_t *old = task->mm;
+    task->mm = as;
+    vmm_switch(as);
+    irq_restore(flags);
+
+    vmm_put(old);
+    return true;
+}
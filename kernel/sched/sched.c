@@ -0,0 +1,382 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu.h>
+#include <cpu/context.h>
+#include <cpu/features.h>
+#include <cpu/fpu.h>
+#include <cpu/idle.h>
+#include <cpu/irqflags.h>
+#include <libk/io.h>
+#include <libk/string.h>
+#include <mm/kmalloc.h>
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+#include <sched/sched.h>
+#include <sched/softirq.h>
+#include <sched/task.h>
+#include <time/clock.h>
+
+runqueue_t runqueues[MAX_CPUS];
+
+// The boot context turns into the idle task of the boot CPU
+static task_t boot_idle_task;
+
+static void queue_push(task_queue_t *queue, task_t *task)
+{
+    task->next = NULL;
+    task->prev = queue->tail;
+    if (queue->tail != NULL)
+    {
+        queue->tail->next = task;
+    }
+    else
+    {
+        queue->head = task;
+    }
+    queue->tail = task;
+}
+
+static void queue_remove(task_queue_t *queue, task_t *task)
+{
+    if (task->prev != NULL)
+    {
+        task->prev->next = task->next;
+    }
+    else
+    {
+        queue->head = task->next;
+    }
+    if (task->next != NULL)
+    {
+        task->next->prev = task->prev;
+    }
+    else
+    {
+        queue->tail = task->prev;
+    }
+    task->next = NULL;
+    task->prev = NULL;
+}
+
+static void rq_enqueue(runqueue_t *rq, task_t *task)
+{
+    queue_push(&rq->queues[task->priority], task);
+    task->queued = true;
+    rq->bitmap |= 1u << task->priority;
+    ++rq->nr_running;
+}
+
+static void rq_dequeue(runqueue_t *rq, task_t *task)
+{
+    task_queue_t *queue = &rq->queues[task->priority];
+    queue_remove(queue, task);
+    task->queued = false;
+    if (queue->head == NULL)
+    {
+        rq->bitmap &= ~(1u << task->priority);
+    }
+    --rq->nr_running;
+}
+
+static task_t *rq_pick(runqueue_t *rq)
+{
+    if (rq->bitmap == 0)
+    {
+        return rq->idle;
+    }
+    return rq->queues[__builtin_ctz(rq->bitmap)].head;
+}
+
+static void sched_tick(void *ctx)
+{
+    (void) ctx;
+    runqueue_t *rq = this_runqueue();
+    task_t *task = rq->current;
+    if (task == NULL)
+    {
+        return;
+    }
+
+    if (task == rq->idle)
+    {
+        rq->need_resched = rq->bitmap != 0;
+    }
+    else if (task->timeslice == 0 || --task->timeslice == 0)
+    {
+        rq->need_resched = true;
+    }
+}
+
+// Whatever context calls this becomes the idle task of the current CPU
+static void sched_init_runqueue(task_t *idle)
+{
+    runqueue_t *rq = this_runqueue();
+    idle->tid = 0;
+    memcpy(idle->name, "idle", sizeof("idle"));
+    idle->state = TASK_RUNNABLE;
+    idle->priority = SCHED_PRIORITY_IDLE;
+    idle->cpu = cpu_id();
+    idle->switched_in = ktime_ns();
+
+    rq->idle = idle;
+    rq->current = idle;
+}
+
+void sched_init(void)
+{
+    sched_init_runqueue(&boot_idle_task);
+    clock_set_tick_handler(sched_tick, NULL);
+}
+
+void sched_init_ap(void)
+{
+    task_t *idle = kmalloc(sizeof(task_t), KMALLOC_ZERO);
+    if (idle == NULL)
+    {
+        kprintf("sched: no memory for the idle task of cpu %d\n", cpu_id());
+        for (;;)
+        {
+            asm volatile("cli; hlt");
+        }
+    }
+    sched_init_runqueue(idle);
+}
+
+void sched_idle(void)
+{
+    runqueue_t *rq = this_runqueue();
+    for (;;)
+    {
+        irq_disable();
+        softirq_run();
+        if (rq->bitmap != 0)
+        {
+            schedule();
+            continue;
+        }
+        irq_enable();
+
+        // Spare time goes into zeroing frames ahead of the faults and
+        // allocations that want them, a frame at a time so a wakeup never
+        // waits on more than one page
+        if (pmm_zero_idle())
+        {
+            continue;
+        }
+
+        // With MWAIT the enqueue writing the bitmap ends the sleep, waking
+        // an idle CPU needs no reschedule IPI
+        irq_disable();
+        cpu_idle(&rq->bitmap);
+    }
+}
+
+// Whichever task a switch lands in, new or resumed, frees the one that
+// exited on the way out. Must run with interrupts disabled.
+void sched_finish_switch(void)
+{
+    runqueue_t *rq = this_runqueue();
+    if (rq->dead != NULL)
+    {
+        task_t *dead = rq->dead;
+        rq->dead = NULL;
+        fpu_task_exit(dead);
+        vmm_put(dead->mm);
+        kfree(dead->stack);
+        kfree(dead);
+    }
+}
+
+// Must run with interrupts disabled
+static void __schedule(runqueue_t *rq)
+{
+    task_t *prev = rq->current;
+    spin_lock(&rq->lock);
+    rq->need_resched = false;
+
+    // A task still running goes to the back of its priority level. One
+    // that just blocked may already be back if it was woken meanwhile.
+    if (prev != rq->idle && prev->state == TASK_RUNNABLE && !prev->queued)
+    {
+        rq_enqueue(rq, prev);
+    }
+
+    task_t *next = rq_pick(rq);
+    if (next != rq->idle)
+    {
+        rq_dequeue(rq, next);
+    }
+    spin_unlock(&rq->lock);
+
+    if (next->timeslice == 0)
+    {
+        next->timeslice = SCHED_TIMESLICE_TICKS;
+    }
+    if (next == prev)
+    {
+        return;
+    }
+
+    uint64_t now = ktime_ns();
+    prev->runtime_ns += now - prev->switched_in;
+    next->switched_in = now;
+
+    ++rq->switches;
+    rq->current = next;
+    fpu_switch(next);
+    if (next->mm != prev->mm)
+    {
+        vmm_switch(next->mm);
+    }
+    // Idle tasks run on their boot stack and never enter user mode
+    if (next->stack != NULL)
+    {
+        context_set_kernel_stack((uint32_t) next->stack + TASK_STACK_SIZE);
+    }
+    switch_context(&prev->esp, next->esp);
+
+    // Back on prev's stack, possibly much later and if SMP moves tasks on a
+    // different runqueue
+    sched_finish_switch();
+}
+
+void schedule(void)
+{
+    uint32_t flags = irq_save();
+    runqueue_t *rq = this_runqueue();
+    if (rq->current != NULL)
+    {
+        __schedule(rq);
+    }
+    irq_restore(flags);
+}
+
+void sched_yield(void)
+{
+    task_t *task = current_task();
+    if (task != NULL)
+    {
+        task->timeslice = 0;
+    }
+    schedule();
+}
+
+void sched_block(void)
+{
+    uint32_t flags = irq_save();
+    runqueue_t *rq = this_runqueue();
+    spin_lock(&rq->lock);
+    rq->current->state = TASK_BLOCKED;
+    spin_unlock(&rq->lock);
+    __schedule(rq);
+    irq_restore(flags);
+}
+
+// Called with rq->lock held
+static void sched_enqueue_locked(runqueue_t *rq, task_t *task)
+{
+    task->state = TASK_RUNNABLE;
+    rq_enqueue(rq, task);
+    task_t *current = rq->current;
+    if (current != NULL && task->priority < current->priority)
+    {
+        rq->need_resched = true;
+        // An idle CPU looks at the bitmap before every sleep and MWAIT
+        // wakes on the write to it, only HLT needs the interrupt
+        if (current != rq->idle || !cpu_has(CPU_FEATURE_MWAIT))
+        {
+            smp_send_reschedule(task->cpu);
+        }
+    }
+}
+
+void sched_enqueue(task_t *task)
+{
+    runqueue_t *rq = &runqueues[task->cpu];
+    uint32_t flags = spin_lock_irqsave(&rq->lock);
+    sched_enqueue_locked(rq, task);
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+void sched_wait(volatile bool *done)
+{
+    uint32_t flags = irq_save();
+    runqueue_t *rq = this_runqueue();
+    while (!__atomic_load_n(done, __ATOMIC_ACQUIRE))
+    {
+        // Blocked goes out before the flag is read again. A waker on
+        // another CPU sets the flag first and takes our lock to look at
+        // the state, so it either sees us blocked or we see the flag.
+        spin_lock(&rq->lock);
+        rq->current->state = TASK_BLOCKED;
+        spin_unlock(&rq->lock);
+        if (__atomic_load_n(done, __ATOMIC_ACQUIRE))
+        {
+            spin_lock(&rq->lock);
+            rq->current->state = TASK_RUNNABLE;
+            spin_unlock(&rq->lock);
+            break;
+        }
+        __schedule(rq);
+    }
+    irq_restore(flags);
+}
+
+void sched_wake(task_t *task)
+{
+    runqueue_t *rq = &runqueues[task->cpu];
+    uint32_t flags = spin_lock_irqsave(&rq->lock);
+    if (task->state == TASK_BLOCKED && !task->queued)
+    {
+        sched_enqueue_locked(rq, task);
+    }
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+// Called from isr_common_stub once the outermost handler has returned
+void sched_interrupt_exit(void)
+{
+    softirq_run();
+    runqueue_t *rq = this_runqueue();
+    if (rq->need_resched && rq->preempt_count == 0 && rq->current != NULL)
+    {
+        __schedule(rq);
+    }
+}
+
+void preempt_disable(void)
+{
+    ++this_runqueue()->preempt_count;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+void preempt_enable(void)
+{
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    runqueue_t *rq = this_runqueue();
+    if (--rq->preempt_count == 0 && rq->need_resched && !in_interrupt())
+    {
+        schedule();
+    }
+}
+
+void preempt_enable_no_resched(void)
+{
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    --this_runqueue()->preempt_count;
+}
+
+// Tasks reaped here cannot free their own stack while running on it, the
+// next task to run does it for them
+void task_exit(void)
+{
+    irq_disable();
+    runqueue_t *rq = this_runqueue();
+    task_t *task = rq->current;
+    task->state = TASK_DEAD;
+    rq->dead = task;
+    __schedule(rq);
+    __builtin_unreachable();
+}
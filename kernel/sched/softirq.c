@@ -0,0 +1,147 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu.h>
+#include <cpu/irqflags.h>
+#include <cpu/percpu.h>
+#include <sched/softirq.h>
+
+typedef struct softirq_cpu_t
+{
+    uint32_t pending;
+    tasklet_t *tasklets;
+    tasklet_t *tasklets_tail;
+} __attribute__((aligned(64))) softirq_cpu_t;
+
+static softirq_cpu_t softirq_cpus[MAX_CPUS];
+
+// Called with interrupts disabled
+static void tasklet_enqueue(softirq_cpu_t *cpu, tasklet_t *tasklet)
+{
+    tasklet->next = NULL;
+    if (cpu->tasklets_tail != NULL)
+    {
+        cpu->tasklets_tail->next = tasklet;
+    }
+    else
+    {
+        cpu->tasklets = tasklet;
+    }
+    cpu->tasklets_tail = tasklet;
+}
+
+// Swaps scheduled for running in one step. Fails while another CPU is
+// still running the tasklet, which leaves it scheduled.
+static bool tasklet_trylock(tasklet_t *tasklet)
+{
+    uint32_t state = __atomic_load_n(&tasklet->state, __ATOMIC_RELAXED);
+    do
+    {
+        if (state & TASKLET_RUNNING)
+        {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&tasklet->state, &state,
+        (state | TASKLET_RUNNING) & ~TASKLET_SCHEDULED, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    return true;
+}
+
+static void tasklet_softirq(void)
+{
+    uint32_t flags = irq_save();
+    softirq_cpu_t *cpu = &softirq_cpus[cpu_id()];
+    tasklet_t *list = cpu->tasklets;
+    cpu->tasklets = NULL;
+    cpu->tasklets_tail = NULL;
+    irq_restore(flags);
+
+    while (list != NULL)
+    {
+        tasklet_t *next = list->next;
+        if (tasklet_trylock(list))
+        {
+            // Scheduled is already clear so the tasklet may schedule itself
+            // again, it then waits here until this run is over
+            list->fn(list->arg);
+            __atomic_fetch_and(&list->state, ~TASKLET_RUNNING, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            // Scheduled again while running elsewhere, try after that
+            flags = irq_save();
+            tasklet_enqueue(&softirq_cpus[cpu_id()], list);
+            irq_restore(flags);
+            softirq_raise(SOFTIRQ_TASKLET);
+        }
+        list = next;
+    }
+}
+
+static softirq_handler_t softirq_handlers[SOFTIRQ_COUNT] = {
+    [SOFTIRQ_TASKLET] = tasklet_softirq,
+};
+
+void softirq_register(softirq_t nr, softirq_handler_t handler)
+{
+    softirq_handlers[nr] = handler;
+}
+
+void softirq_raise(softirq_t nr)
+{
+    // A task holding interrupts off may be inside a lock a handler needs,
+    // its raise waits for the next interrupt exit like one from a handler
+    bool now = !in_interrupt() && irq_enabled();
+    uint32_t flags = irq_save();
+    softirq_cpus[cpu_id()].pending |= 1u << nr;
+    if (now)
+    {
+        softirq_run();
+    }
+    irq_restore(flags);
+}
+
+void softirq_run(void)
+{
+    percpu_t *cpu = this_cpu();
+    softirq_cpu_t *softirq = &softirq_cpus[cpu->id];
+    if (softirq->pending == 0)
+    {
+        return;
+    }
+
+    // Interrupts arriving meanwhile see a nested depth, so they neither
+    // preempt the handlers nor start another round of softirqs
+    ++cpu->interrupt_depth;
+    for (unsigned round = 0; round < SOFTIRQ_MAX_RESTART && softirq->pending != 0; ++round)
+    {
+        uint32_t pending = softirq->pending;
+        softirq->pending = 0;
+        irq_enable();
+        while (pending != 0)
+        {
+            unsigned nr = __builtin_ctz(pending);
+            pending &= pending - 1;
+            if (softirq_handlers[nr] != NULL)
+            {
+                softirq_handlers[nr]();
+            }
+        }
+        irq_disable();
+    }
+    --cpu->interrupt_depth;
+}
+
+void tasklet_schedule(tasklet_t *tasklet)
+{
+    if (__atomic_fetch_or(&tasklet->state, TASKLET_SCHEDULED, __ATOMIC_ACQ_REL) & TASKLET_SCHEDULED)
+    {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    tasklet_enqueue(&softirq_cpus[cpu_id()], tasklet);
+    irq_restore(flags);
+
+    softirq_raise(SOFTIRQ_TASKLET);
+}
@@ -0,0 +1,56 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu.h>
+#include <cpu/context.h>
+#include <cpu/irqflags.h>
+#include <mm/kmalloc.h>
+#include <sched/sched.h>
+#include <sched/task.h>
+
+static uint32_t next_tid = 1;
+
+// First code a new task runs, switch_context returns here with interrupts
+// still disabled from the schedule() that picked it
+static void task_start(void)
+{
+    sched_finish_switch();
+    irq_enable();
+    task_t *task = current_task();
+    task->entry(task->arg);
+    task_exit();
+}
+
+task_t *task_create(const char *name, task_entry_t entry, void *arg, uint8_t priority)
+{
+    if (priority >= SCHED_PRIORITIES)
+    {
+        return NULL;
+    }
+
+    task_t *task = kmalloc(sizeof(task_t), KMALLOC_ZERO);
+    if (task == NULL)
+    {
+        return NULL;
+    }
+    task->stack = kmalloc(TASK_STACK_SIZE, 0);
+    if (task->stack == NULL)
+    {
+        kfree(task);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < TASK_NAME_LEN - 1 && name[i] != '\0'; ++i)
+    {
+        task->name[i] = name[i];
+    }
+    task->tid = __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
+    task->priority = priority;
+    task->cpu = cpu_id();
+    task->entry = entry;
+    task->arg = arg;
+    task->esp = context_init((uint8_t*) task->stack + TASK_STACK_SIZE, task_start);
+
+    sched_enqueue(task);
+    return task;
+}
@@ -0,0 +1,254 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu.h>
+#include <cpu/irqflags.h>
+#include <cpu/percpu.h>
+#include <libk/io.h>
+#include <sched/sched.h>
+#include <sched/task.h>
+#include <sched/work.h>
+#include <sync/spinlock.h>
+
+static worker_t workers[MAX_CPUS];
+
+// Work queued while the local deque is full or before the CPU has a
+// worker, any worker takes it from here
+static spinlock_t work_inject_lock = SPINLOCK_INIT("work_inject");
+static work_t *work_inject_head;
+static work_t *work_inject_tail;
+
+// Owner only, with interrupts off
+static bool deque_push(work_deque_t *deque, work_t *work)
+{
+    uint32_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    uint32_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    if (bottom - top >= WORK_DEQUE_SIZE)
+    {
+        return false;
+    }
+    __atomic_store_n(&deque->slots[bottom & (WORK_DEQUE_SIZE - 1)], work, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+// Owner only, with interrupts off. Takes the newest entry, which is the
+// one most likely still in this CPU's cache.
+static work_t *deque_pop(work_deque_t *deque)
+{
+    uint32_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint32_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if ((int32_t) (bottom - top) < 0)
+    {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    work_t *work = __atomic_load_n(&deque->slots[bottom & (WORK_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (bottom != top)
+    {
+        return work;
+    }
+
+    // The last entry, a thief may be taking it at the same time
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+        work = NULL;
+    }
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return work;
+}
+
+// Any CPU. Takes the oldest entry, NULL when empty or another thief won.
+static work_t *deque_steal(work_deque_t *deque)
+{
+    uint32_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint32_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if ((int32_t) (bottom - top) <= 0)
+    {
+        return NULL;
+    }
+
+    work_t *work = __atomic_load_n(&deque->slots[top & (WORK_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+        return NULL;
+    }
+    return work;
+}
+
+static void work_inject(work_t *work)
+{
+    uint32_t flags = spin_lock_irqsave(&work_inject_lock);
+    work->next = NULL;
+    if (work_inject_tail != NULL)
+    {
+        work_inject_tail->next = work;
+    }
+    else
+    {
+        work_inject_head = work;
+    }
+    work_inject_tail = work;
+    spin_unlock_irqrestore(&work_inject_lock, flags);
+}
+
+static work_t *work_take_injected(void)
+{
+    if (__atomic_load_n(&work_inject_head, __ATOMIC_RELAXED) == NULL)
+    {
+        return NULL;
+    }
+    uint32_t flags = spin_lock_irqsave(&work_inject_lock);
+    work_t *work = work_inject_head;
+    if (work != NULL)
+    {
+        work_inject_head = work->next;
+        if (work_inject_head == NULL)
+        {
+            work_inject_tail = NULL;
+        }
+    }
+    spin_unlock_irqrestore(&work_inject_lock, flags);
+    return work;
+}
+
+static bool worker_wake(worker_t *worker)
+{
+    task_t *task = __atomic_load_n(&worker->task, __ATOMIC_ACQUIRE);
+    if (task == NULL || !__atomic_exchange_n(&worker->sleeping, 0, __ATOMIC_SEQ_CST))
+    {
+        return false;
+    }
+    worker->wake = true;
+    sched_wake(task);
+    return true;
+}
+
+// The local worker gets the work if it is idle, otherwise the first idle
+// worker elsewhere comes to steal it
+static void work_kick(unsigned cpu)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    unsigned cpus = cpu_count();
+    for (unsigned i = 0; i < cpus; ++i)
+    {
+        if (worker_wake(&workers[(cpu + i) % cpus]))
+        {
+            return;
+        }
+    }
+}
+
+bool work_queue(work_t *work)
+{
+    if (__atomic_exchange_n(&work->pending, 1, __ATOMIC_ACQ_REL))
+    {
+        return false;
+    }
+
+    uint32_t flags = irq_save();
+    unsigned cpu = cpu_id();
+    worker_t *worker = &workers[cpu];
+    if (worker->task == NULL || !deque_push(&worker->deque, work))
+    {
+        work_inject(work);
+    }
+    irq_restore(flags);
+
+    work_kick(cpu);
+    return true;
+}
+
+static work_t *worker_find(worker_t *self, unsigned cpu)
+{
+    uint32_t flags = irq_save();
+    work_t *work = deque_pop(&self->deque);
+    irq_restore(flags);
+    if (work != NULL || (work = work_take_injected()) != NULL)
+    {
+        return work;
+    }
+
+    // Start with the next CPU so thieves spread over their victims
+    unsigned cpus = cpu_count();
+    for (unsigned i = 1; i < cpus; ++i)
+    {
+        worker_t *victim = &workers[(cpu + i) % cpus];
+        if (victim->task != NULL && (work = deque_steal(&victim->deque)) != NULL)
+        {
+            ++self->stolen;
+            return work;
+        }
+    }
+    return NULL;
+}
+
+static void worker_run(worker_t *self, work_t *work)
+{
+    // Cleared first so the work may queue itself again
+    __atomic_store_n(&work->pending, 0, __ATOMIC_RELEASE);
+    work->fn(work);
+    ++self->executed;
+}
+
+static void worker_main(void *arg)
+{
+    worker_t *self = arg;
+    unsigned cpu = cpu_id();
+    for (;;)
+    {
+        work_t *work = worker_find(self, cpu);
+        if (work != NULL)
+        {
+            worker_run(self, work);
+            continue;
+        }
+
+        // Announce the sleep before the last look, a queue that missed the
+        // flag has its work found here
+        self->wake = false;
+        __atomic_store_n(&self->sleeping, 1, __ATOMIC_SEQ_CST);
+        work = worker_find(self, cpu);
+        if (work != NULL)
+        {
+            __atomic_store_n(&self->sleeping, 0, __ATOMIC_RELAXED);
+            worker_run(self, work);
+            continue;
+        }
+        sched_wait(&self->wake);
+    }
+}
+
+void work_init_cpu(void)
+{
+    unsigned cpu = cpu_id();
+    char name[TASK_NAME_LEN];
+    ksnprintf(name, sizeof(name), "worker/%u", cpu);
+    task_t *task = task_create(name, worker_main, &workers[cpu], SCHED_PRIORITY_DEFAULT);
+    if (task == NULL)
+    {
+        kprintf("work: no memory for the worker of cpu %u\n", cpu);
+        return;
+    }
+    __atomic_store_n(&workers[cpu].task, task, __ATOMIC_RELEASE);
+}
+
+void work_dump(void)
+{
+    kprintf("workers:\n");
+    unsigned cpus = cpu_count();
+    for (unsigned i = 0; i < cpus; ++i)
+    {
+        worker_t *worker = &workers[i];
+        kprintf("  cpu %u: %u executed, %u stolen, %u queued\n", i, worker->executed, worker->stolen,
+            worker->deque.bottom - worker->deque.top);
+    }
+}
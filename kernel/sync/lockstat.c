@@ -0,0 +1,40 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libk/io.h>
+#include <sync/lockstat.h>
+
+#ifdef LOCK_STATS
+
+static lock_stats_t *lock_stats_list;
+
+void lock_stats_register(lock_stats_t *stats)
+{
+    if (__atomic_exchange_n(&stats->registered, true, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+
+    lock_stats_t *head = __atomic_load_n(&lock_stats_list, __ATOMIC_RELAXED);
+    do
+    {
+        stats->next = head;
+    }
+    while (!__atomic_compare_exchange_n(&lock_stats_list, &head, stats, true,
+        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Counters are read racily, good enough to spot the hot locks
+void lock_stats_dump(void)
+{
+    kprintf("lock: acquires contended spin-cycles max-spin\n");
+    for (lock_stats_t *stats = __atomic_load_n(&lock_stats_list, __ATOMIC_ACQUIRE);
+        stats != NULL; stats = stats->next)
+    {
+        kprintf("%s %llu %llu %llu %llu\n", stats->name ? stats->name : "?",
+            stats->acquires, stats->contended, stats->spin_cycles, stats->max_spin_cycles);
+    }
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cpu/interrupts.h>
+#include <cpu/syscall.h>
+#include <libk/log.h>
+#include <mm/pmm.h>
+#include <sched/sched.h>
+#include <sched/task.h>
+#include <syscall/syscall.h>
+#include <time/clock.h>
+
+#define SYSCALL_WRITE_CHUNK 256
+
+static bool user_range_ok(uint32_t addr, uint32_t len)
+{
+    return addr + len >= addr && addr + len <= KERNEL_VMA;
+}
+
+static int32_t sys_exit(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    (void) a;
+    (void) b;
+    (void) c;
+    (void) d;
+    task_exit();
+}
+
+static int32_t sys_yield(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    (void) a;
+    (void) b;
+    (void) c;
+    (void) d;
+    sched_yield();
+    return 0;
+}
+
+// Writes go to the kernel log, copied to the kernel first so user memory
+// is only read once
+static int32_t sys_write(uint32_t buf, uint32_t len, uint32_t c, uint32_t d)
+{
+    (void) c;
+    (void) d;
+    if (!user_range_ok(buf, len))
+    {
+        return SYSCALL_EFAULT;
+    }
+
+    char chunk[SYSCALL_WRITE_CHUNK];
+    const char *src = (const char*) buf;
+    for (uint32_t done = 0; done < len; done += SYSCALL_WRITE_CHUNK)
+    {
+        uint32_t count = len - done < SYSCALL_WRITE_CHUNK ? len - done : SYSCALL_WRITE_CHUNK;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            chunk[i] = src[done + i];
+        }
+        log_write(chunk, count);
+    }
+    log_flush();
+    return len;
+}
+
+static int32_t sys_gettid(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    (void) a;
+    (void) b;
+    (void) c;
+    (void) d;
+    return current_task()->tid;
+}
+
+static int32_t sys_clock(uint32_t out, uint32_t b, uint32_t c, uint32_t d)
+{
+    (void) b;
+    (void) c;
+    (void) d;
+    if (out % sizeof(uint32_t) != 0 || !user_range_ok(out, sizeof(uint64_t)))
+    {
+        return SYSCALL_EFAULT;
+    }
+    *(uint64_t*) out = ktime_ns();
+    return 0;
+}
+
+static const syscall_fn_t syscall_table[SYSCALL_COUNT] =
+{
+    [SYS_EXIT] = sys_exit,
+    [SYS_YIELD] = sys_yield,
+    [SYS_WRITE] = sys_write,
+    [SYS_GETTID] = sys_gettid,
+    [SYS_CLOCK] = sys_clock,
+};
+
+void syscall_init(void)
+{
+    syscall_arch_init();
+}
+
+void syscall_dispatch(interrupt_registers_t *regs)
+{
+    uint32_t nr = regs->eax;
+    if (nr >= SYSCALL_COUNT)
+    {
+        regs->eax = SYSCALL_ENOSYS;
+        return;
+    }
+    regs->eax = syscall_table[nr](regs->ebx, regs->esi, regs->edi, regs->ebp);
+}
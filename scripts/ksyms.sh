@@ -0,0 +1,29 @@
+#!/bin/sh
+# Turns `nm -n` output for the kernel into a C symbol table. Only code
+# symbols are kept, sorted by address for the binary search in ksyms.c.
+awk '
+BEGIN {
+    print "#include <debug/ksyms.h>"
+    print ""
+    print "const ksym_t ksyms_table[] ="
+    print "{"
+    count = 0
+    offset = 0
+}
+$2 ~ /^[TtWw]$/ {
+    print "    { 0x" $1 ", " offset " },"
+    names[count++] = $3
+    offset += length($3) + 1
+}
+END {
+    print "};"
+    print ""
+    print "const uint32_t ksyms_count = " count ";"
+    print ""
+    print "const char ksyms_names[] ="
+    for (i = 0; i < count; i++)
+    {
+        print "    \"" names[i] "\\0\""
+    }
+    print "    \"\";"
+}'